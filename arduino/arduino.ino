@@ -3,8 +3,10 @@
 
 #include "sprinkler-alexa.h"
 #include "sprinkler-http.h"
+#include "sprinkler-loop.h"
 #include "sprinkler-mqtt.h"
 #include "sprinkler-ota.h"
+#include "sprinkler-recovery.h"
 #include "sprinkler-setup.h"
 #include "sprinkler-time.h"
 #include "sprinkler-wifi.h"
@@ -13,8 +15,10 @@
 Ticker ticker;
 
 void begin() {
+  Loop.begin();
   ticker.attach(0.6, tick);
   Console.begin(115200);
+  Console.onPending([]() { Loop.wake(); });
 }
 
 void setup() {
@@ -38,6 +42,12 @@ void loop() {
   handleAlexa();
   handleMqtt();
   handleTicks();
+  handleTimers();
+  handleRelays();
+  handleConsole();
+  handleSockets();
+
+  Loop.sleep({wifiDeadline(), otaDeadline(), alexaDeadline(), mqttDeadline(), ticksDeadline(), timersDeadline(), relaysDeadline(), consoleDeadline(), socketsDeadline()});
 }
 
 void tick() {
@@ -46,9 +56,11 @@ void tick() {
 }
 
 void end() {
-  // Boot safety: ensure all zones are OFF regardless of prior state
-  Sprinkler.stop();
-  Console.println("unit", "Boot safety: all zones OFF");
+  // Boot safety: ensure all zones are OFF unless an interrupted run was resumed
+  if (Recovery.action() != RecoveryResume) {
+    Sprinkler.stop();
+    Console.println("unit", "Boot safety: all zones OFF");
+  }
 
   digitalWrite(LED_PIN, LOW);
   ticker.detach();
@@ -0,0 +1,330 @@
+#ifndef SPRINKLER_LIB_JsonReader_H
+#define SPRINKLER_LIB_JsonReader_H
+
+#include <Arduino.h>
+
+// Receives the parse events of a JsonReader. key is the member name inside an
+// object and nullptr inside an array; text is only valid during the call.
+class JsonHandler {
+ public:
+  enum Type { Text, Number, Boolean, Null };
+
+  virtual ~JsonHandler() {}
+
+  virtual void beginObject(const char *key) = 0;
+  virtual void endObject() = 0;
+  virtual void beginArray(const char *key) = 0;
+  virtual void endArray() = 0;
+  virtual void value(const char *key, const char *text, Type type) = 0;
+};
+
+// Incremental (SAX) JSON parser. feed() takes the input in chunks of any size,
+// e.g. straight from onRequestBody, and reports every value as soon as it is
+// complete. Memory is the key/text buffers and a nesting bit stack, whatever
+// the size of the document:
+//
+//   JsonReader reader(handler);
+//   reader.feed(data, len);  // per chunk
+//   if (!reader.finish()) Serial.println(reader.error());
+class JsonReader {
+ public:
+  static const size_t KeySize = 32;
+  static const size_t TextSize = 72;  // a 63 character WPA key
+  static const uint8_t MaxDepth = 16;
+
+  explicit JsonReader(JsonHandler &handler) : handler(handler) { reset(); }
+
+  void reset() {
+    state = Value;
+    strings = TextString;
+    depth = 0;
+    objects = 0;
+    length = 0;
+    offset = 0;
+    failure = nullptr;
+    key[0] = 0;
+    text[0] = 0;
+  }
+
+  // false once the input is invalid, further chunks are ignored
+  bool feed(const uint8_t *data, size_t count) {
+    for (size_t i = 0; i < count && state != Failed; i++, offset++) {
+      step(data[i]);
+    }
+    return state != Failed;
+  }
+
+  // true when the input held exactly one complete value
+  bool finish() {
+    if (state == Literal) {
+      literal();
+    }
+    if (state != Done && state != Failed) {
+      fail("unexpected end");
+    }
+    return state == Done;
+  }
+
+  // stop parsing, e.g. when the handler rejects a value
+  void fail(const char *reason) {
+    if (state != Failed) {
+      failure = reason;
+      state = Failed;
+    }
+  }
+
+  const char *error() const { return failure ? failure : ""; }
+  size_t position() const { return offset; }
+
+ private:
+  enum State { Value, ValueOrEnd, Key, KeyOrEnd, KeyString, Colon, TextString, Escape, Unicode, Literal, Next, Done, Failed };
+
+  static bool isSpace(uint8_t c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; }
+  static bool isLiteral(uint8_t c) { return isalnum(c) || c == '-' || c == '+' || c == '.'; }
+
+  // -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?
+  static bool isNumber(const char *s) {
+    if (*s == '-') s++;
+    if (*s == '0') {
+      s++;
+    } else if (isdigit((uint8_t)*s)) {
+      while (isdigit((uint8_t)*s)) s++;
+    } else {
+      return false;
+    }
+    if (*s == '.') {
+      s++;
+      if (!isdigit((uint8_t)*s)) return false;
+      while (isdigit((uint8_t)*s)) s++;
+    }
+    if (*s == 'e' || *s == 'E') {
+      s++;
+      if (*s == '+' || *s == '-') s++;
+      if (!isdigit((uint8_t)*s)) return false;
+      while (isdigit((uint8_t)*s)) s++;
+    }
+    return *s == 0;
+  }
+
+  bool inObject() const { return objects & (1UL << depth); }
+  const char *member() const { return inObject() ? key : nullptr; }
+
+  void step(uint8_t c) {
+    if (state == Literal) {
+      if (isLiteral(c)) {
+        append(c);
+        return;
+      }
+      literal();  // the delimiter is handled below
+    }
+
+    switch (state) {
+      case Value:
+      case ValueOrEnd:
+        if (isSpace(c)) {
+        } else if (c == ']' && state == ValueOrEnd) {
+          close(false);
+        } else if (c == '{') {
+          open(true);
+        } else if (c == '[') {
+          open(false);
+        } else if (c == '"') {
+          strings = TextString;
+          length = 0;
+          text[0] = 0;
+          state = TextString;
+        } else if (c == '-' || isdigit(c) || c == 't' || c == 'f' || c == 'n') {
+          strings = TextString;
+          length = 0;
+          state = Literal;
+          append(c);
+        } else {
+          fail("unexpected character");
+        }
+        break;
+
+      case Key:
+      case KeyOrEnd:
+        if (isSpace(c)) {
+        } else if (c == '}' && state == KeyOrEnd) {
+          close(true);
+        } else if (c == '"') {
+          strings = KeyString;
+          length = 0;
+          key[0] = 0;
+          state = KeyString;
+        } else {
+          fail("expected a key");
+        }
+        break;
+
+      case KeyString:
+      case TextString:
+        if (c == '"') {
+          if (state == KeyString) {
+            state = Colon;
+          } else {
+            handler.value(member(), text, JsonHandler::Text);
+            advance();
+          }
+        } else if (c == '\\') {
+          state = Escape;
+        } else if (c < 0x20) {
+          fail("control character in string");
+        } else {
+          append(c);
+        }
+        break;
+
+      case Escape:
+        state = strings;
+        switch (c) {
+          case '"': append('"'); break;
+          case '\\': append('\\'); break;
+          case '/': append('/'); break;
+          case 'b': append('\b'); break;
+          case 'f': append('\f'); break;
+          case 'n': append('\n'); break;
+          case 'r': append('\r'); break;
+          case 't': append('\t'); break;
+          case 'u':
+            code = 0;
+            digits = 0;
+            state = Unicode;
+            break;
+          default: fail("bad escape"); break;
+        }
+        break;
+
+      case Unicode:
+        if (!isxdigit(c)) {
+          fail("bad escape");
+          break;
+        }
+        code = code * 16 + (isdigit(c) ? c - '0' : (c | 0x20) - 'a' + 10);
+        if (++digits == 4) {
+          // BMP only, surrogate pairs are kept as two 3 byte sequences
+          if (code < 0x80) {
+            append(code);
+          } else if (code < 0x800) {
+            append(0xC0 | (code >> 6));
+            append(0x80 | (code & 0x3F));
+          } else {
+            append(0xE0 | (code >> 12));
+            append(0x80 | ((code >> 6) & 0x3F));
+            append(0x80 | (code & 0x3F));
+          }
+          state = strings;
+        }
+        break;
+
+      case Colon:
+        if (isSpace(c)) {
+        } else if (c == ':') {
+          state = Value;
+        } else {
+          fail("expected ':'");
+        }
+        break;
+
+      case Next:
+        if (isSpace(c)) {
+        } else if (c == ',') {
+          state = inObject() ? Key : Value;
+        } else if (c == '}' && inObject()) {
+          close(true);
+        } else if (c == ']' && !inObject()) {
+          close(false);
+        } else {
+          fail("expected ',' or a closing bracket");
+        }
+        break;
+
+      case Done:
+        if (!isSpace(c)) {
+          fail("trailing characters");
+        }
+        break;
+
+      default:
+        break;
+    }
+  }
+
+  void append(uint8_t c) {
+    char *buffer = strings == KeyString ? key : text;
+    size_t size = strings == KeyString ? KeySize : TextSize;
+    if (length + 1 >= size) {
+      fail(strings == KeyString ? "key too long" : "value too long");
+      return;
+    }
+    buffer[length++] = c;
+    buffer[length] = 0;
+  }
+
+  void literal() {
+    if (strcmp(text, "true") == 0 || strcmp(text, "false") == 0) {
+      handler.value(member(), text, JsonHandler::Boolean);
+    } else if (strcmp(text, "null") == 0) {
+      handler.value(member(), text, JsonHandler::Null);
+    } else if (isNumber(text)) {
+      handler.value(member(), text, JsonHandler::Number);
+    } else {
+      fail("bad literal");
+      return;
+    }
+    advance();
+  }
+
+  void open(bool object) {
+    if (depth + 1 >= MaxDepth) {
+      fail("nested too deep");
+      return;
+    }
+    if (object) {
+      handler.beginObject(member());
+    } else {
+      handler.beginArray(member());
+    }
+    depth++;
+    if (object) {
+      objects |= 1UL << depth;
+      state = KeyOrEnd;
+    } else {
+      objects &= ~(1UL << depth);
+      state = ValueOrEnd;
+    }
+  }
+
+  void close(bool object) {
+    depth--;
+    if (object) {
+      handler.endObject();
+    } else {
+      handler.endArray();
+    }
+    advance();
+  }
+
+  // a value is complete, the handler may have failed the parse meanwhile
+  void advance() {
+    if (state != Failed) {
+      state = depth ? Next : Done;
+    }
+  }
+
+  JsonHandler &handler;
+  State state;
+  State strings;     // KeyString or TextString, where escapes return to
+  uint8_t depth;
+  uint32_t objects;  // bit n: the container at depth n is an object
+  uint16_t code;
+  uint8_t digits;
+  size_t length;
+  size_t offset;
+  const char *failure;
+  char key[KeySize];
+  char text[TextSize];
+};
+
+#endif
@@ -0,0 +1,161 @@
+#ifndef SPRINKLER_LIB_JsonWriter_H
+#define SPRINKLER_LIB_JsonWriter_H
+
+#include <Print.h>
+
+// Fixed buffer target, e.g. for WebSocket events. Once a write does not fit,
+// it and everything after it is dropped and flagged; the buffer always stays
+// NUL-terminated.
+class JsonBuffer : public Print {
+ public:
+  JsonBuffer(char *buffer, size_t size) : buffer(buffer), size(size), length(0), overflow(false) {
+    buffer[0] = 0;
+  }
+
+  size_t write(uint8_t c) override { return write(&c, 1); }
+
+  size_t write(const uint8_t *data, size_t count) override {
+    if (overflow || length + count >= size) {
+      overflow = true;
+      return 0;
+    }
+    memcpy(buffer + length, data, count);
+    length += count;
+    buffer[length] = 0;
+    return count;
+  }
+
+  const char *c_str() const { return buffer; }
+  bool isOverflow() const { return overflow; }
+
+ private:
+  char *buffer;
+  size_t size;
+  size_t length;
+  bool overflow;
+};
+
+// Streams JSON straight into a Print (AsyncResponseStream, JsonBuffer, Serial)
+// without building temporary Strings. Commas are placed automatically:
+//
+//   json.beginObject().member("zone", 1).key("days").beginArray().value("mon").endArray().endObject();
+class JsonWriter {
+ public:
+  explicit JsonWriter(Print &out) : out(out), depth(0), commas(0), keyed(false), written(0) {}
+
+  JsonWriter &beginObject() { separate(); put('{'); push(); return *this; }
+  JsonWriter &endObject() { pop(); put('}'); return *this; }
+  JsonWriter &beginArray() { separate(); put('['); push(); return *this; }
+  JsonWriter &endArray() { pop(); put(']'); return *this; }
+
+  JsonWriter &key(const char *name) {
+    separate();
+    string(name);
+    put(':');
+    keyed = true;
+    return *this;
+  }
+
+  JsonWriter &key(unsigned int name) {
+    separate();
+    put('"');
+    written += out.print(name);
+    put('"');
+    put(':');
+    keyed = true;
+    return *this;
+  }
+
+  JsonWriter &value(const char *text) {
+    separate();
+    if (text) {
+      string(text);
+    } else {
+      written += out.write("null", 4);
+    }
+    return *this;
+  }
+
+  JsonWriter &value(const String &text) { return value(text.c_str()); }
+  JsonWriter &value(bool flag) { separate(); written += out.print(flag ? "true" : "false"); return *this; }
+  JsonWriter &value(int number) { separate(); written += out.print(number); return *this; }
+  JsonWriter &value(unsigned int number) { separate(); written += out.print(number); return *this; }
+  JsonWriter &value(long number) { separate(); written += out.print(number); return *this; }
+  JsonWriter &value(unsigned long number) { separate(); written += out.print(number); return *this; }
+  JsonWriter &value(long long number) { separate(); written += out.print(number); return *this; }
+  JsonWriter &value(unsigned long long number) { separate(); written += out.print(number); return *this; }
+  JsonWriter &value(double number, int digits) { separate(); written += out.print(number, digits); return *this; }
+
+  JsonWriter &null() { separate(); written += out.write("null", 4); return *this; }
+
+  // pre-rendered JSON, copied verbatim
+  JsonWriter &raw(const char *json) { separate(); written += out.print(json); return *this; }
+
+  template <typename T>
+  JsonWriter &member(const char *name, T v) { key(name); return value(v); }
+  JsonWriter &member(const char *name, double v, int digits) { key(name); return value(v, digits); }
+
+  size_t length() const { return written; }
+
+ private:
+  void put(char c) { written += out.write((uint8_t)c); }
+
+  void push() {
+    depth++;
+    commas &= ~(1UL << depth);
+  }
+
+  void pop() { depth--; }
+
+  // a comma before every value of an object or array but the first
+  void separate() {
+    if (keyed) {
+      keyed = false;
+      return;
+    }
+    if (depth > 0) {
+      if (commas & (1UL << depth)) {
+        put(',');
+      }
+      commas |= 1UL << depth;
+    }
+  }
+
+  void string(const char *text) {
+    static const char hex[] = "0123456789abcdef";
+
+    put('"');
+    const char *run = text;
+    for (const char *c = text; *c; c++) {
+      uint8_t ch = *c;
+      if (ch >= 0x20 && ch != '"' && ch != '\\') {
+        continue;
+      }
+
+      written += out.write((const uint8_t *)run, c - run);
+      run = c + 1;
+      put('\\');
+      switch (ch) {
+        case '"': put('"'); break;
+        case '\\': put('\\'); break;
+        case '\n': put('n'); break;
+        case '\r': put('r'); break;
+        case '\t': put('t'); break;
+        default:
+          put('u'); put('0'); put('0');
+          put(hex[ch >> 4]); put(hex[ch & 0xF]);
+          break;
+      }
+    }
+    written += out.write((const uint8_t *)run, strlen(run));
+    put('"');
+  }
+
+  Print &out;
+  uint8_t depth;
+  uint32_t commas;  // bit n: the container at depth n already holds a value
+  bool keyed;       // a key was written, its value needs no comma
+  size_t written;
+};
+
+#endif
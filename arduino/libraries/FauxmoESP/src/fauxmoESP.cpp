@@ -28,6 +28,7 @@ THE SOFTWARE.
 
 #include <Arduino.h>
 #include "fauxmoESP.h"
+#include <limits.h>
 
 // -----------------------------------------------------------------------------
 // UDP
@@ -796,6 +797,16 @@ void fauxmoESP::handle() {
     }
 }
 
+unsigned long fauxmoESP::nextNotify() {
+    if (!_enabled || _lastMSearch == 0) return ULONG_MAX;
+
+    unsigned long now = millis();
+    if (now - _lastMSearch >= 180000) return ULONG_MAX;
+
+    unsigned long elapsed = now - _lastNotify;
+    return elapsed > 10000 ? 0 : 10000 - elapsed + 1;
+}
+
 void fauxmoESP::enable(bool enable) {
 
 	if (enable == _enabled) return;
@@ -106,6 +106,7 @@ class fauxmoESP {
         void createServer(bool internal) { _internal = internal; }
         void setPort(unsigned long tcp_port) { _tcp_port = tcp_port; }
         void handle();
+        unsigned long nextNotify();  // ms until the next SSDP NOTIFY, ULONG_MAX if none pending
 
     private:
 
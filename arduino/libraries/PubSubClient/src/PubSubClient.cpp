@@ -7,6 +7,7 @@
 
 #include "PubSubClient.h"
 #include "Arduino.h"
+#include <limits.h>
 
 PubSubClient::PubSubClient() {
     this->_state = MQTT_DISCONNECTED;
@@ -367,6 +368,16 @@ uint32_t PubSubClient::readPacket(uint8_t* lengthLength) {
     return len;
 }
 
+unsigned long PubSubClient::keepAliveDeadline() {
+    if (!connected()) {
+        return ULONG_MAX;
+    }
+    unsigned long t = millis();
+    unsigned long interval = this->keepAlive*1000UL;
+    unsigned long idle = max(t - lastInActivity, t - lastOutActivity);
+    return idle > interval ? 0 : interval - idle + 1;
+}
+
 boolean PubSubClient::loop() {
     if (connected()) {
         unsigned long t = millis();
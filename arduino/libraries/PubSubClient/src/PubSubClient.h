@@ -175,6 +175,7 @@ public:
    boolean subscribe(const char* topic, uint8_t qos);
    boolean unsubscribe(const char* topic);
    boolean loop();
+   unsigned long keepAliveDeadline();  // ms until loop() must send a keepalive ping
    boolean connected();
    int state();
 
@@ -0,0 +1,358 @@
+/*
+  TimeAlarms.cpp - Arduino Time alarms for use with Time library
+
+  Based on the TimeAlarms library by Michael Margolis and Paul Stoffregen.
+  The fixed alarm table is replaced by growable slots plus a binary min-heap
+  ordered by next trigger, so the number of alarms is limited only by memory:
+    - create/free/enable/disable are O(log n)
+    - isDue() and getNextTrigger() are O(1)
+    - serviceAlarms() only touches alarms that are actually due
+*/
+
+#include "TimeAlarms.h"
+
+//**************************************************************
+//* Alarm Class Constructor
+
+AlarmClass::AlarmClass()
+{
+  Mode.isEnabled = Mode.isOneShot = 0;
+  Mode.alarmType = dtNotAllocated;
+  value = nextTrigger = 0;
+  onTickHandler = nullptr;  // prevent a callback until this pointer is explicitly set
+  heapIndex = dtINVALID_ALARM_ID;
+}
+
+//**************************************************************
+//* Private Methods
+
+void AlarmClass::updateNextTrigger()
+{
+  if (Mode.isEnabled) {
+    time_t time = now();
+    if (dtIsAlarm(Mode.alarmType) && nextTrigger <= time) {
+      // update alarm if next trigger is not yet in the future
+      if (Mode.alarmType == dtExplicitAlarm) {
+        // is the value a specific date and time in the future
+        nextTrigger = value;  // yes, trigger on this value
+      } else if (Mode.alarmType == dtDailyAlarm) {
+        //if this is a daily alarm
+        if (value + previousMidnight(time) <= time) {
+          // if time has passed then set for tomorrow
+          nextTrigger = value + nextMidnight(time);
+        } else {
+          // set the date to today and add the time given in value
+          nextTrigger = value + previousMidnight(time);
+        }
+      } else if (Mode.alarmType == dtWeeklyAlarm) {
+        // if this is a weekly alarm
+        if ((value + previousSunday(time)) <= time) {
+          // if day has passed then set for the next week.
+          nextTrigger = value + nextSunday(time);
+        } else {
+          // set the date to this week today and add the time given in value
+          nextTrigger = value + previousSunday(time);
+        }
+      } else {
+        // its not a recognized alarm type - this should not happen
+        Mode.isEnabled = false;  // Disable the alarm
+      }
+    }
+    if (Mode.alarmType == dtTimer) {
+      // its a timer
+      nextTrigger = time + value;  // add the value to previous time (this ensures delay always at least Value seconds)
+    }
+  }
+}
+
+//**************************************************************
+//* Time Alarms Public Methods
+
+TimeAlarmsClass::TimeAlarmsClass()
+{
+  isServicing = false;
+  servicedAlarmId = dtINVALID_ALARM_ID;
+  allocated = 0;
+  Alarm.reserve(dtNBR_ALARMS);
+  heap.reserve(dtNBR_ALARMS);
+}
+
+void TimeAlarmsClass::enable(AlarmID_t ID)
+{
+  if (isAllocated(ID)) {
+    if (( !(dtUseAbsoluteValue(Alarm[ID].Mode.alarmType) && (Alarm[ID].value == 0)) ) && (Alarm[ID].onTickHandler != nullptr)) {
+      // only enable if value is non zero and a tick handler has been set
+      // (is not NULL, value is non zero ONLY for dtTimer & dtExplicitAlarm
+      // (the rest can have 0 to account for midnight))
+      Alarm[ID].Mode.isEnabled = true;
+      Alarm[ID].updateNextTrigger(); // trigger is updated whenever  this is called, even if already enabled
+    } else {
+      Alarm[ID].Mode.isEnabled = false;
+    }
+    schedule(ID);
+  }
+}
+
+void TimeAlarmsClass::disable(AlarmID_t ID)
+{
+  if (isAllocated(ID)) {
+    Alarm[ID].Mode.isEnabled = false;
+    unschedule(ID);
+  }
+}
+
+// write the given value to the given alarm
+void TimeAlarmsClass::write(AlarmID_t ID, time_t value)
+{
+  if (isAllocated(ID)) {
+    Alarm[ID].value = value;  //note: we don't check value as we do it in create
+    Alarm[ID].nextTrigger = 0; // clear out previous trigger time (see issue #12)
+    enable(ID);  // update trigger time
+  }
+}
+
+// return the value for the given alarm ID
+time_t TimeAlarmsClass::read(AlarmID_t ID)
+{
+  if (isAllocated(ID)) {
+    return Alarm[ID].value ;
+  } else {
+    return dtINVALID_TIME;
+  }
+}
+
+// return the alarm type for the given alarm ID
+dtAlarmPeriod_t TimeAlarmsClass::readType(AlarmID_t ID)
+{
+  if (isAllocated(ID)) {
+    return (dtAlarmPeriod_t)Alarm[ID].Mode.alarmType ;
+  } else {
+    return dtNotAllocated;
+  }
+}
+
+void TimeAlarmsClass::free(AlarmID_t ID)
+{
+  if (isAllocated(ID)) {
+    unschedule(ID);
+    Alarm[ID].Mode.isEnabled = false;
+    Alarm[ID].Mode.alarmType = dtNotAllocated;
+    Alarm[ID].onTickHandler = nullptr;
+    Alarm[ID].value = 0;
+    Alarm[ID].nextTrigger = 0;
+    freeIds.push_back(ID);
+    allocated--;
+  }
+}
+
+// returns the number of allocated timers
+size_t TimeAlarmsClass::count()
+{
+  return allocated;
+}
+
+// returns true only if id is allocated and the type is a time based alarm, returns false if not allocated or if its a timer
+bool TimeAlarmsClass::isAlarm(AlarmID_t ID)
+{
+  return( isAllocated(ID) && dtIsAlarm(Alarm[ID].Mode.alarmType) );
+}
+
+// returns true if this id is allocated
+bool TimeAlarmsClass::isAllocated(AlarmID_t ID)
+{
+  return (ID < Alarm.size() && Alarm[ID].Mode.alarmType != dtNotAllocated);
+}
+
+// returns the currently triggered alarm id
+// returns dtINVALID_ALARM_ID if not invoked from within an alarm handler
+AlarmID_t TimeAlarmsClass::getTriggeredAlarmId()
+{
+  if (isServicing) {
+    return servicedAlarmId;  // new private data member used instead of local loop variable i in serviceAlarms();
+  } else {
+    return dtINVALID_ALARM_ID; // valid ids only available when servicing a callback
+  }
+}
+
+void TimeAlarmsClass::waitForDigits( uint8_t Digits, dtUnits_t Units)
+{
+  while (Digits != getDigitsNow(Units)) {
+    serviceAlarms();
+  }
+}
+
+void TimeAlarmsClass::waitForRollover( dtUnits_t Units)
+{
+  // if in the rollover digit then wait for the rollover
+  while (getDigitsNow(Units) == 0) {
+    serviceAlarms();
+  }
+  waitForDigits(0, Units);
+}
+
+uint8_t TimeAlarmsClass::getDigitsNow( dtUnits_t Units)
+{
+  time_t time = now();
+  if (Units == dtSecond) return numberOfSeconds(time);
+  if (Units == dtMinute) return numberOfMinutes(time);
+  if (Units == dtHour) return numberOfHours(time);
+  if (Units == dtDay) return dayOfWeek(time);
+  return 255;  // This should never happen
+}
+
+//returns isServicing
+bool TimeAlarmsClass::getIsServicing()
+{
+  return isServicing;
+}
+
+// returns true if the earliest enabled alarm is due
+bool TimeAlarmsClass::isDue()
+{
+  return !heap.empty() && now() >= Alarm[heap[0]].nextTrigger;
+}
+
+void TimeAlarmsClass::serviceAlarms()
+{
+  if (!isServicing) {
+    isServicing = true;
+    time_t time = now();
+    // a fired alarm either leaves the heap or moves into the future, so each
+    // alarm is visited at most once per pass; the bound guards handlers that
+    // keep creating alarms which are already due
+    size_t budget = heap.size();
+    while (budget-- && !heap.empty() && time >= Alarm[heap[0]].nextTrigger) {
+      servicedAlarmId = heap[0];
+      OnTick_t TickHandler = Alarm[servicedAlarmId].onTickHandler;
+      if (Alarm[servicedAlarmId].Mode.isOneShot) {
+        free(servicedAlarmId);  // free the ID if mode is OnShot
+      } else {
+        Alarm[servicedAlarmId].updateNextTrigger();
+        schedule(servicedAlarmId);
+      }
+      if (TickHandler != nullptr) {
+        TickHandler();     // call the handler
+      }
+    }
+    servicedAlarmId = dtINVALID_ALARM_ID;
+    isServicing = false;
+  }
+}
+
+// returns the absolute time of the next scheduled alarm, or 0 if none
+time_t TimeAlarmsClass::getNextTrigger()
+{
+  return heap.empty() ? 0 : Alarm[heap[0]].nextTrigger;
+}
+
+//**************************************************************
+//* Time Alarms Private Methods
+
+// attempt to create an alarm and return true if successful
+AlarmID_t TimeAlarmsClass::create(time_t value, OnTick_t onTickHandler, uint8_t isOneShot, dtAlarmPeriod_t alarmType)
+{
+  if ( ! ( (dtIsAlarm(alarmType) && now() < SECS_PER_YEAR) || (dtUseAbsoluteValue(alarmType) && (value == 0)) ) ) {
+    // only allocate if the time is set and the value is not 0
+    AlarmID_t id;
+    if (!freeIds.empty()) {
+      id = freeIds.back();
+      freeIds.pop_back();
+    } else if (Alarm.size() < dtINVALID_ALARM_ID) {
+      id = Alarm.size();
+      Alarm.emplace_back();
+    } else {
+      return dtINVALID_ALARM_ID; // id space exhausted
+    }
+    Alarm[id].onTickHandler = onTickHandler;
+    Alarm[id].Mode.isOneShot = isOneShot;
+    Alarm[id].Mode.alarmType = alarmType;
+    Alarm[id].value = value;
+    allocated++;
+    enable(id);
+    return id;  // alarm created ok
+  }
+  return dtINVALID_ALARM_ID; // time is invalid
+}
+
+void TimeAlarmsClass::schedule(AlarmID_t ID)
+{
+  if (!Alarm[ID].Mode.isEnabled) {
+    unschedule(ID);
+    return;
+  }
+
+  size_t index = Alarm[ID].heapIndex;
+  if (index == dtINVALID_ALARM_ID) {
+    index = heap.size();
+    heap.push_back(ID);
+    Alarm[ID].heapIndex = index;
+    siftUp(index);
+  } else {
+    // trigger may have moved either way
+    siftUp(index);
+    siftDown(Alarm[ID].heapIndex);
+  }
+}
+
+void TimeAlarmsClass::unschedule(AlarmID_t ID)
+{
+  size_t index = Alarm[ID].heapIndex;
+  if (index == dtINVALID_ALARM_ID) {
+    return;
+  }
+
+  Alarm[ID].heapIndex = dtINVALID_ALARM_ID;
+  AlarmID_t last = heap.back();
+  heap.pop_back();
+  if (index < heap.size()) {
+    place(index, last);
+    siftUp(index);
+    siftDown(Alarm[last].heapIndex);
+  }
+}
+
+void TimeAlarmsClass::siftUp(size_t index)
+{
+  AlarmID_t id = heap[index];
+  time_t trigger = Alarm[id].nextTrigger;
+  while (index > 0) {
+    size_t parent = (index - 1) / 2;
+    if (Alarm[heap[parent]].nextTrigger <= trigger) {
+      break;
+    }
+    place(index, heap[parent]);
+    index = parent;
+  }
+  place(index, id);
+}
+
+void TimeAlarmsClass::siftDown(size_t index)
+{
+  AlarmID_t id = heap[index];
+  time_t trigger = Alarm[id].nextTrigger;
+  size_t size = heap.size();
+  while (true) {
+    size_t child = 2 * index + 1;
+    if (child >= size) {
+      break;
+    }
+    if (child + 1 < size && Alarm[heap[child + 1]].nextTrigger < Alarm[heap[child]].nextTrigger) {
+      child++;
+    }
+    if (trigger <= Alarm[heap[child]].nextTrigger) {
+      break;
+    }
+    place(index, heap[child]);
+    index = child;
+  }
+  place(index, id);
+}
+
+void TimeAlarmsClass::place(size_t index, AlarmID_t ID)
+{
+  heap[index] = ID;
+  Alarm[ID].heapIndex = index;
+}
+
+// make one instance for the user to use
+TimeAlarmsClass Alarm = TimeAlarmsClass() ;
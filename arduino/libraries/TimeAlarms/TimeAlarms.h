@@ -4,14 +4,13 @@
 #define TimeAlarms_h
 
 #include <functional>
+#include <vector>
 #include <Arduino.h>
 #include "TimeLib.h"
 
-#if defined(__AVR__)
-#define dtNBR_ALARMS 6   // max is 255
-#else
-#define dtNBR_ALARMS 15  // assume non-AVR has more memory
-#endif
+// alarms are kept in a binary min-heap ordered by next trigger time, so there
+// is no fixed alarm cap; dtNBR_ALARMS is only the initial capacity reserved
+#define dtNBR_ALARMS 16
 
 #define USE_SPECIALIST_METHODS  // define this for testing
 
@@ -46,10 +45,10 @@ typedef enum {
 #define dtIsAlarm(_type_)  (_type_ >= dtExplicitAlarm && _type_ < dtLastAlarmType)
 #define dtUseAbsoluteValue(_type_)  (_type_ == dtTimer || _type_ == dtExplicitAlarm)
 
-typedef uint8_t AlarmID_t;
+typedef uint16_t AlarmID_t;
 typedef AlarmID_t AlarmId;  // Arduino friendly name
 
-#define dtINVALID_ALARM_ID 255
+#define dtINVALID_ALARM_ID 0xFFFF
 #define dtINVALID_TIME     (time_t)(-1)
 #define AlarmHMS(_hr_, _min_, _sec_) (_hr_ * SECS_PER_HOUR + _min_ * SECS_PER_MIN + _sec_)
 
@@ -66,17 +65,27 @@ public:
   time_t value;
   time_t nextTrigger;
   AlarmMode_t Mode;
+  AlarmID_t heapIndex;    // position in the trigger heap, dtINVALID_ALARM_ID when not queued
 };
 
 // class containing the collection of alarms
 class TimeAlarmsClass
 {
 private:
-  AlarmClass Alarm[dtNBR_ALARMS];
+  std::vector<AlarmClass> Alarm;   // alarm slots, indexed by AlarmID_t
+  std::vector<AlarmID_t> freeIds;  // released slots available for reuse
+  std::vector<AlarmID_t> heap;     // enabled alarms, min-heap on nextTrigger
+  size_t allocated;
   uint8_t isServicing;
-  uint8_t servicedAlarmId; // the alarm currently being serviced
+  AlarmID_t servicedAlarmId; // the alarm currently being serviced
   AlarmID_t create(time_t value, OnTick_t onTickHandler, uint8_t isOneShot, dtAlarmPeriod_t alarmType);
 
+  void schedule(AlarmID_t ID);     // insert or reposition the alarm in the heap
+  void unschedule(AlarmID_t ID);   // remove the alarm from the heap
+  void siftUp(size_t index);
+  void siftDown(size_t index);
+  void place(size_t index, AlarmID_t ID);
+
 public:
   TimeAlarmsClass();
   // functions to create alarms and timers
@@ -138,6 +147,7 @@ public:
   }
 
   void serviceAlarms();
+  bool isDue();                             // true if the earliest enabled alarm is due, O(1)
 
   // utility methods
   uint8_t getDigitsNow( dtUnits_t Units);         // returns the current digit value for the given time unit
@@ -158,8 +168,8 @@ public:
 #ifndef USE_SPECIALIST_METHODS
 private:  // the following methods are for testing and are not documented as part of the standard library
 #endif
-  uint8_t count();                          // returns the number of allocated timers
-  time_t getNextTrigger();                  // returns the time of the next scheduled alarm
+  size_t count();                           // returns the number of allocated timers
+  time_t getNextTrigger();                  // returns the time of the next scheduled alarm, or 0 if none
   bool isAllocated(AlarmID_t ID);           // returns true if this id is allocated
   bool isAlarm(AlarmID_t ID);               // returns true if id is for a time based alarm, false if its a timer or not allocated
 };
@@ -0,0 +1,158 @@
+#include "LogPack.h"
+
+#define LOG_HEADER_SIZE (sizeof(uint32_t) + sizeof(const char *))
+
+void LogPacker::add(const char *text) {
+  if (!text) {
+    text = "(null)";
+  }
+  size_t count = strlen(text);
+  if (full || length + 2 > size) {
+    full = true;
+    return;
+  }
+  if (count > size - length - 2) {
+    count = size - length - 2;
+  }
+  uint8_t n = count > 255 ? 255 : count;
+  buffer[length++] = 's';
+  buffer[length++] = n;
+  put(text, n);
+}
+
+void LogPacker::tagged(char tag, const void *value, size_t count) {
+  if (full || length + 1 + count > size) {
+    full = true;
+    return;
+  }
+  buffer[length++] = tag;
+  put(value, count);
+}
+
+void LogPacker::put(const void *data, size_t count) {
+  memcpy(buffer + length, data, count);
+  length += count;
+}
+
+uint32_t logMillis(const uint8_t *payload) {
+  uint32_t ms;
+  memcpy(&ms, payload, sizeof(ms));
+  return ms;
+}
+
+// Copies the format, expanding each conversion with the next argument. A
+// conversion that does not match the stored type prints the value with the
+// conversion of that type, so a wrong format never reads garbage.
+size_t logFormat(char *text, size_t size, const uint8_t *payload, size_t length) {
+  if (size == 0) {
+    return 0;
+  }
+  text[0] = 0;
+  if (length < LOG_HEADER_SIZE) {
+    return 0;
+  }
+
+  const char *format;
+  memcpy(&format, payload + sizeof(uint32_t), sizeof(format));
+  size_t at = LOG_HEADER_SIZE;
+  size_t out = 0;
+
+  for (const char *p = format; *p && out + 1 < size; p++) {
+    if (*p != '%') {
+      text[out++] = *p;
+      continue;
+    }
+    if (p[1] == '%') {
+      text[out++] = '%';
+      p++;
+      continue;
+    }
+
+    // %[flags][width][.precision][length]conversion
+    char spec[16] = "%";
+    size_t n = 1;
+    const char *q = p + 1;
+    while (*q && strchr("-+ #0123456789.", *q) && n < sizeof(spec) - 4) {
+      spec[n++] = *q++;
+    }
+    while (*q && strchr("hlLqjzt", *q)) {
+      q++;  // the stored type decides the length
+    }
+    char conversion = *q;
+    if (!conversion) {
+      break;
+    }
+    p = q;
+
+    if (at >= length) {
+      continue;  // fewer arguments than conversions
+    }
+
+    char tag = payload[at++];
+    size_t room = size - out;
+    int written = 0;
+    switch (tag) {
+      case 'i':
+      case 'u': {
+        int32_t v;
+        memcpy(&v, payload + at, sizeof(v));
+        at += sizeof(v);
+        spec[n++] = strchr("diuxXoc", conversion) ? conversion : (tag == 'i' ? 'd' : 'u');
+        spec[n] = 0;
+        written = snprintf(text + out, room, spec, v);
+        break;
+      }
+      case 'q':
+      case 'Q': {
+        long long v;
+        memcpy(&v, payload + at, sizeof(v));
+        at += sizeof(v);
+        spec[n++] = 'l';
+        spec[n++] = 'l';
+        spec[n++] = strchr("diuxXo", conversion) ? conversion : (tag == 'q' ? 'd' : 'u');
+        spec[n] = 0;
+        written = snprintf(text + out, room, spec, v);
+        break;
+      }
+      case 'd': {
+        double v;
+        memcpy(&v, payload + at, sizeof(v));
+        at += sizeof(v);
+        spec[n++] = strchr("fFeEgG", conversion) ? conversion : 'g';
+        spec[n] = 0;
+        written = snprintf(text + out, room, spec, v);
+        break;
+      }
+      case 's': {
+        size_t stored = at < length ? payload[at++] : 0;
+        if (at + stored > length) {
+          stored = length - at;
+        }
+        size_t count = stored;  // what gets printed, the precision may cut it short
+        char *dot = strchr(spec, '.');
+        if (dot) {
+          size_t precision = atoi(dot + 1);
+          count = precision < count ? precision : count;
+          n = dot - spec;
+        }
+        spec[n++] = '.';
+        spec[n++] = '*';
+        spec[n++] = 's';
+        spec[n] = 0;
+        written = snprintf(text + out, room, spec, (int)count, (const char *)payload + at);
+        at += stored;
+        break;
+      }
+      default:
+        at = length;
+        break;
+    }
+
+    if (written > 0) {
+      out += (size_t)written < room ? written : room - 1;
+    }
+  }
+
+  text[out] = 0;
+  return out;
+}
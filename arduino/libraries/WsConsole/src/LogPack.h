@@ -0,0 +1,63 @@
+#ifndef LogPack_h
+#define LogPack_h
+
+#include <Arduino.h>
+
+#include "LogRing.h"
+
+#define LOG_PACKED 0x80  // level flag of a record holding a format and its arguments
+
+// Packs a log call into a record payload without formatting it:
+//
+//   [uint32 ms][const char *format][tag value]...
+//
+// The format is a literal, so its address identifies it for the life of the
+// firmware and only the pointer is stored. Numbers are stored as they are;
+// strings are copied (up to what fits) since they may not outlive the call.
+// logFormat() expands a payload when a reader asks for the text.
+class LogPacker {
+ public:
+  LogPacker(uint8_t *buffer, size_t size, const char *format, uint32_t ms)
+      : buffer(buffer), size(size), length(0), full(false) {
+    put(&ms, sizeof(ms));
+    put(&format, sizeof(format));
+  }
+
+  void add(int v) { add32('i', v); }
+  void add(unsigned int v) { add32('u', v); }
+  void add(long v) { sizeof(v) > 4 ? add((long long)v) : add32('i', v); }
+  void add(unsigned long v) { sizeof(v) > 4 ? add((unsigned long long)v) : add32('u', v); }
+  void add(long long v) { tagged('q', &v, sizeof(v)); }
+  void add(unsigned long long v) { tagged('Q', &v, sizeof(v)); }
+  void add(double v) { tagged('d', &v, sizeof(v)); }
+  void add(const char *text);
+  void add(const String &text) { add(text.c_str()); }
+
+  size_t bytes() const { return length; }
+
+ private:
+  void add32(char tag, int32_t v) { tagged(tag, &v, sizeof(v)); }
+  void tagged(char tag, const void *value, size_t count);
+  void put(const void *data, size_t count);
+
+  uint8_t *buffer;
+  size_t size;
+  size_t length;
+  bool full;  // the arguments after the first one that did not fit are dropped
+};
+
+// text of a packed payload; returns its length
+size_t logFormat(char *text, size_t size, const uint8_t *payload, size_t length);
+
+// ms of a packed payload
+uint32_t logMillis(const uint8_t *payload);
+
+template <typename... Args>
+size_t logPack(uint8_t *buffer, size_t size, uint32_t ms, const char *format, const Args &...args) {
+  LogPacker packer(buffer, size, format, ms);
+  int expand[] = {0, (packer.add(args), 0)...};
+  (void)expand;
+  return packer.bytes();
+}
+
+#endif
@@ -0,0 +1,105 @@
+#include "LogRing.h"
+
+uint8_t LogRing::intern(const char *scope) {
+  for (uint8_t i = 0; i < scopeCount; i++) {
+    if (strncmp(scopes[i], scope, LOG_SCOPE_SIZE - 1) == 0) {
+      return i;
+    }
+  }
+
+  if (scopeCount == LOG_MAX_SCOPES) {
+    return LOG_MAX_SCOPES - 1;
+  }
+
+  strncpy(scopes[scopeCount], scope, LOG_SCOPE_SIZE - 1);
+  return scopeCount++;
+}
+
+uint32_t LogRing::append(uint8_t level, uint8_t scope, const char *text, size_t length) {
+  if (length > LOG_MAX_LINE) {
+    length = LOG_MAX_LINE;
+  }
+  size_t size = recordSize(length);
+
+  // records never wrap, the rest of the arena becomes padding
+  if (head + size > LOG_RING_SIZE) {
+    size_t padding = LOG_RING_SIZE - head;
+    while (LOG_RING_SIZE - used < padding) {
+      evict();
+    }
+    if (padding >= sizeof(Record)) {
+      ((Record *)(data + head))->length = PADDING;
+    }
+    used += padding;
+    head = 0;
+  }
+
+  while (LOG_RING_SIZE - used < size) {
+    evict();
+  }
+
+  Record *record = (Record *)(data + head);
+  record->length = length;
+  record->level = level;
+  record->scope = scope;
+  record->seq = ++seq;
+  char *payload = (char *)record + sizeof(Record);
+  memcpy(payload, text, length);
+  payload[length] = 0;
+
+  head = (head + size) % LOG_RING_SIZE;
+  used += size;
+  records++;
+  return seq;
+}
+
+bool LogRing::find(uint32_t since, LogEntry &found) const {
+  if (records == 0 || since > seq) {
+    return false;
+  }
+
+  // sequence numbers are consecutive, so skip whole records by their headers;
+  // readers go forward, so start from the last record found while it is stored
+  uint32_t from = firstSeq();
+  size_t offset = tail;
+  if (hintSeq >= from && hintSeq <= since) {
+    from = hintSeq;
+    offset = hintOffset;
+  }
+  uint32_t skip = since > from ? since - from : 0;
+  while (true) {
+    if (isPadding(offset)) {
+      offset = 0;
+      continue;
+    }
+    if (skip == 0) {
+      found = entry(offset);
+      hintSeq = found.seq;
+      hintOffset = offset;
+      return true;
+    }
+    offset = (offset + recordSize(at(offset).length)) % LOG_RING_SIZE;
+    skip--;
+  }
+}
+
+void LogRing::evict() {
+  if (isPadding(tail)) {
+    used -= LOG_RING_SIZE - tail;
+    tail = 0;
+    return;
+  }
+
+  size_t size = recordSize(at(tail).length);
+  used -= size;
+  tail = (tail + size) % LOG_RING_SIZE;
+  records--;
+  dropped++;
+}
+
+void LogRing::clear() {
+  head = 0;
+  tail = 0;
+  used = 0;
+  records = 0;
+}
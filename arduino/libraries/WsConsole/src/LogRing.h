@@ -0,0 +1,113 @@
+#ifndef LogRing_h
+#define LogRing_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifndef LOG_RING_SIZE
+#define LOG_RING_SIZE 16384  // bytes, headers included
+#endif
+
+#define LOG_MAX_LINE 240     // longer lines are cut
+#define LOG_MAX_SCOPES 32
+#define LOG_SCOPE_SIZE 8     // scopes are short tags like "save" or "plan"
+#define LOG_NO_SCOPE 0xFF
+
+// A log line as stored in the ring. text is NUL-terminated and valid until
+// the next append().
+struct LogEntry {
+  uint32_t seq;
+  uint8_t level;
+  const char *scope;
+  const char *text;
+  uint16_t length;
+};
+
+// Fixed-size byte arena holding variable-length log records, oldest first.
+// Appending evicts the oldest records until the new one fits, so both are
+// O(1) per line and the heap is never touched. Scope names are interned
+// into a small table and stored as one byte per record.
+//
+// Every member has a constant initializer, so a global ring is ready before
+// any constructor runs, e.g. for the WsConsole globals of other units.
+class LogRing {
+ public:
+  // id of scope, added on first use; the last slot is shared once the table is full
+  uint8_t intern(const char *scope);
+  const char *scope(uint8_t id) const { return id < scopeCount ? scopes[id] : ""; }
+
+  // returns the sequence number of the new record
+  uint32_t append(uint8_t level, uint8_t scope, const char *text, size_t length);
+  void clear();
+
+  // the oldest record with a sequence number of at least since
+  bool find(uint32_t since, LogEntry &entry) const;
+
+  // oldest first
+  template <typename F>
+  void forEach(F callback) const {
+    size_t offset = tail;
+    size_t left = used;
+    while (left > 0) {
+      if (isPadding(offset)) {
+        left -= LOG_RING_SIZE - offset;
+        offset = 0;
+        continue;
+      }
+      callback(entry(offset));
+      size_t size = recordSize(at(offset).length);
+      left -= size;
+      offset = (offset + size) % LOG_RING_SIZE;
+    }
+  }
+
+  size_t count() const { return records; }
+  size_t bytes() const { return used; }
+  size_t capacity() const { return LOG_RING_SIZE; }
+  uint32_t evicted() const { return dropped; }
+  uint32_t lastSeq() const { return seq; }
+  uint32_t firstSeq() const { return seq - records + 1; }
+
+ private:
+  struct Record {
+    uint16_t length;  // text bytes without the NUL; PADDING up to the end of the arena
+    uint8_t level;
+    uint8_t scope;
+    uint32_t seq;
+  };
+
+  static const uint16_t PADDING = 0xFFFF;
+
+  static size_t recordSize(size_t length) { return (sizeof(Record) + length + 1 + 3) & ~(size_t)3; }
+
+  const Record &at(size_t offset) const { return *(const Record *)(data + offset); }
+  LogEntry entry(size_t offset) const {
+    const Record &record = at(offset);
+    return LogEntry{record.seq, record.level, scope(record.scope), (const char *)data + offset + sizeof(Record), record.length};
+  }
+  bool isPadding(size_t offset) const {
+    return offset + sizeof(Record) > LOG_RING_SIZE || at(offset).length == PADDING;
+  }
+
+  void evict();
+
+  alignas(4) uint8_t data[LOG_RING_SIZE] = {};
+  size_t head = 0;  // next write offset
+  size_t tail = 0;  // oldest record
+  size_t used = 0;  // bytes from tail to head, padding included
+  size_t records = 0;
+  uint32_t seq = 0;
+  uint32_t dropped = 0;
+
+  mutable uint32_t hintSeq = 0;  // the last record find() returned, 0 for none
+  mutable size_t hintOffset = 0;
+
+  char scopes[LOG_MAX_SCOPES][LOG_SCOPE_SIZE] = {};
+  uint8_t scopeCount = 0;
+};
+
+static_assert(LOG_RING_SIZE % 4 == 0, "LOG_RING_SIZE must be a multiple of 4");
+static_assert(LOG_RING_SIZE >= 4 * (LOG_MAX_LINE + 16), "LOG_RING_SIZE holds too few lines");
+
+#endif
@@ -0,0 +1,241 @@
+#include "WsBroadcaster.h"
+
+void WsBroadcaster::begin(AsyncWebSocket *socket) {
+  ws = socket;
+}
+
+void WsBroadcaster::connect(uint32_t id) {
+  portENTER_CRITICAL(&lock);
+  if (!client(id) && clientCount < WS_MAX_CLIENTS) {
+    clients[clientCount++] = Client{id, 0, 0, 0, 0, 0, 0};
+  }
+  portEXIT_CRITICAL(&lock);
+}
+
+void WsBroadcaster::disconnect(uint32_t id) {
+  portENTER_CRITICAL(&lock);
+  Client *found = client(id);
+  if (found) {
+    *found = clients[--clientCount];
+  }
+  if (clientCount == 0) {
+    eventsLength = 0;
+    eventCount = 0;
+    dirty = 0;
+    pending = false;
+  }
+  portEXIT_CRITICAL(&lock);
+}
+
+bool WsBroadcaster::update(const char *key, unsigned int id, const char *json) {
+  size_t length = strlen(json);
+  if (length >= WS_SLOT_SIZE) {
+    return false;
+  }
+
+  portENTER_CRITICAL(&lock);
+  if (clientCount == 0) {
+    portEXIT_CRITICAL(&lock);
+    return false;
+  }
+
+  uint8_t index = 0;
+  while (index < slotCount && !(slots[index].id == id && strcmp(slots[index].key, key) == 0)) {
+    index++;
+  }
+  if (index == slotCount) {
+    if (slotCount == WS_MAX_SLOTS) {
+      overflows++;
+      portEXIT_CRITICAL(&lock);
+      return false;
+    }
+    slots[slotCount].key = key;
+    slots[slotCount].id = id;
+    slotCount++;
+  }
+
+  // whoever has not got the previous value yet only gets this one
+  uint32_t bit = 1UL << index;
+  for (uint8_t i = 0; i < clientCount; i++) {
+    if ((dirty | clients[i].missed) & bit) {
+      clients[i].merged++;
+    }
+  }
+
+  memcpy(slots[index].json, json, length + 1);
+  dirty |= bit;
+  bool first = startPending();
+  portEXIT_CRITICAL(&lock);
+
+  if (first && pendingCallback) {
+    pendingCallback();
+  }
+  return true;
+}
+
+unsigned long WsBroadcaster::deadline() {
+  portENTER_CRITICAL(&lock);
+  bool due = pending;
+  unsigned long since = pendingSince;
+  portEXIT_CRITICAL(&lock);
+
+  if (!due) {
+    return ULONG_MAX;
+  }
+  unsigned long elapsed = millis() - since;
+  return elapsed < WS_BATCH_INTERVAL ? WS_BATCH_INTERVAL - elapsed : 0;
+}
+
+void WsBroadcaster::flush() {
+  if (!ws || deadline() > 0) {
+    return;
+  }
+
+  // take the frame and the client list over, new messages start the next
+  // frame; connect() and disconnect() run on the socket task meanwhile
+  Client sending[WS_MAX_CLIENTS];
+  portENTER_CRITICAL(&lock);
+  size_t length = 0;
+  frame[length++] = '[';
+  memcpy(frame + length, events, eventsLength);
+  length += eventsLength;
+  uint32_t count = eventCount;
+  uint32_t sent = dirty;
+  length = appendSlots(length, sent);
+  eventsLength = 0;
+  eventCount = 0;
+  dirty = 0;
+  pending = false;
+  uint8_t sendingCount = clientCount;
+  memcpy(sending, clients, sendingCount * sizeof(Client));
+  portEXIT_CRITICAL(&lock);
+
+  frames++;
+  bool retry = false;
+  for (uint8_t i = 0; i < sendingCount; i++) {
+    Client &c = sending[i];
+
+    // the latest values of the slots it missed ride along
+    uint32_t extra = c.missed & ~sent;
+    size_t clientLength = length;
+    if (extra) {
+      portENTER_CRITICAL(&lock);
+      clientLength = appendSlots(length, extra);
+      portEXIT_CRITICAL(&lock);
+    }
+
+    if (clientLength == 1) {
+      continue;  // nothing for this one
+    }
+    frame[clientLength] = ']';
+
+    bool delivered = send(c, clientLength);
+
+    // write back unless it disconnected in the meantime
+    portENTER_CRITICAL(&lock);
+    Client *current = client(c.id);
+    if (current) {
+      if (delivered) {
+        current->missed = 0;
+      } else {
+        current->missed |= sent;
+        current->dropped += count;
+      }
+      current->backlog = c.backlog;
+      current->frames = c.frames;
+      current->bytes = c.bytes;
+      retry |= current->missed != 0;
+    }
+    portEXIT_CRITICAL(&lock);
+  }
+
+  if (retry) {
+    portENTER_CRITICAL(&lock);
+    startPending();  // retry them with the next frame
+    portEXIT_CRITICAL(&lock);
+  }
+
+  ws->cleanupClients(WS_MAX_CLIENTS);
+}
+
+void WsBroadcaster::toJSON(JsonWriter &json) {
+  json.beginObject()
+      .member("frames", frames)
+      .member("overflows", overflows)
+      .key("clients")
+      .beginArray();
+  Client copy[WS_MAX_CLIENTS];
+  portENTER_CRITICAL(&lock);
+  uint8_t count = clientCount;
+  memcpy(copy, clients, count * sizeof(Client));
+  portEXIT_CRITICAL(&lock);
+  for (uint8_t i = 0; i < count; i++) {
+    const Client &c = copy[i];
+    json.beginObject()
+        .member("id", c.id)
+        .member("frames", c.frames)
+        .member("bytes", c.bytes)
+        .member("backlog", c.backlog)
+        .member("dropped", c.dropped)
+        .member("merged", c.merged)
+        .endObject();
+  }
+  json.endArray().endObject();
+}
+
+bool WsBroadcaster::startPending() {
+  if (pending) {
+    return false;
+  }
+  pending = true;
+  pendingSince = millis();
+  return true;
+}
+
+WsBroadcaster::Client *WsBroadcaster::client(uint32_t id) {
+  for (uint8_t i = 0; i < clientCount; i++) {
+    if (clients[i].id == id) {
+      return &clients[i];
+    }
+  }
+  return nullptr;
+}
+
+// append { "<key>": json } of the slots in mask
+size_t WsBroadcaster::appendSlots(size_t length, uint32_t mask) {
+  for (uint8_t i = 0; i < slotCount; i++) {
+    if (mask & (1UL << i)) {
+      length += snprintf(frame + length, sizeof(frame) - length, "%s{\"%s\":%s}",
+                         length > 1 ? "," : "", slots[i].key, slots[i].json);
+    }
+  }
+  return length;
+}
+
+// The library queues whatever it is handed, so the backlog of a client is
+// estimated from its socket: as long as the TCP send buffer has room the
+// queue in front of it is empty.
+bool WsBroadcaster::send(Client &c, size_t length) {
+  AsyncWebSocketClient *socket = ws->client(c.id);
+  if (!socket || socket->status() != WS_CONNECTED) {
+    return false;
+  }
+
+  size_t space = socket->client()->space();
+  if (space > 0) {
+    c.backlog = 0;
+  }
+
+  size_t size = length + 1;  // the closing bracket
+  if (socket->queueIsFull() || c.backlog + size > WS_CLIENT_QUEUE + space) {
+    return false;
+  }
+
+  socket->text(frame, size);
+  c.backlog += size > space ? size - space : 0;
+  c.frames++;
+  c.bytes += size;
+  return true;
+}
+
+WsBroadcaster Broadcaster;
@@ -0,0 +1,133 @@
+#ifndef WsBroadcaster_h
+#define WsBroadcaster_h
+
+#include <Arduino.h>
+#include <AsyncWebSocket.h>
+#include <limits.h>
+
+#include <functional>
+
+#include "../../../includes/JsonWriter.h"
+
+#define WS_BATCH_INTERVAL 100  // ms a frame collects messages before it is sent
+#define WS_EVENTS_SIZE 2048    // bytes of queued one-off messages per frame
+#define WS_CLIENT_QUEUE 4096   // bytes a client may have waiting before it is skipped
+
+#ifndef WS_MAX_SLOTS
+#define WS_MAX_SLOTS 16        // latest-wins messages, e.g. the state of each zone
+#endif
+#define WS_SLOT_SIZE 160
+
+#ifndef WS_MAX_CLIENTS
+#define WS_MAX_CLIENTS 8
+#endif
+
+// Batches WebSocket traffic into one JSON array frame per WS_BATCH_INTERVAL.
+// One-off messages (log lines) are appended in order; keyed messages (zone
+// state) keep only their latest value. A client whose socket is backed up is
+// skipped: it loses the one-off messages of that frame and gets the latest
+// keyed ones once it drains.
+//
+// post() and update() may be called from any task; flush() runs on the loop.
+class WsBroadcaster {
+ public:
+  void begin(AsyncWebSocket *ws);
+
+  void connect(uint32_t id);
+  void disconnect(uint32_t id);
+
+  // called when the first message of a frame is queued, e.g. to wake the loop
+  void onPending(std::function<void()> callback) { pendingCallback = callback; }
+
+  // queue the message body renders; false when nobody listens or the frame is full
+  template <typename F>
+  bool post(F body) {
+    portENTER_CRITICAL(&lock);
+    bool posted = false;
+    if (clientCount > 0 && eventsLength + 2 < sizeof(events)) {
+      size_t start = eventsLength + (eventsLength ? 1 : 0);
+      JsonBuffer out(events + start, sizeof(events) - start);
+      JsonWriter json(out);
+      body(json);
+      if (!out.isOverflow()) {
+        if (eventsLength) {
+          events[eventsLength] = ',';
+        }
+        eventsLength = start + json.length();
+        eventCount++;
+        posted = true;
+      }
+    }
+    if (!posted && clientCount > 0) {
+      overflows++;
+    }
+    bool first = posted && startPending();
+    portEXIT_CRITICAL(&lock);
+
+    if (first && pendingCallback) {
+      pendingCallback();
+    }
+    return posted;
+  }
+
+  // replace the pending value of key/id, sent as { "<key>": json }
+  bool update(const char *key, unsigned int id, const char *json);
+
+  // send the frame when it is due; returns ms until the next one
+  void flush();
+  unsigned long deadline();
+
+  void toJSON(JsonWriter &json);
+
+ private:
+  struct Slot {
+    const char *key;  // a literal, e.g. "state"
+    unsigned int id;
+    char json[WS_SLOT_SIZE];
+  };
+
+  struct Client {
+    uint32_t id;
+    uint32_t missed;   // slots updated while the client was skipped
+    size_t backlog;    // bytes estimated to be waiting in its queue
+    uint32_t frames;
+    uint32_t bytes;
+    uint32_t dropped;  // one-off messages it never got
+    uint32_t merged;   // keyed messages replaced before it got them
+  };
+
+  bool startPending();
+  Client *client(uint32_t id);
+  size_t appendSlots(size_t length, uint32_t mask);
+  bool send(Client &client, size_t length);
+
+  AsyncWebSocket *ws = nullptr;
+  portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+  std::function<void()> pendingCallback;
+
+  char events[WS_EVENTS_SIZE];
+  size_t eventsLength = 0;
+  uint32_t eventCount = 0;
+
+  Slot slots[WS_MAX_SLOTS];
+  uint8_t slotCount = 0;
+  uint32_t dirty = 0;  // slots updated since the last frame
+
+  Client clients[WS_MAX_CLIENTS];
+  uint8_t clientCount = 0;
+
+  bool pending = false;
+  unsigned long pendingSince = 0;
+
+  // "[" events, slots "]"
+  char frame[1 + WS_EVENTS_SIZE + WS_MAX_SLOTS * (WS_SLOT_SIZE + 24) + 2];
+
+  uint32_t frames = 0;
+  uint32_t overflows = 0;  // one-off messages that did not fit a frame
+};
+
+static_assert(WS_MAX_SLOTS <= 32, "slots are a 32-bit mask");
+
+extern WsBroadcaster Broadcaster;
+
+#endif
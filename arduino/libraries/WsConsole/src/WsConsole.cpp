@@ -1,10 +1,32 @@
 #include "WsConsole.h"
 
-std::unique_ptr<AsyncWebSocket> wss;
+bool attached = false;  // log lines go out over the WebSocket
+uint32_t streamed = 0;  // the last line handed to Serial and the WebSocket
+std::function<void()> pendingCallback;
 logLevel_t loglevel = logInfo;
 std::map<String, WsConsole *> consoles;
-std::vector<log_t> logs;
-size_t logIndex = 0;
+LogRing logs;
+portMUX_TYPE logsLock = portMUX_INITIALIZER_UNLOCKED;  // lines come from the loop, the persist task and the web server
+
+static const char *levelName(uint8_t level) {
+  switch (level) {
+    case logError:
+      return "error";
+    case logWarn:
+      return "warn";
+    default:
+      return "info";
+  }
+}
+
+// { "seq": 12, "scope": "plan", "info": "armed", "ms": 5210 }
+static void entryToJSON(JsonWriter &json, const LogLine &line) {
+  json.beginObject().member("seq", line.seq).member("scope", line.scope).member(levelName(line.level), line.text);
+  if (line.packed) {
+    json.member("ms", line.ms);
+  }
+  json.endObject();
+}
 
 WsConsole::WsConsole(const char *scope)
     : logScope(scope) {
@@ -29,8 +51,8 @@ void WsConsole::attach(AsyncWebSocket *wsp) {
   if (loglevel == logNone || wsp == nullptr)
     return;
 
-  if (!wss)
-    wss.reset(wsp);
+  Broadcaster.begin(wsp);
+  attached = true;
 }
 
 WsConsole &WsConsole::error(const char *scope, const char *line) {
@@ -45,10 +67,7 @@ WsConsole &WsConsole::error(const String text) {
 
   Serial.printf("[error] %s\r\n", text.c_str());
 
-  broadcast((log_t){
-      logError,
-      logScope,
-      text});
+  record(logError, text.c_str(), text.length());
   return *this;
 }
 
@@ -70,77 +89,230 @@ WsConsole &WsConsole::warn(const String text) {
 
   Serial.printf("[warn] %s\r\n", text.c_str());
 
-  broadcast((log_t){
-      logWarn,
-      logScope,
-      text});
+  record(logWarn, text.c_str(), text.length());
 
   return *this;
 }
 
+size_t WsConsole::write(uint8_t c) {
+  if (loglevel < logInfo)
+    return 0;
+
+  if (c == '\n') {
+    endLine();
+  } else {
+    append((const char *)&c, 1);
+  }
+  return 1;
+}
+
+// Only the new bytes are scanned; a line is logged from the buffer it was
+// assembled in as soon as its newline arrives.
 size_t WsConsole::write(const uint8_t *data, size_t size) {
   if (loglevel < logInfo)
     return 0;
 
-  size_t len = log.write(data, size);
-  int index = log.indexOf("\r\n");
-  if (index != -1) {
-    String line = log.substring(0, index);
-    Serial.print("[");
-    Serial.print(logScope);
-    Serial.print("] ");
-    Serial.println(line);
+  const char *text = (const char *)data;
+  const char *end = text + size;
+  while (text < end) {
+    const char *newline = (const char *)memchr(text, '\n', end - text);
+    if (!newline) {
+      append(text, end - text);
+      break;
+    }
+    size_t length = newline - text;
+    if (length > 0 && newline[-1] == '\r') {
+      length--;  // println's "\r\n"
+    }
+    append(text, length);
+    endLine();
+    text = newline + 1;
+  }
 
-    broadcast((log_t){
-        logInfo,
-        logScope,
-        line});
+  return size;
+}
 
-    String rem = log.substring(index + 2);
-    log.clear();
-    log.concat(rem);
+// A runaway line is logged once it fills the buffer, marked with "...", and
+// whatever follows up to its newline is dropped.
+void WsConsole::append(const char *text, size_t length) {
+  if (overrun) {
+    return;
   }
 
-  return len;
+  size_t room = LOG_MAX_LINE - lineLength;
+  if (length <= room) {
+    memcpy(line + lineLength, text, length);
+    lineLength += length;
+    return;
+  }
+
+  memcpy(line + lineLength, text, room);
+  memcpy(line + LOG_MAX_LINE - 3, "...", 3);
+  lineLength = LOG_MAX_LINE;
+  endLine();
+  overrun = true;
 }
 
-void WsConsole::broadcast(log_t log) {
-  log.scope.replace("\"", "\\\"");
-  log.scope.replace("\r", "");
-  log.scope.replace("\n", "");
-  log.entry.replace("\"", "\\\"");
-  log.entry.replace("\r", "");
-  log.entry.replace("\n", "");
+void WsConsole::endLine() {
+  if (overrun) {
+    overrun = false;
+    return;
+  }
 
-  logs.push_back(log);
+  if (lineLength > 0 && line[lineLength - 1] == '\r') {
+    lineLength--;
+  }
+  line[lineLength] = 0;
 
-  if (logs.size() > 1000) {
-    if (logIndex > 0)
-      logIndex--;
-    logs.erase(logs.begin());
+  Serial.printf("[%s] %s\r\n", logScope.c_str(), line);
+  record(logInfo, line, lineLength);
+  lineLength = 0;
+}
+
+void WsConsole::record(uint8_t level, const void *data, size_t length) {
+  portENTER_CRITICAL(&logsLock);
+  if (scopeId == LOG_NO_SCOPE) {
+    scopeId = logs.intern(logScope.c_str());
   }
+  uint32_t seq = logs.append(level, scopeId, (const char *)data, length);
+  portEXIT_CRITICAL(&logsLock);
 
-  if (wss && wss->count() > 0) {
-    wss->textAll("{ \"event\": " + log.toJson() + " }");
-    logIndex++;
+  if (seq == streamed + 1 && pendingCallback) {
+    pendingCallback();
   }
 }
 
 size_t WsConsole::printTo(Print &p) const {
-  size_t i = 0;
+  LogCursor cursor(0, UINT32_MAX);
+  uint8_t buffer[128];
   size_t len = 0;
-  len += p.write('[');
-  for (auto &log : logs) {
-    String json = log.toJson();
-    if (i != 0) {
-      len += p.write(", ");
+  for (size_t n; (n = cursor.read(buffer, sizeof(buffer))) > 0;) {
+    len += p.write(buffer, n);
+  }
+  return len;
+}
+
+bool WsConsole::read(uint32_t since, LogLine &line) {
+  uint8_t payload[LOG_MAX_LINE + 1];
+  size_t length = 0;
+  uint8_t level = 0;
+  LogEntry entry;
+  portENTER_CRITICAL(&logsLock);
+  bool found = logs.find(since, entry);
+  if (found) {
+    line.seq = entry.seq;
+    level = entry.level;
+    strncpy(line.scope, entry.scope, sizeof(line.scope) - 1);
+    line.scope[sizeof(line.scope) - 1] = 0;
+    length = entry.length;
+    memcpy(payload, entry.text, length + 1);
+  }
+  portEXIT_CRITICAL(&logsLock);
+
+  if (!found) {
+    return false;
+  }
+
+  // formatted out here, other tasks keep logging meanwhile
+  line.level = level & ~LOG_PACKED;
+  line.packed = level & LOG_PACKED;
+  if (line.packed) {
+    line.ms = logMillis(payload);
+    logFormat(line.text, sizeof(line.text), payload, length);
+  } else {
+    line.ms = 0;
+    memcpy(line.text, payload, length + 1);
+  }
+  return true;
+}
+
+uint32_t WsConsole::lastSeq() {
+  portENTER_CRITICAL(&logsLock);
+  uint32_t seq = logs.lastSeq();
+  portEXIT_CRITICAL(&logsLock);
+  return seq;
+}
+
+void WsConsole::stream() {
+  LogLine line;
+  for (int n = 0; n < LOG_STREAM_BATCH && streamed < lastSeq(); n++) {
+    if (!read(streamed + 1, line)) {
+      streamed = lastSeq();  // cleared meanwhile
+      break;
     }
+    streamed = line.seq;
 
-    len += p.write(json.c_str(), json.length());
-    i++;
+    // the others went to Serial as they were logged
+    if (line.packed) {
+      Serial.printf("[%s] %s\r\n", line.scope, line.text);
+    }
+
+    if (attached) {
+      Broadcaster.post([&](JsonWriter &json) {
+        json.beginObject().key("event");
+        entryToJSON(json, line);
+        json.endObject();
+      });
+    }
   }
-  len += p.write(']');
-  return len;
+}
+
+unsigned long WsConsole::deadline() {
+  return streamed < lastSeq() ? 0 : ULONG_MAX;
+}
+
+void WsConsole::onPending(std::function<void()> callback) {
+  pendingCallback = callback;
+}
+
+bool WsConsole::enabled(logLevel_t level) {
+  return loglevel >= level;
+}
+
+LogCursor::LogCursor(uint32_t since, uint32_t limit)
+    : seq(since), until(WsConsole::lastSeq()), left(limit) {
+}
+
+size_t LogCursor::read(uint8_t *buffer, size_t size) {
+  size_t written = 0;
+  while (written < size) {
+    if (offset == length && !next()) {
+      break;
+    }
+    size_t n = min(size - written, length - offset);
+    memcpy(buffer + written, pending + offset, n);
+    offset += n;
+    written += n;
+  }
+  return written;
+}
+
+// render the next line, or the closing bracket, into pending
+bool LogCursor::next() {
+  if (closed) {
+    return false;
+  }
+
+  JsonBuffer out(pending, sizeof(pending));
+  LogLine line;
+  if (left > 0 && seq <= until && WsConsole::read(seq, line) && line.seq <= until) {
+    out.write(opened ? ',' : '[');
+    JsonWriter json(out);
+    entryToJSON(json, line);
+    seq = line.seq + 1;
+    left--;
+  } else {
+    if (!opened) {
+      out.write('[');
+    }
+    out.write(']');
+    closed = true;
+  }
+
+  opened = true;
+  length = strlen(pending);
+  offset = 0;
+  return true;
 }
 
 WsConsole &WsConsole::println(const char *scope, const char *line) {
@@ -150,8 +322,9 @@ WsConsole &WsConsole::println(const char *scope, const char *line) {
 }
 
 void WsConsole::clearLogs() {
+  portENTER_CRITICAL(&logsLock);
   logs.clear();
-  logIndex = 0;
+  portEXIT_CRITICAL(&logsLock);
 }
 
 WsConsole Console = WsConsole();
\ No newline at end of file
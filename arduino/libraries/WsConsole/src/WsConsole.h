@@ -6,7 +6,10 @@
 
 #include <map>
 
-#include "../../../includes/StreamString.h"
+#include "../../../includes/JsonWriter.h"
+#include "LogPack.h"
+#include "LogRing.h"
+#include "WsBroadcaster.h"
 
 typedef enum {
   logNone = 0,
@@ -15,31 +18,51 @@ typedef enum {
   logInfo = 3
 } logLevel_t;
 
-typedef struct {
-  logLevel_t level;
-  String scope;
-  String entry;
-  String toJson() {
-    String logLevel = "";
-    switch (level) {
-      case logError:
-        logLevel = "error";
-        break;
-      case logWarn:
-        logLevel = "warn";
-        break;
-      case logInfo:
-        logLevel = "info";
-        break;
-    }
-    return (String) "{ \"scope\": \"" + scope + "\", \"" + logLevel + "\": \"" + entry + "\" }";
-  }
-} log_t;
+// A stored log line copied out of the ring, safe to use while others log
+struct LogLine {
+  uint32_t seq;
+  uint8_t level;
+  bool packed;  // logged by info(), text was formatted on the way out
+  uint32_t ms;  // when a packed line was logged
+  char scope[LOG_SCOPE_SIZE];
+  char text[LOG_MAX_LINE + 1];
+};
+
+#define LOG_STREAM_BATCH 16  // lines one stream() call hands out
+
+// worst case of one rendered line: every character escaped as \u00XX
+#define LOG_CURSOR_SIZE (6 * (LOG_MAX_LINE + LOG_SCOPE_SIZE) + 64)
+
+// Renders the stored log as a JSON array piece by piece, e.g. into a chunked
+// response. Only the line being copied out is buffered; lines logged after
+// the cursor was created are left to the WebSocket events.
+class LogCursor {
+ public:
+  LogCursor(uint32_t since, uint32_t limit);
+
+  // fills up to size bytes; 0 once the array is closed
+  size_t read(uint8_t *buffer, size_t size);
+
+ private:
+  bool next();
+
+  uint32_t seq;
+  uint32_t until;
+  uint32_t left;
+  bool opened = false;
+  bool closed = false;
+  char pending[LOG_CURSOR_SIZE];
+  size_t length = 0;
+  size_t offset = 0;
+};
 
 class WsConsole : public Print, Printable {
  private:
   String logScope;
-  StreamString log;
+  char line[LOG_MAX_LINE + 1];  // the line being printed, up to its newline
+  uint16_t lineLength = 0;
+  bool overrun = false;  // the rest of a truncated line is dropped
+  uint8_t scopeId = LOG_NO_SCOPE;  // interned on the first line
 
  public:
   WsConsole() : WsConsole("") {}
@@ -61,22 +84,50 @@ class WsConsole : public Print, Printable {
   WsConsole &warn(const char *scope, const char *line);
   WsConsole &warn(const String text);
 
-  virtual size_t write(uint8_t c) override {
-    return write(&c, 1);
+  // Stores the format literal and the arguments as they are, in constant
+  // time and without the heap; the text is formatted by whoever reads the
+  // line: stream() for Serial and the WebSocket, or GET /esp/log.
+  //
+  //   console.info("Starting timer %u for %u min", zone, duration);
+  template <typename... Args>
+  WsConsole &info(const char *format, const Args &...args) {
+    if (enabled(logInfo)) {
+      uint8_t payload[LOG_MAX_LINE];
+      size_t length = logPack(payload, sizeof(payload), millis(), format, args...);
+      record(logInfo | LOG_PACKED, payload, length);
+    }
+    return *this;
   }
 
+  virtual size_t write(uint8_t c) override;
+
   virtual size_t write(const uint8_t *data, size_t size) override;
 
   virtual size_t printTo(Print &p) const override;
 
   static void clearLogs();
 
+  // the oldest stored line with a sequence number of at least since
+  static bool read(uint32_t since, LogLine &line);
+  static uint32_t lastSeq();
+
+  // hand the lines logged since the last call to Serial and the WebSocket
+  static void stream();
+  // 0 while lines wait for stream()
+  static unsigned long deadline();
+  // called when a line is logged with none waiting, e.g. to wake the loop
+  static void onPending(std::function<void()> callback);
+
+  static bool enabled(logLevel_t level);
+
   WsConsole &println(const char *scope, const char *line);
 
   using Print::println;
 
  private:
-  void broadcast(log_t log);
+  void append(const char *text, size_t length);
+  void endLine();
+  void record(uint8_t level, const void *data, size_t length);
 };
 
 extern WsConsole Console;
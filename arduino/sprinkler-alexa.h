@@ -5,6 +5,7 @@
 #include <fauxmoESP.h>
 
 #include "sprinkler.h"
+#include "sprinkler-loop.h"
 #include "html/settings.json.h"
 
 static WsConsole alexa_console("alxa");
@@ -29,6 +30,13 @@ void handleAlexa() {
   }
 }
 
+unsigned long alexaDeadline() {
+  if (fauxmo && Sprinkler.Device.alexaEnabled() && (WiFi.getMode() & WIFI_STA)) {
+    return fauxmo->nextNotify();
+  }
+  return LOOP_IDLE;
+}
+
 void setupAlexa() {
   if (!(WiFi.getMode() & WIFI_STA)) {
     alexa_console.println("Skipped (not in STA mode)");
@@ -101,12 +109,14 @@ void setupAlexa() {
       // All zones device: start all / stop all
       alexa_console.printf("Set: %s (ALL) -> %s\n", device_name, state ? "ON" : "OFF");
       if (state) {
-        // Turn on all configured zones
-        Sprinkler.Settings.forEachZone([](unsigned int zId, SprinklerZone* zone) {
+        // Turn on all configured zones with a single relay write
+        std::vector<unsigned int> zones;
+        Sprinkler.Settings.forEachZone([&zones](unsigned int zId, SprinklerZone* zone) {
           if (zone->name().length() > 0) {
-            Sprinkler.start(zId, SKETCH_TIMER_DEFAULT_LIMIT);
+            zones.push_back(zId);
           }
         });
+        Sprinkler.start(zones, SKETCH_TIMER_DEFAULT_LIMIT);
       } else {
         // Stop all zones
         Sprinkler.stop();
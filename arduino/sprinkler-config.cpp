@@ -0,0 +1,215 @@
+#include <rom/crc.h>
+
+#include <vector>
+
+#include "sprinkler-config.h"
+
+// Schema 1: the header-less SprinklerConfig written by firmware before the
+// versioned format. It was only accepted while full_name matched the exact
+// firmware version, so every upgrade dropped the configuration.
+struct SprinklerTimerConfigV1
+{
+  bool defined;
+  unsigned int h;
+  unsigned int m;
+  unsigned int d;
+};
+
+struct SprinklerZoneConfigV1
+{
+  bool defined;
+  char disp_name[50];
+  SprinklerTimerConfigV1 days[8];
+};
+
+struct SprinklerSequenceConfigV1
+{
+  bool enabled;
+  uint8_t order[6];
+  uint8_t days;
+  uint8_t hour;
+  uint8_t minute;
+  uint8_t duration;
+  uint8_t gap;
+};
+
+struct SprinklerConfigV1
+{
+  uint8_t version;
+  uint8_t loglevel;
+  char full_name[50];
+  char host_name[50];
+  char disp_name[50];
+  char source;
+  bool alexa_enabled;
+  char mqtt_host[64];
+  uint16_t mqtt_port;
+  char mqtt_user[32];
+  char mqtt_pass[64];
+  bool mqtt_enabled;
+  SprinklerSequenceConfigV1 sequence;
+  SprinklerZoneConfigV1 zones[SKETCH_MAX_ZONES];
+};
+
+static void migrateV1(const uint8_t *from, uint8_t *to)
+{
+  const SprinklerConfigV1 &v1 = *(const SprinklerConfigV1 *)from;
+  SprinklerConfig &cfg = *(SprinklerConfig *)to;
+
+  cfg.version = v1.version;
+  cfg.loglevel = v1.loglevel;
+  memcpy(cfg.host_name, v1.host_name, sizeof(cfg.host_name));
+  memcpy(cfg.disp_name, v1.disp_name, sizeof(cfg.disp_name));
+  cfg.source = v1.source;
+  cfg.alexa_enabled = v1.alexa_enabled;
+  memcpy(cfg.mqtt_host, v1.mqtt_host, sizeof(cfg.mqtt_host));
+  cfg.mqtt_port = v1.mqtt_port;
+  memcpy(cfg.mqtt_user, v1.mqtt_user, sizeof(cfg.mqtt_user));
+  memcpy(cfg.mqtt_pass, v1.mqtt_pass, sizeof(cfg.mqtt_pass));
+  cfg.mqtt_enabled = v1.mqtt_enabled;
+
+  cfg.sequence.enabled = v1.sequence.enabled;
+  memcpy(cfg.sequence.order, v1.sequence.order, sizeof(cfg.sequence.order));
+  cfg.sequence.days = v1.sequence.days;
+  cfg.sequence.hour = v1.sequence.hour;
+  cfg.sequence.minute = v1.sequence.minute;
+  cfg.sequence.duration = v1.sequence.duration;
+  cfg.sequence.gap = v1.sequence.gap;
+  cfg.sequence.offset = 0;
+
+  for (uint8_t i = 0; i < SKETCH_MAX_ZONES; i++)
+  {
+    cfg.zones[i].defined = v1.zones[i].defined;
+    memcpy(cfg.zones[i].disp_name, v1.zones[i].disp_name, sizeof(cfg.zones[i].disp_name));
+    for (uint8_t d = 0; d < 8; d++)
+    {
+      const SprinklerTimerConfigV1 &timer = v1.zones[i].days[d];
+      cfg.zones[i].days[d].defined = timer.defined;
+      cfg.zones[i].days[d].h = timer.h;
+      cfg.zones[i].days[d].m = timer.m;
+      cfg.zones[i].days[d].d = timer.d;
+    }
+  }
+}
+
+// Each step upgrades one schema to the next. When SprinklerConfig changes,
+// freeze the old layout as SprinklerConfigV<n>, bump CONFIG_SCHEMA and add a step.
+struct SprinklerConfigMigration
+{
+  uint16_t schema;    // schema the step reads
+  uint16_t length;    // payload size of that schema
+  uint16_t upgraded;  // payload size of schema + 1
+  void (*upgrade)(const uint8_t *from, uint8_t *to);
+};
+
+static const SprinklerConfigMigration migrations[] = {
+  {1, sizeof(SprinklerConfigV1), sizeof(SprinklerConfig), migrateV1},
+};
+
+static bool isLegacy(const uint8_t *blob, size_t size)
+{
+  if (size < sizeof(SprinklerConfigV1))
+  {
+    return false;
+  }
+
+  const SprinklerConfigV1 &v1 = *(const SprinklerConfigV1 *)blob;
+  return strncmp(v1.full_name, "sprinkler-v", 11) == 0 && memchr(v1.full_name, 0, sizeof(v1.full_name));
+}
+
+const SprinklerConfig *configView(const uint8_t *blob, size_t size)
+{
+  const SprinklerConfigHeader &header = *(const SprinklerConfigHeader *)blob;
+  const uint8_t *payload = blob + sizeof(SprinklerConfigHeader);
+
+  if (size < sizeof(SprinklerConfigHeader) + sizeof(SprinklerConfig) ||
+      header.magic != CONFIG_MAGIC ||
+      header.schema != CONFIG_SCHEMA ||
+      header.length != sizeof(SprinklerConfig) ||
+      header.crc != crc32_le(0, payload, header.length))
+  {
+    return nullptr;
+  }
+
+  return (const SprinklerConfig *)payload;
+}
+
+bool configMigrate(const uint8_t *blob, size_t size, SprinklerConfig &cfg)
+{
+  const SprinklerConfigHeader &header = *(const SprinklerConfigHeader *)blob;
+  uint16_t schema;
+  const uint8_t *payload;
+  size_t length;
+
+  if (header.magic == CONFIG_MAGIC)
+  {
+    schema = header.schema;
+    payload = blob + sizeof(SprinklerConfigHeader);
+    length = header.length;
+    if (sizeof(SprinklerConfigHeader) + length > size || header.crc != crc32_le(0, payload, length))
+    {
+      return false;
+    }
+  }
+  else if (isLegacy(blob, size))
+  {
+    schema = 1;
+    payload = blob;
+    length = sizeof(SprinklerConfigV1);
+  }
+  else
+  {
+    return false;
+  }
+
+  std::vector<uint8_t> current(payload, payload + length);
+  std::vector<uint8_t> next;
+  while (schema < CONFIG_SCHEMA)
+  {
+    const SprinklerConfigMigration *step = nullptr;
+    for (const auto &migration : migrations)
+    {
+      if (migration.schema == schema)
+      {
+        step = &migration;
+      }
+    }
+
+    if (step == nullptr || current.size() != step->length)
+    {
+      return false;
+    }
+
+    next.assign(step->upgraded, 0);
+    step->upgrade(current.data(), next.data());
+    current.swap(next);
+    schema++;
+  }
+
+  // a newer firmware's layout is not downgraded
+  if (schema != CONFIG_SCHEMA || current.size() != sizeof(SprinklerConfig))
+  {
+    return false;
+  }
+
+  memcpy((void *)&cfg, current.data(), sizeof(SprinklerConfig));
+  return true;
+}
+
+size_t configWrite(uint8_t *blob, size_t size, const SprinklerConfig &cfg)
+{
+  size_t length = sizeof(SprinklerConfigHeader) + sizeof(SprinklerConfig);
+  if (size < length)
+  {
+    return 0;
+  }
+
+  SprinklerConfigHeader &header = *(SprinklerConfigHeader *)blob;
+  uint8_t *payload = blob + sizeof(SprinklerConfigHeader);
+  memcpy(payload, (const void *)&cfg, sizeof(SprinklerConfig));
+  header.magic = CONFIG_MAGIC;
+  header.schema = CONFIG_SCHEMA;
+  header.length = sizeof(SprinklerConfig);
+  header.crc = crc32_le(0, payload, sizeof(SprinklerConfig));
+  return length;
+}
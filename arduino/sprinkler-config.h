@@ -1,16 +1,31 @@
 #ifndef SPRINKLER_CONFIG_H
 #define SPRINKLER_CONFIG_H
 
+#include <Arduino.h>
+
 #include "html/settings.json.h"
 
+#define CONFIG_MAGIC 0x4B525053  // "SPRK"
+#define CONFIG_SCHEMA 2          // bump with every SprinklerConfig layout change
+
+// Stored ahead of the SprinklerConfig payload
+struct SprinklerConfigHeader
+{
+  uint32_t magic;
+  uint16_t schema;  // layout of the payload
+  uint16_t length;  // payload bytes
+  uint32_t crc;     // CRC32 of the payload
+};
+
 struct SprinklerTimerConfig
 {
-  bool defined;
-  unsigned int h;
-  unsigned int m;
-  unsigned int d;
+  uint32_t defined : 1;
+  uint32_t h : 5;
+  uint32_t m : 6;
+  uint32_t d : 12;  // minutes
+  uint32_t : 8;
 
-  SprinklerTimerConfig(): defined(false), h(0), m(0), d(0) {}
+  SprinklerTimerConfig(): defined(0), h(0), m(0), d(0) {}
 };
 
 struct SprinklerZoneConfig
@@ -30,10 +45,11 @@ struct SprinklerSequenceConfig
   uint8_t minute;             // Start minute (0-59)
   uint8_t duration;           // Duration per zone in minutes
   uint8_t gap;                // Gap between zones in minutes
+  int8_t offset;              // Client timezone offset in hours (UTC = local + offset)
 
   SprinklerSequenceConfig()
     : enabled(false), order{0}, days(0),
-      hour(6), minute(0), duration(15), gap(5) {}
+      hour(6), minute(0), duration(15), gap(5), offset(0) {}
 
   // Helper to get count (like strlen for null-terminated strings)
   uint8_t orderCount() const {
@@ -48,7 +64,6 @@ struct SprinklerConfig
 {
   uint8_t version;
   uint8_t loglevel;
-  char full_name[50];
   char host_name[50];
   char disp_name[50];
   char source;
@@ -63,9 +78,18 @@ struct SprinklerConfig
   SprinklerSequenceConfig sequence;
   // Zones
   SprinklerZoneConfig zones[SKETCH_MAX_ZONES];
-  SprinklerConfig(): version(0), full_name({0}), host_name({0}), disp_name({0}),
+  SprinklerConfig(): version(0), host_name({0}), disp_name({0}),
     source('P'), alexa_enabled(true), mqtt_host({0}), mqtt_port(1883),
     mqtt_user({0}), mqtt_pass({0}), mqtt_enabled(false) {}
 };
 
+// Validate a stored blob in place; returns the payload when it is of the current schema.
+const SprinklerConfig *configView(const uint8_t *blob, size_t size);
+
+// Upgrade a blob written by an older firmware through the registered migrations.
+bool configMigrate(const uint8_t *blob, size_t size, SprinklerConfig &cfg);
+
+// Write header and payload; returns the number of bytes used.
+size_t configWrite(uint8_t *blob, size_t size, const SprinklerConfig &cfg);
+
 #endif
\ No newline at end of file
@@ -1,9 +1,12 @@
 #include "sprinkler-device.h"
+#include "sprinkler-persist.h"
 #include "sprinkler-pinout.h"
+#include "sprinkler-store.h"
 
 #include <WsConsole.h>
 #include <Ticker.h>
 
+
 #ifdef ESP8266
 #define getChipId() ESP.getChipId() 
 #elif defined(ESP32)
@@ -14,7 +17,7 @@ WsConsole unitLog("unit");
 Ticker Timer;
 
 SprinklerDevice::SprinklerDevice()
- : pins{ENG_PIN, RL1_PIN, RL2_PIN, RL3_PIN, RL4_PIN, RL5_PIN, RL6_PIN} {
+ : relays(0), source_pin(ENG_PIN), revisions(0) {
   disp_name = "Sprinkler";
   host_name = "sprinkler-" + String(getChipId(), HEX);
   full_name = "sprinkler-v" + (String)SKETCH_VERSION_MAJOR + "." + (String)SKETCH_VERSION_MINOR + "." + (String)SKETCH_VERSION_RELEASE + "_" + String(getChipId(), HEX);
@@ -50,6 +53,7 @@ logLevel_t SprinklerDevice::logLevel(const char *level) {
   } else if (strcmp(level, "info") == 0) {
     loglevel = logInfo;
   }
+  touch();
   return (logLevel_t)loglevel;
 }
 
@@ -57,6 +61,7 @@ const String SprinklerDevice::hostname(const char *name) {
   if (strlen(name) > 0) {
     if (!host_name.equals(name)) {
       host_name = name;
+      touch();
     }
   }
 
@@ -67,6 +72,7 @@ const String SprinklerDevice::dispname(const char *name) {
   if (strlen(name) > 0) {
     if (!disp_name.equals(name)) {
       disp_name = name;
+      touch();
     }
   }
 
@@ -74,7 +80,7 @@ const String SprinklerDevice::dispname(const char *name) {
 }
 
 const String SprinklerDevice::source() {
-   return pins[0] == ENG_PIN ? "pump" : "utility";
+   return source_pin == ENG_PIN ? "pump" : "utility";
 }
 
 const String SprinklerDevice::source(const char *name) {
@@ -90,12 +96,13 @@ const String SprinklerDevice::source(const char *name) {
 }
 
 const bool SprinklerDevice::source(const uint8_t pin) {
-  if (pins[0] != pin)
+  if (source_pin != pin)
   {
     turnOff();
     pinMode(pin, OUTPUT);
     digitalWrite(pin, HIGH);
-    pins[0] = pin;
+    source_pin = pin;
+    touch();
     return true;
   }
 
@@ -106,20 +113,30 @@ void SprinklerDevice::init()
 {
    pinMode(LED_PIN, OUTPUT);
 
-   for(const uint8_t &pin : pins)
-   {
-      pinMode(pin, OUTPUT);
-      digitalWrite(pin, HIGH);
-   }
+   pinMode(source_pin, OUTPUT);
+   digitalWrite(source_pin, HIGH);
+   driver.begin();
 }
 
 SprinklerConfig SprinklerDevice::load() {
-  EEPROM.begin(EEPROM_SIZE);
-
   SprinklerConfig cfg;
-  EEPROM.get(0, cfg);
+  bool found = Store.load(cfg);
+  bool migrated = false;
+  if (!found) {
+    EEPROM.begin(EEPROM_SIZE);
+    const SprinklerConfig *stored = configView(EEPROM.getConstDataPtr(), EEPROM_SIZE);
+    if (stored) {
+      cfg = *stored;
+      found = true;
+      migrated = Store.isReady();  // first boot with the config partition
+    } else if (configMigrate(EEPROM.getConstDataPtr(), EEPROM_SIZE, cfg)) {
+      unitLog.println("config migrated.");
+      found = migrated = true;
+    }
+    EEPROM.end();
+  }
 
-  if (full_name.equals(cfg.full_name)) {
+  if (found) {
     unitLog.print("log level: ");
     unitLog.println(cfg.loglevel);
     loglevel = cfg.loglevel;
@@ -131,7 +148,7 @@ SprinklerConfig SprinklerDevice::load() {
     host_name = cfg.host_name;
     unitLog.print("water source: ");
     unitLog.println(cfg.source);
-    pins[0] = cfg.source == 'U' ? UTL_PIN : ENG_PIN;
+    source_pin = cfg.source == 'U' ? UTL_PIN : ENG_PIN;
     unitLog.print("alexa enabled: ");
     unitLog.println(cfg.alexa_enabled ? "yes" : "no");
     alexa_enabled = cfg.alexa_enabled;
@@ -152,23 +169,24 @@ SprinklerConfig SprinklerDevice::load() {
     memset(&cfg, 0, sizeof(SprinklerConfig));
     strcpy(cfg.disp_name, disp_name.c_str());
     strcpy(cfg.host_name, host_name.c_str());
-    strcpy(cfg.full_name, full_name.c_str());
     cfg.loglevel = logInfo;
     cfg.alexa_enabled = true;
     cfg.version = version;
     unitLog.println("no config found.");
   }
 
-  EEPROM.end();
+  if (migrated) {
+    toConfig(cfg);
+    Persist.stage(cfg);  // rewrite in the current schema and location
+  }
 
   return cfg;
 }
 
-void SprinklerDevice::save(SprinklerConfig cfg) {
+void SprinklerDevice::toConfig(SprinklerConfig &cfg) {
   strcpy(cfg.disp_name, disp_name.c_str());
   strcpy(cfg.host_name, host_name.c_str());
-  strcpy(cfg.full_name, full_name.c_str());
-  cfg.source = pins[0] == ENG_PIN ? 'P' : 'U';
+  cfg.source = source_pin == ENG_PIN ? 'P' : 'U';
   cfg.loglevel = loglevel;
   cfg.alexa_enabled = alexa_enabled;
   strncpy(cfg.mqtt_host, mqtt_host.c_str(), 63);
@@ -178,14 +196,10 @@ void SprinklerDevice::save(SprinklerConfig cfg) {
   cfg.mqtt_enabled = mqtt_enabled;
   cfg.sequence = seq_config;
   cfg.version = version + 1;
-  EEPROM.begin(EEPROM_SIZE);
-  EEPROM.put(0, cfg);
-  EEPROM.commit();
-  EEPROM.end();
-  unitLog.println("Saved.");
 }
 
 void SprinklerDevice::clear() {
+  Store.format();
   for (int i = 0; i < EEPROM.length(); i++) {
     EEPROM.write(i, 0);
   }
@@ -194,21 +208,66 @@ void SprinklerDevice::clear() {
 }
 
 uint8_t SprinklerDevice::toggle(uint8_t relay) {
-  if (relay < sizeof(pins)) {
-    uint8_t val = digitalRead(pins[relay]);
-    digitalWrite(pins[relay], !val);
-    bitWrite(relays, relay, val);
+  if (relay <= SKETCH_MAX_ZONES) {
+    RelayMask mask = (RelayMask)1 << relay;
+    bool on = relays & mask;
+    apply(on ? 0 : mask, on ? mask : 0);
 
-    return !val;
+    return !on;
   }
 
   return 255;
 }
 
+RelayMask SprinklerDevice::apply(RelayMask onMask, RelayMask offMask) {
+  RelayMask all = ((RelayMask)1 << (SKETCH_MAX_ZONES + 1)) - 1;
+  RelayMask state = ((relays | onMask) & ~offMask) & all;
+  RelayMask changed = state ^ relays;
+  if (!changed) {
+    return relays;
+  }
+
+  bool source = state & 1;
+  bool sourceOff = (changed & 1) && !source;
+  relays = state;
+
+  // engine off before the zones close, engine on after they opened
+  if (sourceOff) {
+    digitalWrite(source_pin, HIGH);
+  }
+  if (changed >> 1) {
+    driver.write((ZoneMask)(state >> 1));
+  }
+  if ((changed & 1) && source) {
+    digitalWrite(source_pin, LOW);
+  }
+
+  return relays;
+}
+
+void SprinklerDevice::stage(RelayMask onMask, RelayMask offMask) {
+  if (!transitions.push(relays, onMask, offMask, esp_timer_get_time())) {
+    unitLog.warn("relay queue full, switching at once");
+    apply(onMask, offMask);
+  }
+}
+
+void SprinklerDevice::halt() {
+  transitions.clear();
+  apply(0, ~(RelayMask)0);
+}
+
+void SprinklerDevice::handleRelays() {
+  RelayTransition step;
+  while (transitions.pop(step, esp_timer_get_time())) {
+    apply(step.on, step.off);
+    transitions.applied(step, esp_timer_get_time());
+  }
+}
+
 uint8_t SprinklerDevice::turnOn(uint8_t relay) {
-  if (relay < sizeof(pins) && !bitRead(relays, relay)) {
-    digitalWrite(pins[relay], LOW);
-    bitWrite(relays, relay, 1);
+  if (relay <= SKETCH_MAX_ZONES && !(relays & ((RelayMask)1 << relay))) {
+    apply((RelayMask)1 << relay, 0);
 
     return 1;
   }
@@ -217,9 +276,8 @@ uint8_t SprinklerDevice::turnOn(uint8_t relay) {
 }
 
 uint8_t SprinklerDevice::turnOff(uint8_t relay) {
-  if (relay < sizeof(pins) && bitRead(relays, relay)) {
-    digitalWrite(pins[relay], HIGH);
-    bitWrite(relays, relay, 0);
+  if (relay <= SKETCH_MAX_ZONES && (relays & ((RelayMask)1 << relay))) {
+    apply(0, (RelayMask)1 << relay);
 
     return 0;
   }
@@ -241,6 +299,7 @@ void SprinklerDevice::blink(float seconds){
 
 void SprinklerDevice::reset() {
   unitLog.println("Reseting...");
+  Store.format();
   for (int i = 0; i < EEPROM.length(); i++) {
     EEPROM.write(i, 0);
   }
@@ -252,5 +311,5 @@ void SprinklerDevice::reset() {
 
 void SprinklerDevice::restart() {
   unitLog.println("Restarting...");
-  abort();
+  ESP.restart();  // ESP_RST_SW, Recovery discards the run instead of resuming it
 }
\ No newline at end of file
@@ -6,12 +6,15 @@
 
 #include "includes/files.h"
 #include "sprinkler-config.h"
+#include "sprinkler-relay.h"
 
 #define EEPROM_SIZE 4096
 
 class SprinklerDevice {
  protected:
-  uint8_t relays;
+  RelayMask relays;
+  RelayDriver driver;
+  RelayQueue transitions;
 
  private:
   uint8_t loglevel;
@@ -31,14 +34,13 @@ class SprinklerDevice {
   // Sequence config
   SprinklerSequenceConfig seq_config;
 
-  // [0] water source
-  // [1] zone 1
-  // ...
-  // [6] zone 6
-  uint8_t pins[7]; 
+  // water source relay, zone relays are driven by the relay driver
+  uint8_t source_pin;
 
   uint8_t version;
 
+  uint32_t revisions;
+
  public:
   SprinklerDevice();
 
@@ -72,42 +74,63 @@ class SprinklerDevice {
 
   logLevel_t logLevel(const char *level);
 
-  void logLevel(uint8_t level) { loglevel = level; }
+  void logLevel(uint8_t level) { if (loglevel != level) { loglevel = level; touch(); } }
 
   const char *logLevel();
 
   uint8_t logLevelNumber() { return loglevel; }
 
   bool alexaEnabled() { return alexa_enabled; }
-  void alexaEnabled(bool enabled) { alexa_enabled = enabled; }
+  void alexaEnabled(bool enabled) { if (alexa_enabled != enabled) { alexa_enabled = enabled; touch(); } }
 
   // MQTT configuration accessors
   String mqttHost() { return mqtt_host; }
-  void mqttHost(const char* host) { mqtt_host = host; }
+  void mqttHost(const char* host) { if (mqtt_host != host) { mqtt_host = host; touch(); } }
 
   uint16_t mqttPort() { return mqtt_port; }
-  void mqttPort(uint16_t port) { mqtt_port = port; }
+  void mqttPort(uint16_t port) { if (mqtt_port != port) { mqtt_port = port; touch(); } }
 
   String mqttUser() { return mqtt_user; }
-  void mqttUser(const char* user) { mqtt_user = user; }
+  void mqttUser(const char* user) { if (mqtt_user != user) { mqtt_user = user; touch(); } }
 
   String mqttPass() { return mqtt_pass; }
-  void mqttPass(const char* pass) { mqtt_pass = pass; }
+  void mqttPass(const char* pass) { if (mqtt_pass != pass) { mqtt_pass = pass; touch(); } }
 
   bool mqttEnabled() { return mqtt_enabled; }
-  void mqttEnabled(bool enabled) { mqtt_enabled = enabled; }
+  void mqttEnabled(bool enabled) { if (mqtt_enabled != enabled) { mqtt_enabled = enabled; touch(); } }
 
-  // Sequence config accessor
+  // Sequence config accessor; call touch() after editing through it
   SprinklerSequenceConfig& sequence() { return seq_config; }
 
+  // bumped by every setter, keys the JSON cache
+  uint32_t revision() const { return revisions; }
+  void touch() { revisions++; }
+
   SprinklerConfig load();
 
   void init();
 
-  void save(SprinklerConfig cfg);
+  // fill the device part of a config snapshot
+  void toConfig(SprinklerConfig &cfg);
 
   void clear();
 
+  // Switch several relays with one driver transaction.
+  // Bit 0 is the water source, bit n is zone n; off wins over on.
+  RelayMask apply(RelayMask onMask, RelayMask offMask);
+
+  RelayMask relayMask() const { return relays; }
+
+  // Stage a change through the transition queue (pump lead/lag, switch spacing).
+  void stage(RelayMask onMask, RelayMask offMask);
+  // Drop staged changes and switch everything off at once.
+  void halt();
+
+  // apply due transitions; call from the loop task only
+  void handleRelays();
+  unsigned long relaysDeadline() { return transitions.deadline(esp_timer_get_time()); }
+  void relaysJSON(JsonWriter &json) { transitions.toJSON(json); }
+
   uint8_t ICACHE_RAM_ATTR turnOn(uint8_t relay = 0);
 
   uint8_t ICACHE_RAM_ATTR turnOff(uint8_t relay = 0);
@@ -120,11 +143,8 @@ class SprinklerDevice {
 
   void restart();
 
-  String toJSON() {
-    return (String) "{" +
-           "\r\n  \"disp_name\": \"" + dispname() + "\"" +
-           "\r\n ,\"host_name\": \"" + hostname() + "\"" +
-           "\r\n}";
+  void toJSON(JsonWriter &json) {
+    json.beginObject().member("disp_name", dispname()).member("host_name", hostname()).endObject();
   }
 };
 
@@ -7,13 +7,18 @@
 #include <ESPmDNS.h>
 #include <TimeLib.h>
 #include <WsConsole.h>
+#include <rom/crc.h>
 
 #include "includes/AsyncHTTPAPHandler.h"
 #include "includes/AsyncHTTPUpdateHandler.h"
 #include "includes/AsyncHTTPUpgradeHandler.h"
+#include "includes/JsonWriter.h"
 #include "includes/StreamString.h"
 #include "includes/files.h"
 #include "sprinkler.h"
+#include "sprinkler-loop.h"
+#include "sprinkler-persist.h"
+#include "sprinkler-store.h"
 
 // Forward declaration for Alexa integration (defined in sprinkler-alexa.h)
 bool processAlexaRequest(AsyncClient *client, bool isGet, String url, String body);
@@ -37,6 +42,75 @@ void json(AsyncWebServerRequest *request, const String text) {
   request->send(200, "application/json", text);
 }
 
+typedef std::function<void(JsonWriter &)> JsonBody;
+
+// stream the body into the response, no intermediate String
+void json(AsyncWebServerRequest *request, JsonBody body) {
+  AsyncResponseStream *response = request->beginResponseStream("application/json");
+  JsonWriter writer(*response);
+  body(writer);
+  request->send(response);
+}
+
+// Serialized body of a GET route, rebuilt only when the revision of the
+// objects behind it moves. Clients revalidate with If-None-Match.
+struct JsonCache {
+  uint32_t revision = 0;
+  bool valid = false;
+  String body;
+  char etag[11];  // "crc32"
+
+  uint32_t hits = 0;
+  uint32_t misses = 0;
+  uint32_t notModified = 0;
+  uint32_t bypassed = 0;
+
+  void toJSON(JsonWriter &json) const {
+    json.beginObject()
+        .member("hits", hits)
+        .member("misses", misses)
+        .member("notModified", notModified)
+        .member("bypassed", bypassed)
+        .member("bytes", body.length())
+        .endObject();
+  }
+};
+
+JsonCache settingsCache;
+JsonCache zonesCache;
+JsonCache stateCache;
+
+SprinklerParser settingsParser;
+
+void json(AsyncWebServerRequest *request, JsonCache &cache, uint32_t revision, JsonBody body) {
+  if (!cache.valid || cache.revision != revision) {
+    StreamString out;
+    JsonWriter writer(out);
+    body(writer);
+    cache.body = out;
+    cache.revision = revision;
+    cache.valid = true;
+    snprintf(cache.etag, sizeof(cache.etag), "\"%08x\"", crc32_le(0, (const uint8_t *)cache.body.c_str(), cache.body.length()));
+    cache.misses++;
+  } else {
+    cache.hits++;
+  }
+
+  if (request->header("If-None-Match").equals(cache.etag)) {
+    cache.notModified++;
+    AsyncWebServerResponse *response = request->beginResponse(304);
+    response->addHeader("ETag", cache.etag);
+    request->send(response);
+    return;
+  }
+
+  // the response keeps its own copy, the cache may be rebuilt while it is sent
+  AsyncWebServerResponse *response = request->beginResponse(200, "application/json", cache.body);
+  response->addHeader("ETag", cache.etag);
+  response->addHeader("Cache-Control", "no-cache");
+  request->send(response);
+}
+
 void gzip(AsyncWebServerRequest *request, const char *contentType, const unsigned char *content, size_t contentLength) {
   if (!request->header("If-Modified-Since").equals(Sprinkler.builtDateString())) {
     AsyncWebServerResponse *response = request->beginResponse_P(200, contentType, content, contentLength);
@@ -48,11 +122,25 @@ void gzip(AsyncWebServerRequest *request, const char *contentType, const unsigne
   }
 }
 
+// "zone" of a state event, the key it is coalesced by
+unsigned int zoneOf(const char *state) {
+  const char *zone = strstr(state, "\"zone\":");
+  return zone ? atoi(zone + 7) : 0;
+}
+
 void setupHttp() {
   static WsConsole console("http");
 
+  // one frame per WS_BATCH_INTERVAL, only the latest state of each zone
+  Broadcaster.begin(&ws);
+  Broadcaster.onPending([]() { Loop.wake(); });
+
   Sprinkler.on("state", [](const char *event) {
-    ws.textAll((String) "{ \"state\": " + (String)(strlen(event) ? event : "null") + "}");
+    Broadcaster.update("state", zoneOf(event), strlen(event) ? event : "null");
+  });
+
+  Sprinkler.on("sequence", [](const char *event) {
+    Broadcaster.update("sequence", 0, strlen(event) ? event : "null");
   });
 
   http.on("/", [&](AsyncWebServerRequest *rqt) { gzip(rqt, "text/html", SKETCH_INDEX_HTML_GZ, sizeof(SKETCH_INDEX_HTML_GZ)); });
@@ -63,7 +151,13 @@ void setupHttp() {
   http.on("/js/setup.js", [&](AsyncWebServerRequest *rqt) { gzip(rqt, "application/javascript", SKETCH_SETUP_JS_GZ, sizeof(SKETCH_SETUP_JS_GZ)); });
 
   http.on("/api/state", ASYNC_HTTP_GET, [&](AsyncWebServerRequest *request) {
-    json(request, Sprinkler.Timers.toJSON());
+    if (Sprinkler.Timers.isWatering()) {
+      // running zones count down, no two bodies are the same
+      stateCache.bypassed++;
+      json(request, [](JsonWriter &json) { Sprinkler.Timers.toJSON(json); });
+    } else {
+      json(request, stateCache, Sprinkler.Timers.revision(), [](JsonWriter &json) { Sprinkler.Timers.toJSON(json); });
+    }
   });
 
   http.on("/api/zone/{}/state", ASYNC_HTTP_GET, [&](AsyncWebServerRequest *request) {
@@ -72,7 +166,7 @@ void setupHttp() {
       request->send(400, "application/json", "{\"error\":\"Invalid zone\"}");
       return;
     }
-    json(request, Sprinkler.Timers.toJSON(rel));
+    json(request, [rel](JsonWriter &json) { Sprinkler.Timers.toJSON(json, rel); });
   });
 
   http.on("/api/zone/{}/start", ASYNC_HTTP_GET, [&](AsyncWebServerRequest *request) {
@@ -86,9 +180,9 @@ void setupHttp() {
     if (dur > SKETCH_TIMER_DEFAULT_LIMIT) {
       dur = SKETCH_TIMER_DEFAULT_LIMIT;
     }
-    console.println("GET: /api/zone/" + (String)rel + "/start?d=" + (String)dur);
+    console.info("GET: /api/zone/%u/start?d=%u", rel, dur);
     Sprinkler.start(rel, dur);
-    json(request, Sprinkler.Timers.toJSON(rel));
+    json(request, [rel](JsonWriter &json) { Sprinkler.Timers.toJSON(json, rel); });
   });
   http.on("/api/zone/{}/stop", ASYNC_HTTP_GET, [&](AsyncWebServerRequest *request) {
     uint8_t rel = request->pathArg(0).toInt();
@@ -97,7 +191,7 @@ void setupHttp() {
       return;
     }
     Sprinkler.stop(rel);
-    json(request, Sprinkler.Timers.toJSON(rel));
+    json(request, [rel](JsonWriter &json) { Sprinkler.Timers.toJSON(json, rel); });
   });
   http.on("/api/zone/{}/pause", ASYNC_HTTP_GET, [&](AsyncWebServerRequest *request) {
     uint8_t rel = request->pathArg(0).toInt();
@@ -106,7 +200,7 @@ void setupHttp() {
       return;
     }
     Sprinkler.pause(rel);
-    json(request, Sprinkler.Timers.toJSON(rel));
+    json(request, [rel](JsonWriter &json) { Sprinkler.Timers.toJSON(json, rel); });
   });
   http.on("/api/zone/{}/resume", ASYNC_HTTP_GET, [&](AsyncWebServerRequest *request) {
     uint8_t rel = request->pathArg(0).toInt();
@@ -115,7 +209,7 @@ void setupHttp() {
       return;
     }
     Sprinkler.resume(rel);
-    json(request, Sprinkler.Timers.toJSON(rel));
+    json(request, [rel](JsonWriter &json) { Sprinkler.Timers.toJSON(json, rel); });
   });
 
   http.on("/api/relay/{}/{}", ASYNC_HTTP_GET, [&](AsyncWebServerRequest *request) {
@@ -130,8 +224,8 @@ void setupHttp() {
       Sprinkler.Device.turnOff(rel);
     }
 
-    console.println((String) "rel:" + rel + " value:" + val);
-    json(request, (String) "{\"rel\":" + rel + ", \"value\":" + val + "}");
+    console.info("rel:%u value:%u", rel, val);
+    json(request, [rel, val](JsonWriter &json) { json.beginObject().member("rel", rel).member("value", val).endObject(); });
   });
 
   http.on("/api/pin/{}/{}", ASYNC_HTTP_GET, [&](AsyncWebServerRequest *request) {
@@ -152,24 +246,52 @@ void setupHttp() {
       val = LOW;
     }
 
-    console.println((String) "pin:" + pin + " value:" + val);
-    json(request, (String) "{\"pin\":" + pin + ", \"value\":" + val + "}");
+    console.info("pin:%u value:%u", pin, val);
+    json(request, [pin, val](JsonWriter &json) { json.beginObject().member("pin", pin).member("value", val).endObject(); });
   });
 
   http.on("/api/schedule", ASYNC_HTTP_GET, [&](AsyncWebServerRequest *request) {
-    json(request, (String) "{ \"state\": \"" + String(Sprinkler.isEnabled() ? "enabled" : "disabled") + "\" }");
+    json(request, [](JsonWriter &json) {
+      json.beginObject().member("state", Sprinkler.isEnabled() ? "enabled" : "disabled").key("timetable");
+      Sprinkler.Settings.timetable().toJSON(json);
+      json.endObject();
+    });
   });
 
   http.on("/api/schedule/{}", ASYNC_HTTP_POST, [&](AsyncWebServerRequest *request) {
     String command = request->pathArg(0);
-    console.println("POST: /api/schedule/" + command);
+    console.info("POST: /api/schedule/%s", command);
     if (command == "enable") {
       Sprinkler.enable();
     }
     else {
       Sprinkler.disable();
     }
-    json(request, (String) "{ \"state\": \"" + String(Sprinkler.isEnabled() ? "enabled" : "disabled") + "\" }");
+    json(request, [](JsonWriter &json) { json.beginObject().member("state", Sprinkler.isEnabled() ? "enabled" : "disabled").endObject(); });
+  });
+  
+  http.on("/api/sequence", ASYNC_HTTP_GET, [&](AsyncWebServerRequest *request) {
+    json(request, [](JsonWriter &json) { Sprinkler.Timers.Sequence.toJSON(json); });
+  });
+
+  http.on("/api/sequence/{}", ASYNC_HTTP_POST, [&](AsyncWebServerRequest *request) {
+    String command = request->pathArg(0);
+    console.info("POST: /api/sequence/%s", command);
+    if (command == "start") {
+      Sprinkler.startSequence();
+    } else if (command == "pause") {
+      Sprinkler.pauseSequence();
+    } else if (command == "resume") {
+      Sprinkler.resumeSequence();
+    } else if (command == "skip") {
+      Sprinkler.skipSequence();
+    } else if (command == "stop") {
+      Sprinkler.stopSequence();
+    } else {
+      request->send(400, "application/json", "{\"error\":\"Invalid command\"}");
+      return;
+    }
+    json(request, [](JsonWriter &json) { Sprinkler.Timers.Sequence.toJSON(json); });
   });
   
   http.on("/api/use/{}/water", ASYNC_HTTP_POST, [&](AsyncWebServerRequest *request) {
@@ -184,31 +306,59 @@ void setupHttp() {
   });
 
   http.on("/api/settings/general", ASYNC_HTTP_GET, [&](AsyncWebServerRequest *request) {
-    json(request, (String) "{ \"name\": \"" + Sprinkler.dispname() + "\", \"host\": \"" + Sprinkler.hostname() + "\" }");
+    json(request, [](JsonWriter &json) { json.beginObject().member("name", Sprinkler.dispname()).member("host", Sprinkler.hostname()).endObject(); });
   });
   http.on("/api/settings/zones", ASYNC_HTTP_GET, [&](AsyncWebServerRequest *request) {
-    json(request, Sprinkler.Settings.toJSON());
+    json(request, zonesCache, Sprinkler.Settings.revision(), [](JsonWriter &json) { Sprinkler.Settings.toJSON(json); });
   });
   http.on("/api/settings", ASYNC_HTTP_GET, [&](AsyncWebServerRequest *request) {
-    json(request, Sprinkler.toJSON());
+    json(request, settingsCache, Sprinkler.revision(), [](JsonWriter &json) { Sprinkler.toJSON(json); });
   });
 
-  http.addHandler(new AsyncCallbackJsonWebHandler(
+  AsyncCallbackJsonWebHandler *settingsPatch = new AsyncCallbackJsonWebHandler(
       "/api/settings", [&](AsyncWebServerRequest *request, JsonVariant &jsonDoc) {
         JsonObject jsonObj = jsonDoc.as<JsonObject>();
-        console.println("POST: /api/settings");
-        if (!Sprinkler.fromJSON(jsonObj)) {
+        console.info("PATCH: /api/settings");
+        unsigned int changed = Sprinkler.patch(jsonObj);
+        json(request, [changed](JsonWriter &json) {
+          json.beginObject().member("changed", changed).member("revision", Sprinkler.revision()).endObject();
+        });
+      },
+      4096);
+  settingsPatch->setMethod(ASYNC_HTTP_PATCH);
+  http.addHandler(settingsPatch);
+
+  // parsed chunk by chunk, the body size is not limited by a buffer
+  http.on(
+      "/api/settings", ASYNC_HTTP_POST | ASYNC_HTTP_PUT,
+      [&](AsyncWebServerRequest *request) {
+        console.info("POST: /api/settings");
+        if (!settingsParser.finish(request)) {
+          error(request, String("Invalid settings: ") + settingsParser.error(request));
+        } else if (!Sprinkler.fromJSON(settingsParser)) {
           error(request, "Failed to save settings");
         } else {
-          json(request, Sprinkler.toJSON());
+          json(request, settingsCache, Sprinkler.revision(), [](JsonWriter &json) { Sprinkler.toJSON(json); });
         }
+        settingsParser.release(request);
       },
-      4096));
+      nullptr,
+      [&](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+        if (index == 0) {
+          settingsParser.begin(request);
+        }
+        settingsParser.feed(request, data, len);
+      });
 
+  // ?since=<seq>&limit=<n>; the array is streamed a line at a time so the
+  // whole log is never copied
   http.on("/esp/log", ASYNC_HTTP_GET, [&](AsyncWebServerRequest *request) {
-    StreamString jStream;
-    Console.printTo(jStream);
-    json(request, jStream);
+    uint32_t since = request->hasArg("since") ? request->arg("since").toInt() : 0;
+    uint32_t limit = request->hasArg("limit") ? request->arg("limit").toInt() : UINT32_MAX;
+    auto cursor = std::make_shared<LogCursor>(since, limit);
+    request->send(request->beginChunkedResponse("application/json", [cursor](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+      return cursor->read(buffer, maxLen);
+    }));
   });
 
   http.on("/esp/log/clear", ASYNC_HTTP_POST, [&](AsyncWebServerRequest *request) {
@@ -227,7 +377,45 @@ void setupHttp() {
 
   http.on("/esp/time", ASYNC_HTTP_GET, [&](AsyncWebServerRequest *request) {
     time_t t = now();
-    json(request, (String) "{ \"d\": \"" + (String)day(t) + " " + (String)monthShortStr(month(t)) + " " + (String)year(t) + "\", \"h\": \"" + hour(t) + "\", \"m\": \"" + minute(t) + "\", \"s\": \"" + second(t) + "\" }");
+    char date[16];
+    snprintf(date, sizeof(date), "%d %s %d", day(t), monthShortStr(month(t)), year(t));
+    char h[4], m[4], s[4];
+    snprintf(h, sizeof(h), "%d", hour(t));
+    snprintf(m, sizeof(m), "%d", minute(t));
+    snprintf(s, sizeof(s), "%d", second(t));
+    json(request, [&](JsonWriter &json) { json.beginObject().member("d", date).member("h", h).member("m", m).member("s", s).endObject(); });
+  });
+
+  http.on("/esp/loop", ASYNC_HTTP_GET, [&](AsyncWebServerRequest *request) {
+    json(request, [](JsonWriter &json) { Loop.toJSON(json); });
+  });
+
+  http.on("/esp/relays", ASYNC_HTTP_GET, [&](AsyncWebServerRequest *request) {
+    json(request, [](JsonWriter &json) { Sprinkler.Device.relaysJSON(json); });
+  });
+
+  http.on("/esp/sockets", ASYNC_HTTP_GET, [&](AsyncWebServerRequest *request) {
+    json(request, [](JsonWriter &json) { Broadcaster.toJSON(json); });
+  });
+
+  http.on("/esp/persist", ASYNC_HTTP_GET, [&](AsyncWebServerRequest *request) {
+    json(request, [](JsonWriter &json) { Persist.toJSON(json); });
+  });
+
+  http.on("/esp/store", ASYNC_HTTP_GET, [&](AsyncWebServerRequest *request) {
+    json(request, [](JsonWriter &json) { Store.toJSON(json); });
+  });
+
+  http.on("/esp/cache", ASYNC_HTTP_GET, [&](AsyncWebServerRequest *request) {
+    json(request, [](JsonWriter &json) {
+      json.beginObject().key("settings");
+      settingsCache.toJSON(json);
+      json.key("zones");
+      zonesCache.toJSON(json);
+      json.key("state");
+      stateCache.toJSON(json);
+      json.endObject();
+    });
   });
 
   http.on("/esp/restart", ASYNC_HTTP_POST, [&](AsyncWebServerRequest *request) {
@@ -255,7 +443,7 @@ void setupHttp() {
     }
 
     // Not an Alexa request - handle as 404
-    console.println("(404): " + request->url());
+    console.info("(404): %s", request->url());
     if (!captivePortal(request)) {
       AsyncResponseStream *response = request->beginResponseStream("text/html");
       response->print("<!DOCTYPE html><html><head><title>URI Not Found</title></head><body>");
@@ -274,9 +462,11 @@ void setupHttp() {
       case WS_EVT_CONNECT:
         console.printf("[%u] Connected from %d.%d.%d.%d url: %s\n", id, ip[0], ip[1], ip[2], ip[3], url.c_str());
         server->text(id, "{\"connection\": \"Connected\"}");
+        Broadcaster.connect(id);
         Console.attach(&ws);
         break;
       case WS_EVT_DISCONNECT:
+        Broadcaster.disconnect(id);
         console.printf("[%u] Disconnected!\n", id);
         break;
       case WS_EVT_PONG:
@@ -311,4 +501,21 @@ void setupHttp() {
   }
 }
 
+// Serial and WebSocket output of the lines logged since the last pass
+void handleConsole() {
+  WsConsole::stream();
+}
+
+unsigned long consoleDeadline() {
+  return WsConsole::deadline();
+}
+
+void handleSockets() {
+  Broadcaster.flush();
+}
+
+unsigned long socketsDeadline() {
+  return Broadcaster.deadline();
+}
+
 #endif
\ No newline at end of file
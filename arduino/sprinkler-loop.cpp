@@ -0,0 +1,53 @@
+#include "sprinkler-loop.h"
+
+void SprinklerLoop::begin() {
+  task = xTaskGetCurrentTaskHandle();
+  windowStart = millis();
+}
+
+void SprinklerLoop::wake() {
+  if (task) {
+    xTaskNotifyGive(task);
+  }
+}
+
+void IRAM_ATTR SprinklerLoop::wakeFromISR() {
+  if (task) {
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(task, &woken);
+    if (woken) {
+      portYIELD_FROM_ISR();
+    }
+  }
+}
+
+void SprinklerLoop::sleep(std::initializer_list<unsigned long> deadlines) {
+  unsigned long ms = LOOP_MAX_SLEEP;
+  for (unsigned long deadline : deadlines) {
+    if (deadline < ms) {
+      ms = deadline;
+    }
+  }
+
+  if (ms > 0) {
+    unsigned long start = micros();
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(ms) ? pdMS_TO_TICKS(ms) : 1);
+    windowSleptUs += micros() - start;
+    windowWakeups++;
+  }
+
+  unsigned long elapsed = millis() - windowStart;
+  if (elapsed >= LOOP_STATS_WINDOW) {
+    idle = windowSleptUs / (elapsed * 10.0f);
+    wakeups = windowWakeups * 1000.0f / elapsed;
+    windowStart += elapsed;
+    windowSleptUs = 0;
+    windowWakeups = 0;
+  }
+}
+
+void SprinklerLoop::toJSON(JsonWriter &json) {
+  json.beginObject().member("idle", idle, 1).member("wakeups", wakeups, 2).endObject();
+}
+
+SprinklerLoop Loop;
@@ -0,0 +1,45 @@
+#ifndef SPRINKLER_LOOP_H
+#define SPRINKLER_LOOP_H
+
+#include <Arduino.h>
+#include <limits.h>
+
+#include <initializer_list>
+
+#include "includes/JsonWriter.h"
+
+#define LOOP_IDLE ULONG_MAX     // deadline source has nothing pending
+#define LOOP_MAX_SLEEP 1000     // ms, upper bound for one sleep
+#define LOOP_STATS_WINDOW 10000 // ms, idle/wakeup statistics window
+
+// Deadline-aware driver for the Arduino loop task: sleeps on a task notification
+// until the nearest deadline reported by the handlers, or until another task calls wake().
+class SprinklerLoop {
+ public:
+  void begin();
+
+  // block until the earliest of the given deadlines (ms from now) or a wake()
+  void sleep(std::initializer_list<unsigned long> deadlines);
+
+  void wake();
+  void IRAM_ATTR wakeFromISR();
+
+  float idlePercent() const { return idle; }
+  float wakeupsPerSecond() const { return wakeups; }
+
+  void toJSON(JsonWriter &json);
+
+ private:
+  TaskHandle_t task = nullptr;
+
+  unsigned long windowStart = 0;
+  unsigned long windowSleptUs = 0;
+  uint32_t windowWakeups = 0;
+
+  float idle = 0;
+  float wakeups = 0;
+};
+
+extern SprinklerLoop Loop;
+
+#endif
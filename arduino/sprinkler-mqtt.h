@@ -2,10 +2,15 @@
 #define SPRINKLER_MQTT_H
 
 #include <WiFi.h>
+#include <lwip/sockets.h>
 #define MQTT_MAX_PACKET_SIZE 1024
 #include <PubSubClient.h>
 #include <WsConsole.h>
 #include "sprinkler.h"
+#include "sprinkler-loop.h"
+
+#define MQTT_RECONNECT_INTERVAL 5000
+#define MQTT_WATCH_STACK_SIZE 2048
 
 static WsConsole mqtt_console("mqtt");
 
@@ -18,6 +23,33 @@ static unsigned long lastReconnectAttempt = 0;
 static bool mqttFirstAttempt = true;
 static bool mqttDiscoveryPublished = false;
 
+// Incoming publishes arrive on the socket without waking the loop: a watcher
+// task blocks in select() on it, wakes the loop once bytes are readable and
+// waits for handleMqtt() to read them before it watches again.
+static TaskHandle_t mqttWatcher = nullptr;
+static volatile int mqttSocket = -1;
+
+static void mqttWatch(void *) {
+  for (;;) {
+    int fd = mqttSocket;
+    if (fd < 0) {
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);  // until connected
+      continue;
+    }
+
+    fd_set readable;
+    FD_ZERO(&readable);
+    FD_SET(fd, &readable);
+    struct timeval timeout = {1, 0};  // picks up a reconnected socket
+    ulTaskNotifyTake(pdTRUE, 0);      // drop the reads that came before
+    if (select(fd + 1, &readable, nullptr, nullptr, &timeout) != 0) {
+      // readable, or the socket failed and handleMqtt() has to notice
+      Loop.wake();
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+  }
+}
+
 // Topic prefix based on hostname
 static String mqttTopicPrefix;
 
@@ -107,6 +139,8 @@ void setupMqtt() {
   // Set topic prefix based on hostname
   mqttTopicPrefix = "sprinkler/" + Sprinkler.Device.hostname();
 
+  xTaskCreate(mqttWatch, "mqtt", MQTT_WATCH_STACK_SIZE, nullptr, 1, &mqttWatcher);
+
   // Subscribe to state events to publish changes
   Sprinkler.on("state", [](const char *event) {
     if (mqttClient.connected()) {
@@ -134,16 +168,42 @@ void handleMqtt() {
   if (!mqttClient.connected()) {
     unsigned long now = millis();
     // Try immediately on first attempt, then every 5 seconds
-    if (mqttFirstAttempt || (now - lastReconnectAttempt > 5000)) {
+    if (mqttFirstAttempt || (now - lastReconnectAttempt > MQTT_RECONNECT_INTERVAL)) {
       mqttFirstAttempt = false;
       lastReconnectAttempt = now;
       mqttConnect();
     }
   } else {
-    mqttClient.loop();
+    // loop() reads one packet; WiFiClient may already hold the next ones,
+    // which select() does not see
+    do {
+      mqttClient.loop();
+    } while (mqttClient.connected() && mqttWiFiClient.available());
+  }
+
+  mqttSocket = mqttClient.connected() ? mqttWiFiClient.fd() : -1;
+  if (mqttWatcher) {
+    xTaskNotifyGive(mqttWatcher);  // read, watch the socket again
   }
 }
 
+unsigned long mqttDeadline() {
+  if (!Sprinkler.Device.mqttEnabled() || !Sprinkler.connectedWifi) {
+    return LOOP_IDLE;
+  }
+
+  if (!mqttClient.connected()) {
+    if (mqttFirstAttempt) {
+      return 0;
+    }
+    unsigned long elapsed = millis() - lastReconnectAttempt;
+    return elapsed > MQTT_RECONNECT_INTERVAL ? 0 : MQTT_RECONNECT_INTERVAL - elapsed + 1;
+  }
+
+  // incoming publishes wake the loop through mqttWatch()
+  return mqttClient.keepAliveDeadline();
+}
+
 bool mqttConnected() {
   return mqttClient.connected();
 }
@@ -218,7 +278,7 @@ void mqttCallback(char* topic, byte* payload, unsigned int length) {
   String message = String((char*)payload).substring(0, length);
   message.toUpperCase();
 
-  mqtt_console.printf("Received: %s = %s\n", topic, message.c_str());
+  mqtt_console.info("Received: %s = %s", topic, message);
 
   // Parse zone number from topic: .../zone/N/cmd
   int zoneIdx = topicStr.indexOf("/zone/");
@@ -230,10 +290,10 @@ void mqttCallback(char* topic, byte* payload, unsigned int length) {
 
       if (zone >= 1 && zone <= SKETCH_MAX_ZONES) {
         if (message == "ON" && !Sprinkler.Timers.isWatering(zone)) {
-          mqtt_console.printf("Starting zone %d\n", zone);
+          mqtt_console.info("Starting zone %u", zone);
           Sprinkler.start(zone, SKETCH_TIMER_DEFAULT_LIMIT);
         } else if (message == "OFF" && Sprinkler.Timers.isWatering(zone)) {
-          mqtt_console.printf("Stopping zone %d\n", zone);
+          mqtt_console.info("Stopping zone %u", zone);
           Sprinkler.stop(zone);
         }
       }
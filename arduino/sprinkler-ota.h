@@ -5,6 +5,9 @@
 #include <functional>
 
 #include "sprinkler.h"
+#include "sprinkler-loop.h"
+
+#define OTA_POLL_INTERVAL 250
 
 
 void setupOTA() {
@@ -46,3 +49,8 @@ void setupOTA() {
 void handleOTA() {
   ArduinoOTA.handle();
 }
+
+unsigned long otaDeadline() {
+  // invitations arrive on a polled UDP socket
+  return Sprinkler.connectedWifi ? OTA_POLL_INTERVAL : LOOP_IDLE;
+}
@@ -0,0 +1,202 @@
+#include "sprinkler-parser.h"
+
+void SprinklerParser::begin(const void *request) {
+  clear();
+  owner = request;
+}
+
+bool SprinklerParser::feed(const void *request, const uint8_t *data, size_t length) {
+  if (request != owner) {
+    return false;  // a newer body took over the parser
+  }
+  return reader.feed(data, length);
+}
+
+bool SprinklerParser::finish(const void *request) {
+  if (request != owner) {
+    return false;
+  }
+  return reader.finish();
+}
+
+const char *SprinklerParser::error(const void *request) const {
+  return request == owner ? reader.error() : "no body";
+}
+
+void SprinklerParser::release(const void *request) {
+  if (request == owner) {
+    clear();
+  }
+}
+
+void SprinklerParser::clear() {
+  for (const auto &kv : staged) {
+    delete kv.second;
+  }
+  staged.clear();
+  doc.clear();
+  reader.reset();
+
+  owner = nullptr;
+  depth = 0;
+  zonesGiven = false;
+  inZones = false;
+  inDays = false;
+  zone = nullptr;
+  day = nullptr;
+  timer = nullptr;
+}
+
+void SprinklerParser::beginObject(const char *key) {
+  open(key, true);
+}
+
+void SprinklerParser::endObject() {
+  close();
+}
+
+void SprinklerParser::beginArray(const char *key) {
+  open(key, false);
+}
+
+void SprinklerParser::endArray() {
+  close();
+}
+
+void SprinklerParser::open(const char *key, bool object) {
+  depth++;
+  if (depth == Root) {
+    if (!object) {
+      reader.fail("expected an object");
+      return;
+    }
+    nodes[0] = doc.to<JsonObject>();
+    return;
+  }
+
+  if (depth == Zones && object && strcmp(key, "zones") == 0) {
+    inZones = true;
+    zonesGiven = true;
+    return;
+  }
+
+  if (inZones) {
+    if (depth == Zone && object) {
+      unsigned int zoneid = atoi(key);
+      if (zoneid < 1 || zoneid > SKETCH_MAX_ZONES) {
+        return;  // skipped with everything in it
+      }
+      zone = new SprinklerZone(zoneid);
+      if (zone == nullptr) {
+        reader.fail("out of memory");
+        return;
+      }
+      auto it = staged.find(zoneid);
+      if (it != staged.end()) {
+        delete it->second;
+      }
+      staged[zoneid] = zone;
+    } else if (depth == Days && zone && object && strcmp(key, "days") == 0) {
+      inDays = true;
+    } else if (depth == Day && inDays && !object) {
+      day = zone->day(key);
+    } else if (depth == Timer && day && object) {
+      if (day->size() >= PARSER_MAX_TIMERS) {
+        reader.fail("too many timers");
+        return;
+      }
+      timer = day->add();
+    }
+    return;
+  }
+
+  // device keys keep their structure, e.g. sequence.order[]
+  if (depth > PARSER_MAX_NESTING) {
+    reader.fail("nested too deep");
+    return;
+  }
+
+  // char * makes ArduinoJson copy the key out of the reader's buffer
+  JsonVariant parent = nodes[depth - 2];
+  char *name = const_cast<char *>(key);
+  if (object) {
+    nodes[depth - 1] = name ? parent.createNestedObject(name) : parent.createNestedObject();
+  } else {
+    nodes[depth - 1] = name ? parent.createNestedArray(name) : parent.createNestedArray();
+  }
+
+  if (doc.overflowed()) {
+    reader.fail("settings too large");
+  }
+}
+
+void SprinklerParser::close() {
+  if (inZones) {
+    switch (depth) {
+      case Timer: timer = nullptr; break;
+      case Day: day = nullptr; break;
+      case Days: inDays = false; break;
+      case Zone: zone = nullptr; break;
+      case Zones: inZones = false; break;
+      default: break;
+    }
+  }
+  depth--;
+}
+
+void SprinklerParser::value(const char *key, const char *text, Type type) {
+  if (depth == 0) {
+    reader.fail("expected an object");
+    return;
+  }
+
+  if (depth == Root && strcmp(key, "zones") == 0) {
+    zonesGiven = true;  // "zones": null clears them
+    return;
+  }
+
+  if (inZones) {
+    if (depth == Zone && zone && strcmp(key, "name") == 0) {
+      zone->name(type == Text ? text : "");
+    } else if (depth == Timer && timer) {
+      unsigned int number = atoi(text);
+      if (strcmp(key, "d") == 0) {
+        timer->duration(number);
+      } else if (strcmp(key, "h") == 0) {
+        timer->hours(number);
+      } else if (strcmp(key, "m") == 0) {
+        timer->minutes(number);
+      }
+    }
+    return;
+  }
+
+  JsonVariant parent = nodes[depth - 1];
+  set(key ? parent.getOrAddMember(const_cast<char *>(key)) : parent.addElement(), text, type);
+
+  if (doc.overflowed()) {
+    reader.fail("settings too large");
+  }
+}
+
+void SprinklerParser::set(JsonVariant slot, const char *text, Type type) {
+  switch (type) {
+    case Text:
+      slot.set(const_cast<char *>(text));
+      break;
+    case Number:
+      if (strpbrk(text, ".eE")) {
+        slot.set(atof(text));
+      } else if (text[0] == '-') {
+        slot.set(atol(text));
+      } else {
+        slot.set(strtoul(text, nullptr, 10));
+      }
+      break;
+    case Boolean:
+      slot.set(text[0] == 't');
+      break;
+    case Null:
+      break;  // a new slot is null already
+  }
+}
@@ -0,0 +1,71 @@
+#ifndef SPRINKLER_PARSER_H
+#define SPRINKLER_PARSER_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+#include <map>
+
+#include "includes/JsonReader.h"
+#include "sprinkler-settings.h"
+
+#define PARSER_DEVICE_SIZE 1024  // device, Wi-Fi, MQTT and sequence keys
+#define PARSER_MAX_TIMERS 48     // per zone and day
+#define PARSER_MAX_NESTING 5     // of the device keys, e.g. sequence.order[]
+
+// Streams a POST /api/settings body into the settings model chunk by chunk.
+// Zones, days and timers are built into staged zones as their values arrive;
+// the few device keys are collected into a small fixed document. Nothing
+// touches the live settings until the whole body parsed, then
+// SprinklerControl::fromJSON(parser) swaps the staged zones in.
+class SprinklerParser : public JsonHandler {
+ public:
+  SprinklerParser() : reader(*this) {}
+  ~SprinklerParser() { clear(); }
+
+  // start a body for request, dropping whatever an earlier one left staged
+  void begin(const void *request);
+  bool feed(const void *request, const uint8_t *data, size_t length);
+  // true when request's body was complete and valid
+  bool finish(const void *request);
+  // free the staged zones and the device keys of request's body
+  void release(const void *request);
+
+  const char *error(const void *request) const;
+
+  JsonObject device() { return doc.as<JsonObject>(); }
+  bool hasZones() const { return zonesGiven; }
+  std::map<unsigned int, SprinklerZone *> &zones() { return staged; }
+
+  void beginObject(const char *key) override;
+  void endObject() override;
+  void beginArray(const char *key) override;
+  void endArray() override;
+  void value(const char *key, const char *text, Type type) override;
+
+ private:
+  // zones.<id>.days.<day>[n].<field> nesting levels
+  enum Level { Root = 1, Zones, Zone, Days, Day, Timer };
+
+  void clear();
+  void open(const char *key, bool object);
+  void close();
+  void set(JsonVariant slot, const char *text, Type type);
+
+  JsonReader reader;
+  const void *owner = nullptr;
+
+  StaticJsonDocument<PARSER_DEVICE_SIZE> doc;
+  JsonVariant nodes[PARSER_MAX_NESTING];
+
+  std::map<unsigned int, SprinklerZone *> staged;
+  uint8_t depth = 0;
+  bool zonesGiven = false;
+  bool inZones = false;
+  bool inDays = false;
+  SprinklerZone *zone = nullptr;
+  ScheduleDay *day = nullptr;
+  SprinklerTimer *timer = nullptr;
+};
+
+#endif
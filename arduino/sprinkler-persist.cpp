@@ -0,0 +1,130 @@
+#include <EEPROM.h>
+#include <WsConsole.h>
+
+#include "sprinkler-device.h"
+#include "sprinkler-persist.h"
+#include "sprinkler-store.h"
+
+WsConsole persistLog("save");
+
+void SprinklerPersist::begin() {
+  if (task) {
+    return;
+  }
+
+  stageLock = xSemaphoreCreateMutexStatic(&stageLockBuffer);
+  commitLock = xSemaphoreCreateMutexStatic(&commitLockBuffer);
+  xTaskCreate(run, "persist", PERSIST_STACK_SIZE, this, 1, &task);
+
+  if (pending) {
+    xTaskNotifyGive(task);  // staged before the worker was started
+  }
+}
+
+void SprinklerPersist::stage(const SprinklerConfig &cfg) {
+  if (stageLock) {
+    xSemaphoreTake(stageLock, portMAX_DELAY);
+  }
+  memcpy((void *)&staged, (const void *)&cfg, sizeof(SprinklerConfig));
+  pending = true;
+  stagedCount++;
+  if (stageLock) {
+    xSemaphoreGive(stageLock);
+  }
+
+  if (task) {
+    xTaskNotifyGive(task);
+  }
+}
+
+void SprinklerPersist::flush() {
+  if (!commitLock) {
+    begin();
+  }
+  commit();
+}
+
+void SprinklerPersist::run(void *arg) {
+  SprinklerPersist *persist = (SprinklerPersist *)arg;
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    // wait for the burst to settle
+    while (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(PERSIST_DEBOUNCE))) {
+    }
+    persist->commit();
+  }
+}
+
+void SprinklerPersist::commit() {
+  static SprinklerConfig snapshot;
+
+  xSemaphoreTake(commitLock, portMAX_DELAY);
+
+  xSemaphoreTake(stageLock, portMAX_DELAY);
+  bool dirty = pending;
+  if (dirty) {
+    memcpy((void *)&snapshot, (const void *)&staged, sizeof(SprinklerConfig));
+    pending = false;
+  }
+  xSemaphoreGive(stageLock);
+
+  if (dirty) {
+    // the store appends the sections that changed, the EEPROM copies the bytes
+    unsigned long start = millis();
+    size_t written = Store.isReady() ? Store.write(snapshot) : writeEEPROM(snapshot);
+    committed(written, start);
+  }
+
+  xSemaphoreGive(commitLock);
+}
+
+// copy changed spans only, leave the flash alone when nothing differs
+size_t SprinklerPersist::writeEEPROM(const SprinklerConfig &cfg) {
+  static uint8_t image[sizeof(SprinklerConfigHeader) + sizeof(SprinklerConfig)];
+
+  configWrite(image, sizeof(image), cfg);
+  if (!EEPROM.length()) {
+    EEPROM.begin(EEPROM_SIZE);
+  }
+
+  const uint8_t *stored = EEPROM.getConstDataPtr();
+  size_t changed = 0;
+  for (size_t i = 0; i < sizeof(image); i++) {
+    if (stored[i] != image[i]) {
+      changed++;
+    }
+  }
+
+  if (changed) {
+    memcpy(EEPROM.getDataPtr(), image, sizeof(image));
+    EEPROM.commit();
+  }
+  return changed;
+}
+
+void SprinklerPersist::committed(size_t written, unsigned long start) {
+  if (!written) {
+    skipped++;
+    return;
+  }
+
+  commits++;
+  bytes += written;
+  lastMs = millis() - start;
+  maxMs = lastMs > maxMs ? lastMs : maxMs;
+  persistLog.println("Saved " + String(written) + " bytes in " + String(lastMs) + " ms.");
+}
+
+void SprinklerPersist::toJSON(JsonWriter &json) {
+  json.beginObject()
+      .member("pending", (bool)pending)
+      .member("staged", stagedCount)
+      .member("commits", commits)
+      .member("skipped", skipped)
+      .member("bytes", bytes)
+      .member("lastMs", lastMs)
+      .member("maxMs", maxMs)
+      .endObject();
+}
+
+SprinklerPersist Persist;
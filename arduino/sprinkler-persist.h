@@ -0,0 +1,57 @@
+#ifndef SPRINKLER_PERSIST_H
+#define SPRINKLER_PERSIST_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+#include "includes/JsonWriter.h"
+#include "sprinkler-config.h"
+
+#define PERSIST_DEBOUNCE 500     // ms without a new change before committing
+#define PERSIST_STACK_SIZE 4096
+
+// Write-behind config persistence. Callers stage a snapshot and return at once;
+// a worker task coalesces bursts of changes, compares the image against flash
+// and commits only when bytes actually changed.
+class SprinklerPersist {
+ public:
+  void begin();
+
+  // replace the pending snapshot and restart the debounce window
+  void stage(const SprinklerConfig &cfg);
+
+  // commit a pending snapshot on the calling task, e.g. before a restart
+  void flush();
+
+  bool isPending() const { return pending; }
+
+  void toJSON(JsonWriter &json);
+
+ private:
+  static void run(void *arg);
+  void commit();
+  size_t writeEEPROM(const SprinklerConfig &cfg);
+  void committed(size_t written, unsigned long start);
+
+  SprinklerConfig staged;
+  volatile bool pending = false;
+
+  TaskHandle_t task = nullptr;
+  SemaphoreHandle_t stageLock = nullptr;
+  SemaphoreHandle_t commitLock = nullptr;
+  StaticSemaphore_t stageLockBuffer;
+  StaticSemaphore_t commitLockBuffer;
+
+  uint32_t stagedCount = 0;
+  uint32_t commits = 0;
+  uint32_t skipped = 0;
+  uint32_t bytes = 0;
+  uint32_t lastMs = 0;
+  uint32_t maxMs = 0;
+};
+
+extern SprinklerPersist Persist;
+
+#endif
@@ -0,0 +1,111 @@
+#include <esp_attr.h>
+#include <esp_timer.h>
+#include <rom/crc.h>
+
+#include "sprinkler-loop.h"
+#include "sprinkler-recovery.h"
+#include "sprinkler-state.h"
+
+RTC_NOINIT_ATTR static SprinklerRunRecord runRecord;
+
+void SprinklerRunRecord::clear() {
+  memset(this, 0, sizeof(*this));
+  sequence = RECOVERY_NO_SEQUENCE;
+  seal();
+}
+
+void SprinklerRunRecord::seal() {
+  magic = RECOVERY_MAGIC;
+  crc = checksum();
+}
+
+bool SprinklerRunRecord::isValid() const {
+  return magic == RECOVERY_MAGIC && crc == checksum();
+}
+
+unsigned int SprinklerRunRecord::elapsed(unsigned int zone) const {
+  if (zone < 1 || zone > SKETCH_MAX_ZONES) {
+    return 0;
+  }
+
+  unsigned int total = duration[zone - 1] * 60;
+  return remaining[zone - 1] < total ? total - remaining[zone - 1] : 0;
+}
+
+uint32_t SprinklerRunRecord::checksum() const {
+  return crc32_le(0, (const uint8_t *)this, offsetof(SprinklerRunRecord, crc));
+}
+
+RecoveryAction SprinklerRecovery::decide(const SprinklerRunRecord &record, esp_reset_reason_t reason) {
+  if (!record.isValid() || record.isIdle()) {
+    return RecoveryNone;
+  }
+
+  switch (reason) {
+    case ESP_RST_BROWNOUT:
+    case ESP_RST_PANIC:
+    case ESP_RST_INT_WDT:
+    case ESP_RST_TASK_WDT:
+    case ESP_RST_WDT:
+      // a pump that browns the unit out on every start must not boot-loop it
+      return record.resumes < RECOVERY_MAX_RESUMES ? RecoveryResume : RecoveryAbort;
+    default:
+      // power-on, restart requested by the user or OTA
+      return RecoveryAbort;
+  }
+}
+
+void SprinklerRecovery::begin() {
+  previous = runRecord;
+  resetReason = esp_reset_reason();
+  decision = decide(previous, resetReason);
+}
+
+void SprinklerRecovery::resumed(bool resumed) {
+  resumes = resumed ? previous.resumes + 1 : 0;
+}
+
+void SprinklerRecovery::save(SprinklerRunRecord &record) {
+  if (record.isIdle()) {
+    resumes = 0;  // the run finished, the next one starts with a clean slate
+  }
+  record.resumes = resumes;
+  record.seal();
+  runRecord = record;
+
+  running = (record.watering & ~record.paused) != 0;
+  saved = esp_timer_get_time();
+}
+
+void SprinklerRecovery::save(SprinklerState &timers) {
+  SprinklerRunRecord record;
+  record.clear();
+
+  for (unsigned int zone = 1; zone <= SKETCH_MAX_ZONES; zone++) {
+    if (timers.isActive(zone)) {
+      record.watering |= 1UL << (zone - 1);
+      if (timers.isPaused(zone)) {
+        record.paused |= 1UL << (zone - 1);
+      }
+      record.duration[zone - 1] = timers.duration(zone);
+      record.remaining[zone - 1] = timers.remaining(zone);
+    }
+  }
+
+  if (timers.Sequence.active) {
+    record.sequence = timers.Sequence.currentZoneIndex;
+  }
+
+  save(record);
+}
+
+unsigned long SprinklerRecovery::deadline() const {
+  if (!running) {
+    return LOOP_IDLE;  // paused zones keep their remaining time
+  }
+
+  int64_t elapsed = (esp_timer_get_time() - saved) / 1000;
+  return elapsed < RECOVERY_REFRESH ? RECOVERY_REFRESH - elapsed : 0;
+}
+
+SprinklerRecovery Recovery;
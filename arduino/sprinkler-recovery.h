@@ -0,0 +1,80 @@
+#ifndef SPRINKLER_RECOVERY_H
+#define SPRINKLER_RECOVERY_H
+
+#include <Arduino.h>
+#include <esp_system.h>
+
+#include "html/settings.json.h"
+
+#define RECOVERY_MAGIC 0x334E5552   // "RUN3"
+#define RECOVERY_MAX_RESUMES 3      // consecutive resumes of one run before it is given up
+#define RECOVERY_NO_SEQUENCE 0xFF
+#define RECOVERY_REFRESH 60000      // ms, how often remaining times are re-saved while zones water
+
+class SprinklerState;
+
+// Compact in-flight watering record kept in RTC slow memory. It survives panic,
+// watchdog and most brownout resets and is validated by CRC, so it can be
+// acted upon before EEPROM settings or NTP time are available.
+struct SprinklerRunRecord {
+  uint32_t magic;
+  uint32_t watering;                     // zone bitmask, bit 0 = zone 1
+  uint32_t paused;                       // subset of watering
+  uint8_t sequence;                      // sequence zone index, RECOVERY_NO_SEQUENCE when idle
+  uint8_t resumes;                       // boots that already resumed this run
+  uint16_t duration[SKETCH_MAX_ZONES];   // minutes, up to TIMER_MAX_DURATION
+  uint16_t remaining[SKETCH_MAX_ZONES];  // seconds, 65535 covers TIMER_MAX_DURATION minutes
+  uint32_t crc;
+
+  void clear();
+  void seal();
+  bool isValid() const;
+  bool isIdle() const { return !watering && sequence == RECOVERY_NO_SEQUENCE; }
+
+  // seconds of the zone's run watered before the record was saved
+  unsigned int elapsed(unsigned int zone) const;
+
+ private:
+  uint32_t checksum() const;
+};
+
+static_assert(SKETCH_MAX_ZONES <= 32, "zone bitmask is 32 bits wide");
+
+enum RecoveryAction {
+  RecoveryNone,    // nothing was running
+  RecoveryResume,  // unexpected reset, pick the run back up
+  RecoveryAbort    // intentional reset, corrupt record or resume loop
+};
+
+class SprinklerRecovery {
+ public:
+  // snapshot the record left by the previous boot and decide what to do with it
+  void begin();
+
+  RecoveryAction action() const { return decision; }
+  const SprinklerRunRecord &record() const { return previous; }
+  esp_reset_reason_t reason() const { return resetReason; }
+
+  // count the boot against the run it picked back up
+  void resumed(bool resumed);
+  void save(SprinklerRunRecord &record);
+  // record the zones and sequence position of timers
+  void save(SprinklerState &timers);
+
+  // ms until the remaining times saved are a refresh old, LOOP_IDLE while no zone waters
+  unsigned long deadline() const;
+
+  static RecoveryAction decide(const SprinklerRunRecord &record, esp_reset_reason_t reason);
+
+ private:
+  SprinklerRunRecord previous;
+  esp_reset_reason_t resetReason = ESP_RST_UNKNOWN;
+  RecoveryAction decision = RecoveryNone;
+  uint8_t resumes = 0;
+  bool running = false;  // the last record saved had a zone watering
+  int64_t saved = 0;     // esp_timer time (us) of the last save
+};
+
+extern SprinklerRecovery Recovery;
+
+#endif
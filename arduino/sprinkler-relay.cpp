@@ -0,0 +1,231 @@
+#include "sprinkler-relay.h"
+#include "sprinkler-loop.h"
+
+#if RELAY_DRIVER == RELAY_DRIVER_GPIO
+#include <soc/gpio_struct.h>
+#elif RELAY_DRIVER == RELAY_DRIVER_74HC595
+#include <SPI.h>
+#elif RELAY_DRIVER == RELAY_DRIVER_MCP23017
+#include <Wire.h>
+#endif
+
+#define RELAY_CHIPS(zonesPerChip) ((SKETCH_MAX_ZONES + (zonesPerChip) - 1) / (zonesPerChip))
+
+#if RELAY_DRIVER == RELAY_DRIVER_GPIO
+
+static_assert(SKETCH_MAX_ZONES <= RELAY_GPIO_PINS, "the GPIO pinout has six zone relays, use an expander driver");
+
+const uint8_t GpioRelayDriver::pins[RELAY_GPIO_PINS] = {RL1_PIN, RL2_PIN, RL3_PIN, RL4_PIN, RL5_PIN, RL6_PIN};
+
+void GpioRelayDriver::begin() {
+  for (uint8_t i = 0; i < zones; i++) {
+    pinMode(pins[i], OUTPUT);
+  }
+  write(0);
+}
+
+void GpioRelayDriver::write(ZoneMask state) {
+  uint32_t high = 0, high1 = 0, low = 0, low1 = 0;
+  for (uint8_t i = 0; i < zones; i++) {
+    uint8_t pin = pins[i];
+    bool level = bitRead(state, i) ? !RELAY_ACTIVE_LOW : RELAY_ACTIVE_LOW;
+    if (pin < 32) {
+      (level ? high : low) |= 1UL << pin;
+    } else {
+      (level ? high1 : low1) |= 1UL << (pin - 32);
+    }
+  }
+
+  // one set and one clear per register bank
+  if (low) GPIO.out_w1tc = low;
+  if (low1) GPIO.out1_w1tc.val = low1;
+  if (high) GPIO.out_w1ts = high;
+  if (high1) GPIO.out1_w1ts.val = high1;
+}
+
+#elif RELAY_DRIVER == RELAY_DRIVER_74HC595
+
+void ShiftRelayDriver::begin() {
+  pinMode(SR_LATCH_PIN, OUTPUT);
+  digitalWrite(SR_LATCH_PIN, LOW);
+  SPI.begin(SR_CLOCK_PIN, -1, SR_DATA_PIN, -1);
+  write(0);
+}
+
+void ShiftRelayDriver::write(ZoneMask state) {
+  if (RELAY_ACTIVE_LOW) {
+    state = ~state;
+  }
+
+  // the last chip in the chain is shifted first
+  SPI.beginTransaction(SPISettings(1000000, MSBFIRST, SPI_MODE0));
+  for (int chip = RELAY_CHIPS(8) - 1; chip >= 0; chip--) {
+    SPI.transfer((uint8_t)(state >> (chip * 8)));
+  }
+  SPI.endTransaction();
+
+  digitalWrite(SR_LATCH_PIN, HIGH);
+  digitalWrite(SR_LATCH_PIN, LOW);
+}
+
+#elif RELAY_DRIVER == RELAY_DRIVER_MCP23017
+
+#define MCP_IODIRA 0x00
+#define MCP_GPIOA 0x12
+
+void ExpanderRelayDriver::begin() {
+  Wire.begin();
+  write(0);  // latch the idle level before the ports become outputs
+  for (uint8_t chip = 0; chip < RELAY_CHIPS(16); chip++) {
+    Wire.beginTransmission(MCP_ADDRESS + chip);
+    Wire.write(MCP_IODIRA);
+    Wire.write(0x00);
+    Wire.write(0x00);
+    Wire.endTransmission();
+  }
+}
+
+void ExpanderRelayDriver::write(ZoneMask state) {
+  if (RELAY_ACTIVE_LOW) {
+    state = ~state;
+  }
+
+  // GPIOA and GPIOB of each chip in one sequential write
+  for (uint8_t chip = 0; chip < RELAY_CHIPS(16); chip++) {
+    uint16_t port = state >> (chip * 16);
+    Wire.beginTransmission(MCP_ADDRESS + chip);
+    Wire.write(MCP_GPIOA);
+    Wire.write((uint8_t)port);
+    Wire.write((uint8_t)(port >> 8));
+    Wire.endTransmission();
+  }
+}
+
+#endif
+
+bool RelayQueue::push(RelayMask current, RelayMask on, RelayMask off, int64_t t) {
+  portENTER_CRITICAL(&lock);
+  if (count + __builtin_popcountll(on | off) > RELAY_QUEUE_SIZE) {
+    portEXIT_CRITICAL(&lock);
+    return false;
+  }
+
+  // a newer request overrides pending steps for the same relays
+  on &= ~off;
+  RelayMask target = current;
+  for (uint8_t i = 0; i < count; i++) {
+    steps[i].on &= ~off;
+    steps[i].off &= ~on;
+    target = (target | steps[i].on) & ~steps[i].off;
+  }
+
+  RelayMask opening = on & ~target;
+  RelayMask closing = off & target;
+  int64_t queued = t;
+  int64_t at = t;
+
+  if (closing & 1) {
+    append(0, 1, queued, at);  // pump first
+    closing &= ~(RelayMask)1;
+    if (closing) {
+      at += RELAY_PUMP_LAG * 1000LL;
+    }
+  }
+  if (closing) {
+    append(0, closing, queued, at);
+  }
+
+  // valves one at a time, the pump after the last one
+  bool valves = false;
+  for (uint8_t relay = 1; relay < 64; relay++) {
+    RelayMask bit = (RelayMask)1 << relay;
+    if (opening & bit) {
+      int64_t spaced = lastEnergized + RELAY_SWITCH_GAP * 1000LL;
+      at = at > spaced ? at : spaced;
+      append(bit, 0, queued, at);
+      lastEnergized = at;
+      valves = true;
+    }
+  }
+  if (opening & 1) {
+    int64_t spaced = lastEnergized + RELAY_SWITCH_GAP * 1000LL;
+    at = valves ? at + RELAY_PUMP_LEAD * 1000LL : at;
+    at = at > spaced ? at : spaced;
+    append(1, 0, queued, at);
+    lastEnergized = at;
+  }
+  portEXIT_CRITICAL(&lock);
+
+  Loop.wake();
+  return true;
+}
+
+void RelayQueue::append(RelayMask on, RelayMask off, int64_t queued, int64_t due) {
+  steps[count++] = {on, off, queued, due};
+}
+
+void RelayQueue::clear() {
+  portENTER_CRITICAL(&lock);
+  count = 0;
+  portEXIT_CRITICAL(&lock);
+}
+
+bool RelayQueue::pop(RelayTransition &step, int64_t t) {
+  portENTER_CRITICAL(&lock);
+  // drop steps emptied by later requests, find the earliest due one
+  int next = -1;
+  uint8_t kept = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    if (!steps[i].on && !steps[i].off) {
+      continue;
+    }
+    steps[kept] = steps[i];
+    if (next < 0 || steps[kept].due < steps[next].due) {
+      next = kept;
+    }
+    kept++;
+  }
+  count = kept;
+
+  bool due = next >= 0 && steps[next].due <= t;
+  if (due) {
+    step = steps[next];
+    memmove(&steps[next], &steps[next + 1], (count - next - 1) * sizeof(RelayTransition));
+    count--;
+  }
+  portEXIT_CRITICAL(&lock);
+  return due;
+}
+
+unsigned long RelayQueue::deadline(int64_t t) {
+  int64_t next = 0;
+  portENTER_CRITICAL(&lock);
+  for (uint8_t i = 0; i < count; i++) {
+    if ((steps[i].on || steps[i].off) && (!next || steps[i].due < next)) {
+      next = steps[i].due;
+    }
+  }
+  portEXIT_CRITICAL(&lock);
+
+  if (!next) {
+    return LOOP_IDLE;
+  }
+  return next > t ? (next - t + 999) / 1000 : 0;
+}
+
+void RelayQueue::applied(const RelayTransition &step, int64_t at) {
+  lastLatency = at - step.queued;
+  if (lastLatency > maxLatency) {
+    maxLatency = lastLatency;
+  }
+  transitions++;
+}
+
+void RelayQueue::toJSON(JsonWriter &json) {
+  json.beginObject()
+      .member("pending", count)
+      .member("transitions", transitions)
+      .member("lastLatencyMs", (unsigned long)(lastLatency / 1000))
+      .member("maxLatencyMs", (unsigned long)(maxLatency / 1000))
+      .endObject();
+}
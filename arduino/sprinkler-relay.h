@@ -0,0 +1,142 @@
+#ifndef SPRINKLER_RELAY_H
+#define SPRINKLER_RELAY_H
+
+#include <Arduino.h>
+#include <esp_timer.h>
+
+#include "html/settings.json.h"
+#include "includes/JsonWriter.h"
+#include "sprinkler-pinout.h"
+
+#define RELAY_DRIVER_GPIO 0      // one GPIO per zone (RLn_PIN)
+#define RELAY_DRIVER_74HC595 1   // daisy-chained shift registers, 8 zones per chip
+#define RELAY_DRIVER_MCP23017 2  // I2C port expanders, 16 zones per chip
+#define RELAY_DRIVER_MOCK 3      // no hardware, records the written state
+
+#ifndef RELAY_DRIVER
+#define RELAY_DRIVER RELAY_DRIVER_GPIO
+#endif
+
+#ifndef RELAY_ACTIVE_LOW
+#define RELAY_ACTIVE_LOW 1  // relay boards energize on a LOW input
+#endif
+
+// Relay state: bit 0 is the water source, bit n is zone n.
+typedef uint64_t RelayMask;
+
+// Zone relay state as written to a driver: bit 0 is zone 1.
+typedef uint32_t ZoneMask;
+
+static_assert(SKETCH_MAX_ZONES <= 32, "zone relays are a 32-bit mask");
+
+// Each driver writes the complete zone state in a single transaction,
+// so switching latency does not grow with the number of changed zones.
+
+#define RELAY_GPIO_PINS 6  // zone relays of the GPIO pinout, RL1_PIN..RL6_PIN
+
+class GpioRelayDriver {
+ public:
+  void begin();
+  void write(ZoneMask state);
+
+ private:
+  // the first SKETCH_MAX_ZONES pins drive zones, the rest are left alone
+  static const uint8_t zones = SKETCH_MAX_ZONES < RELAY_GPIO_PINS ? SKETCH_MAX_ZONES : RELAY_GPIO_PINS;
+  static const uint8_t pins[RELAY_GPIO_PINS];
+};
+
+#ifndef SR_DATA_PIN
+#define SR_DATA_PIN 23
+#define SR_CLOCK_PIN 18
+#define SR_LATCH_PIN 5
+#endif
+
+class ShiftRelayDriver {
+ public:
+  void begin();
+  void write(ZoneMask state);
+};
+
+#ifndef MCP_ADDRESS
+#define MCP_ADDRESS 0x20  // first expander, the next ones follow on consecutive addresses
+#endif
+
+class ExpanderRelayDriver {
+ public:
+  void begin();
+  void write(ZoneMask state);
+};
+
+class MockRelayDriver {
+ public:
+  void begin() { state = 0; writes = 0; }
+  void write(ZoneMask value) { state = value; writes++; }
+
+  ZoneMask state = 0;
+  uint32_t writes = 0;
+};
+
+#ifndef RELAY_PUMP_LEAD
+#define RELAY_PUMP_LEAD 2000  // ms, valves open before the pump starts
+#endif
+
+#ifndef RELAY_PUMP_LAG
+#define RELAY_PUMP_LAG 1000   // ms, valves close after the pump stopped
+#endif
+
+#ifndef RELAY_SWITCH_GAP
+#define RELAY_SWITCH_GAP 250  // ms, minimum spacing between energizing relays
+#endif
+
+#define RELAY_QUEUE_SIZE 16
+
+struct RelayTransition {
+  RelayMask on;
+  RelayMask off;
+  int64_t queued;  // esp_timer time (us) the change was requested
+  int64_t due;     // esp_timer time (us) the step may be applied
+};
+
+// Staged relay changes. A change is split into timestamped steps so that valves
+// energize one at a time, the pump starts only after its valves are open and
+// stops before they close. Steps are applied by the loop task, nothing blocks.
+class RelayQueue {
+ public:
+  // stage a change at esp_timer time t on top of the current relay state;
+  // false when the queue is full
+  bool push(RelayMask current, RelayMask on, RelayMask off, int64_t t);
+  void clear();
+
+  // take the earliest step that is due
+  bool pop(RelayTransition &step, int64_t t);
+  unsigned long deadline(int64_t t);  // ms until the next step
+
+  void applied(const RelayTransition &step, int64_t at);
+
+  void toJSON(JsonWriter &json);
+
+ private:
+  void append(RelayMask on, RelayMask off, int64_t queued, int64_t due);
+
+  RelayTransition steps[RELAY_QUEUE_SIZE];
+  uint8_t count = 0;
+  int64_t lastEnergized = 0;
+
+  uint32_t transitions = 0;
+  int64_t lastLatency = 0;
+  int64_t maxLatency = 0;
+
+  portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+};
+
+#if RELAY_DRIVER == RELAY_DRIVER_74HC595
+typedef ShiftRelayDriver RelayDriver;
+#elif RELAY_DRIVER == RELAY_DRIVER_MCP23017
+typedef ExpanderRelayDriver RelayDriver;
+#elif RELAY_DRIVER == RELAY_DRIVER_MOCK
+typedef MockRelayDriver RelayDriver;
+#else
+typedef GpioRelayDriver RelayDriver;
+#endif
+
+#endif
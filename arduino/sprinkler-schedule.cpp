@@ -3,76 +3,23 @@
 
 volatile bool alarmServiceLocked = false;
 
-void SprinklerTimer::disable()
-{
-  if (Alarm.isAllocated(AlarmID))
-  {
-    Alarm.free(AlarmID);
-    AlarmID = dtINVALID_ALARM_ID;
-  }
-}
-
-bool SprinklerTimer::enable()
-{
-  disable();
-
-  if (Duration)
-  {
-    AlarmID = (Day == dowInvalid)
-                  ? Alarm.alarmRepeat(hour(Time), minute(Time), 0, OnTick)
-                  : Alarm.alarmRepeat(Day, hour(Time), minute(Time), 0, OnTick);
-  }
-
-  if (!Alarm.isAllocated(AlarmID))
-  {
-    if (Duration)
-    {
-      Console.warn("unit", "#" + (String)Day + ": failed to enable " + (String)hours() + ":" + (String)minutes() + " " + (String)Duration + " timer.");
-    }
-    return false;
-  }
-
-  return true;
-}
-
 void SprinklerTimer::duration(unsigned int value)
 {
-  disable();
-
-  Duration = value;
+  Duration = min(value, (unsigned int)TIMER_MAX_DURATION);
 }
 
 void SprinklerTimer::hours(unsigned int value)
 {
-  disable();
-  tmElements_t te;
-  breakTime(Time ? Time : now(), te);
-  te.Hour = value;
-  if (!Time)
-  {
-    te.Minute = 0;
-  }
-  Time = makeTime(te);
+  Minute = min(value, 23u) * 60 + minutes();
 }
 
 void SprinklerTimer::minutes(unsigned int value)
 {
-  disable();
-
-  tmElements_t te;
-  breakTime(Time ? Time : now(), te);
-  te.Minute = value;
-  if (!Time)
-  {
-    te.Hour = 0;
-  }
-  Time = makeTime(te);
+  Minute = hours() * 60 + min(value, 59u);
 }
 
 void SprinklerTimer::fromJSON(JsonObject json)
 {
-  disable();
-
   if (json.containsKey("d"))
   {
     duration(json["d"].as<String>().toInt());
@@ -89,10 +36,24 @@ void SprinklerTimer::fromJSON(JsonObject json)
   }
 }
 
-void SprinklerTimer::fromConfig(SprinklerTimerConfig &config)
+bool SprinklerTimer::patch(JsonObject json)
 {
-  disable();
+  unsigned int d = json.containsKey("d") ? json["d"].as<String>().toInt() : duration();
+  unsigned int h = json.containsKey("h") ? json["h"].as<String>().toInt() : hours();
+  unsigned int m = json.containsKey("m") ? json["m"].as<String>().toInt() : minutes();
+  if (d == duration() && h == hours() && m == minutes())
+  {
+    return false;
+  }
 
+  duration(d);
+  hours(h);
+  minutes(m);
+  return true;
+}
+
+void SprinklerTimer::fromConfig(SprinklerTimerConfig &config)
+{
   hours(config.h);
 
   minutes(config.m);
@@ -110,16 +71,20 @@ SprinklerTimerConfig SprinklerTimer::toConfig()
   return cfg;
 }
 
-String SprinklerTimer::toJSON()
+void SprinklerTimer::toJSON(JsonWriter &json)
 {
-  return "{ \"d\": " + (String)Duration + ", \"h\": " + (String)hour(Time) + ", \"m\": " + (String)minute(Time) + " }";
+  json.beginObject()
+      .member("d", duration())
+      .member("h", hours())
+      .member("m", minutes())
+      .endObject();
 }
 
 SprinklerTimerConfig ScheduleDay::toConfig()
 {
   for (auto &t : Timers)
   {
-    return t->toConfig();
+    return t.toConfig();
   }
 
   SprinklerTimerConfig cfg;
@@ -129,120 +94,160 @@ SprinklerTimerConfig ScheduleDay::toConfig()
 
 void ScheduleDay::fromConfig(SprinklerTimerConfig &config)
 {
-  alarmServiceLocked = true;  // Prevent alarm servicing during update
-
-  for (auto &t : Timers)
-  {
-    t->disable();
-    delete t;
-  }
-
-  Timers.clear();
+  clear();
 
   if (!config.defined) {
-    alarmServiceLocked = false;
     return;
   }
 
-  SprinklerTimer *timer = new SprinklerTimer(Day, onTimerTick);
-  if (timer == nullptr) {
-    alarmServiceLocked = false;
-    return;
-  }
-  timer->fromConfig(config);
-  Timers.push_back(timer);
-
-  alarmServiceLocked = false;  // Re-enable alarm servicing
+  add()->fromConfig(config);
 }
 
 void ScheduleDay::fromJSON(JsonArray json)
 {
-  alarmServiceLocked = true;  // Prevent alarm servicing during update
+  clear();
 
-  for (auto &t : Timers)
+  for (JsonVariant value : json)
   {
-    t->disable();
-    delete t;
+    add()->fromJSON(value.as<JsonObject>());
   }
+}
 
-  Timers.clear();
-
+unsigned int ScheduleDay::patch(JsonArray json)
+{
+  unsigned int changed = 0;
+  size_t i = 0;
   for (JsonVariant value : json)
   {
-    SprinklerTimer *timer = new SprinklerTimer(Day, onTimerTick);
-    if (timer == nullptr) {
-      continue;
+    if (i < Timers.size())
+    {
+      changed += Timers[i].patch(value.as<JsonObject>());
+    }
+    else
+    {
+      add()->fromJSON(value.as<JsonObject>());
+      changed++;
     }
-    timer->fromJSON(value.as<JsonObject>());
-    Timers.push_back(timer);
+    i++;
+  }
+
+  if (Timers.size() > i)
+  {
+    changed += Timers.size() - i;
+    Timers.erase(Timers.begin() + i, Timers.end());
   }
 
-  alarmServiceLocked = false;  // Re-enable alarm servicing
+  return changed;
+}
+
+void ScheduleDay::clear()
+{
+  Timers.clear();
+  Timers.shrink_to_fit();
 }
 
-String ScheduleDay::toJSON()
+SprinklerTimer *ScheduleDay::add()
 {
-  String json = "[";
-  String coma = "";
+  Timers.emplace_back(Day);
+  return &Timers.back();
+}
+
+void ScheduleDay::toJSON(JsonWriter &json)
+{
+  json.beginArray();
   for (auto &timer : Timers)
   {
-    json += coma + timer->toJSON();
-    coma = ",";
+    timer.toJSON(json);
+  }
+  json.endArray();
+}
+
+int8_t SprinklerSchedule::index(const char *key)
+{
+  if (key == nullptr || key[0] == 0)
+  {
+    return -1;
+  }
+
+  // the first two characters tell the days apart, the rest is confirmed below
+  int8_t i;
+  switch ((key[0] << 8) | key[1])
+  {
+    case ('a' << 8) | 'l': i = 0; break;
+    case ('s' << 8) | 'u': i = 1; break;
+    case ('m' << 8) | 'o': i = 2; break;
+    case ('t' << 8) | 'u': i = 3; break;
+    case ('w' << 8) | 'e': i = 4; break;
+    case ('t' << 8) | 'h': i = 5; break;
+    case ('f' << 8) | 'r': i = 6; break;
+    case ('s' << 8) | 'a': i = 7; break;
+    default: return -1;
   }
-  json += "]";
 
-  return json;
+  return strcmp(key + 2, ScheduleDayKeys[i] + 2) == 0 ? i : -1;
 }
 
 void SprinklerSchedule::fromJSON(JsonObject json)
 {
-  // First, clear ALL existing days (proper "replace" semantics)
-  // This ensures days not in the incoming JSON get cleared
-  for (const auto &kv : days)
+  // replace semantics: days missing from the JSON end up empty
+  for (auto &day : Days)
   {
-    ScheduleDay *day = kv.second;
-    JsonArray emptyArr;
-    day->fromJSON(emptyArr);
+    day.clear();
+  }
+
+  for (JsonPair kv : json)
+  {
+    ScheduleDay *day = this->day(kv.key().c_str());
+    if (day == nullptr)
+    {
+      continue;
+    }
+    day->fromJSON(kv.value().as<JsonArray>());
   }
+}
 
-  // Then apply only the days specified in the incoming JSON
+unsigned int SprinklerSchedule::patch(JsonObject json)
+{
+  unsigned int changed = 0;
   for (JsonPair kv : json)
   {
-    String key = kv.key().c_str();
-    ScheduleDay *day = days[key];
-    JsonArray arr = kv.value().as<JsonArray>();
-    day->fromJSON(arr);
+    ScheduleDay *day = this->day(kv.key().c_str());
+    if (day == nullptr)
+    {
+      continue;
+    }
+    changed += day->patch(kv.value().as<JsonArray>());
   }
+  return changed;
 }
 
-String SprinklerSchedule::toJSON()
+ScheduleDay *SprinklerSchedule::day(const char *key)
 {
-  String json = "{";
-  String coma = "";
-  for (const auto &kv : days)
+  int8_t i = index(key);
+  return i < 0 ? nullptr : &Days[i];
+}
+
+void SprinklerSchedule::toJSON(JsonWriter &json)
+{
+  json.beginObject();
+  for (uint8_t i = 0; i < 8; i++)
   {
-    String dayid = kv.first;
-    ScheduleDay *day = kv.second;
-    if (day->isEnabled())
+    if (Days[i].isEnabled())
     {
-      json += coma + "\"" + dayid + "\": " + day->toJSON();
-      coma = ",";
+      json.key(ScheduleDayKeys[i]);
+      Days[i].toJSON(json);
     }
   }
-  json += "}";
-  return json;
+  json.endObject();
 }
 
 SprinklerZoneConfig SprinklerSchedule::toConfig()
 {
   SprinklerZoneConfig config;
   memset(&config, 0, sizeof(SprinklerZoneConfig));
-  uint8_t i = 0;
-  for (const auto &kv : days)
+  for (auto &day : Days)
   {
-    ScheduleDay *day = kv.second;
-    config.days[day->dow()] = day->toConfig();
-    i++;
+    config.days[day.dow()] = day.toConfig();
   }
 
   return config;
@@ -250,9 +255,8 @@ SprinklerZoneConfig SprinklerSchedule::toConfig()
 
 void SprinklerSchedule::fromConfig(SprinklerZoneConfig &config)
 {
-  for (const auto &kv : days)
+  for (auto &day : Days)
   {
-    ScheduleDay *day = kv.second;
-    day->fromConfig(config.days[day->dow()]);
+    day.fromConfig(config.days[day.dow()]);
   }
 }
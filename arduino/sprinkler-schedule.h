@@ -3,54 +3,57 @@
 
 #include <Arduino.h>
 #include <ArduinoJson.h>
-#include <Ticker.h>
-#include <TimeAlarms.h>
 #include <TimeLib.h>
 
-#include <map>
 #include <vector>
 
+#include "includes/JsonWriter.h"
 #include "sprinkler-config.h"
 
-// Lock flag to prevent alarm servicing during config updates
+// Lock flag to prevent alarm servicing while the timetable is rebuilt
 extern volatile bool alarmServiceLocked;
 
+#define TIMER_MAX_DURATION 1023  // minutes, the width of SprinklerTimer::Duration
+
+// One start time of a zone, packed into 4 bytes and kept by value in its
+// ScheduleDay. Timers carry no alarm of their own, SprinklerTimetable
+// dispatches them.
 class SprinklerTimer {
  protected:
-  timeDayOfWeek_t Day;
-
-  unsigned int Duration;
-  AlarmID_t AlarmID;
-  OnTick_t OnTick;
-  time_t Time;
+  uint32_t Minute : 11;    // minute of the day, 0..1439
+  uint32_t Duration : 10;  // minutes, 0 disables the timer
+  uint32_t Day : 3;        // timeDayOfWeek_t, dowInvalid for everyday
+  uint32_t Flags : 8;      // reserved, zero
 
  public:
-  typedef std::function<void(SprinklerTimer *)> OnTimerTick;
-
-  SprinklerTimer(timeDayOfWeek_t day, OnTimerTick onTick)
-      : OnTick([this, onTick]() { onTick(this); }), Day(day), Time(0), Duration(0), AlarmID(dtINVALID_ALARM_ID) {
+  SprinklerTimer(timeDayOfWeek_t day)
+      : Minute(0), Duration(0), Day(day), Flags(0) {
   }
 
-  bool isEnabled() { return Alarm.isAllocated(AlarmID); }
-
-  void disable();
-  bool enable();
+  bool isEnabled() const { return Duration > 0; }
 
-  unsigned int hours() { return hour(Time); }
-  unsigned int minutes() { return minute(Time); }
-  unsigned int duration() { return Duration; }
+  timeDayOfWeek_t dow() const { return (timeDayOfWeek_t)Day; }
+  unsigned int hours() const { return Minute / 60; }
+  unsigned int minutes() const { return Minute % 60; }
+  unsigned int duration() const { return Duration; }
 
+  // out of range values are clamped, 23:59 and TIMER_MAX_DURATION
   void hours(unsigned int value);
   void minutes(unsigned int value);
   void duration(unsigned int value);
 
   void fromJSON(JsonObject json);
-  String toJSON();
+  void toJSON(JsonWriter &json);
+
+  // apply the given fields; false when they match the current values
+  bool patch(JsonObject json);
 
   void fromConfig(SprinklerTimerConfig &config);
   SprinklerTimerConfig toConfig();
 };
 
+static_assert(sizeof(SprinklerTimer) == 4, "SprinklerTimer is expected to pack into 4 bytes");
+
 class ScheduleDay {
  public:
   ScheduleDay(timeDayOfWeek_t day) : Day(day) {}
@@ -58,76 +61,59 @@ class ScheduleDay {
   timeDayOfWeek_t dow() { return Day; }
 
   bool isEnabled() {
-    if (Timers.size() > 0) {
-      for (auto &timer : Timers) {
-        if (timer->isEnabled()) {
-          return true;
-        }
+    for (auto &timer : Timers) {
+      if (timer.isEnabled()) {
+        return true;
       }
     }
 
     return false;
   }
 
-  void enable() {
+  template<typename F>
+  void forEachTimer(F callback) {
     for (auto &timer : Timers) {
-      timer->enable();  // Always re-enable to handle NTP time corrections
+      if (timer.isEnabled()) {
+        callback(&timer);
+      }
     }
   }
 
-  void disable() {
-    for (auto &timer : Timers) {
-      timer->disable();
-    }
-  }
+  void fromJSON(JsonArray json);
+  void toJSON(JsonWriter &json);
 
-  void onTimer(SprinklerTimer::OnTimerTick onTick) { onTimerTick = onTick; }
+  // update timers by position, append or drop the difference; returns the number of timers changed
+  unsigned int patch(JsonArray json);
 
-  void fromJSON(JsonArray json);
-  String toJSON();
+  // append an empty timer, e.g. while a settings body is parsed; the
+  // pointer is valid until the next add()
+  SprinklerTimer *add();
+  void clear();
+  size_t size() const { return Timers.size(); }
 
   void fromConfig(SprinklerTimerConfig &config);
   SprinklerTimerConfig toConfig();
 
  protected:
   timeDayOfWeek_t Day;
-  std::vector<SprinklerTimer *> Timers;
-  SprinklerTimer::OnTimerTick onTimerTick;
+  std::vector<SprinklerTimer> Timers;
 };
 
+// JSON keys of the days, indexed by timeDayOfWeek_t ("all" is dowInvalid)
+constexpr const char *ScheduleDayKeys[8] = {"all", "sun", "mon", "tue", "wed", "thu", "fri", "sat"};
+
 class SprinklerSchedule {
  public:
-  ScheduleDay Everyday;
-  ScheduleDay Mon;
-  ScheduleDay Tue;
-  ScheduleDay Wed;
-  ScheduleDay Thu;
-  ScheduleDay Fri;
-  ScheduleDay Sat;
-  ScheduleDay Sun;
-
-  SprinklerSchedule() : Everyday(dowInvalid),
-                        Mon(dowMonday),
-                        Tue(dowTuesday),
-                        Wed(dowWednesday),
-                        Thu(dowThursday),
-                        Fri(dowFriday),
-                        Sat(dowSaturday),
-                        Sun(dowSunday) {
-    days["all"] = &Everyday;
-    days["mon"] = &Mon;
-    days["tue"] = &Tue;
-    days["wed"] = &Wed;
-    days["thu"] = &Thu;
-    days["fri"] = &Fri;
-    days["sat"] = &Sat;
-    days["sun"] = &Sun;
+  SprinklerSchedule()
+      : Days{{dowInvalid}, {dowSunday}, {dowMonday}, {dowTuesday}, {dowWednesday}, {dowThursday}, {dowFriday}, {dowSaturday}} {
   }
 
+  // position of a day key in ScheduleDayKeys, -1 for anything else
+  static int8_t index(const char *key);
+
   bool isEnabled() {
-    for (const auto &kv : days) {
-      ScheduleDay *day = kv.second;
-      if (day->isEnabled()) {
+    for (auto &day : Days) {
+      if (day.isEnabled()) {
         return true;
       }
     }
@@ -135,35 +121,27 @@ class SprinklerSchedule {
     return false;
   }
 
-  void enable() {
-    for (const auto &kv : days) {
-      ScheduleDay *day = kv.second;
-      day->enable();
+  template<typename F>
+  void forEachTimer(F callback) {
+    for (auto &day : Days) {
+      day.forEachTimer(callback);
     }
   }
 
-  void disable() {
-    for (const auto &kv : days) {
-      ScheduleDay *day = kv.second;
-      day->disable();
-    }
-  }
+  void fromJSON(JsonObject json);
+  void toJSON(JsonWriter &json);
 
-  void onTimer(SprinklerTimer::OnTimerTick onTick) {
-    for (const auto &kv : days) {
-      ScheduleDay *day = kv.second;
-      day->onTimer(onTick);
-    }
-  }
+  // merge only the days given, a null day clears it; returns the number of timers changed
+  unsigned int patch(JsonObject json);
 
-  void fromJSON(JsonObject json);
-  String toJSON();
+  // "mon".."sun" or "all"; nullptr for an unknown key
+  ScheduleDay *day(const char *key);
 
   void fromConfig(SprinklerZoneConfig &config);
   SprinklerZoneConfig toConfig();
 
  private:
-  std::map<String, ScheduleDay *> days;
+  ScheduleDay Days[8];
 };
 
 #endif
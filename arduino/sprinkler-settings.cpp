@@ -14,10 +14,33 @@ void SprinklerZone::name(const char *value)
 
 void SprinklerZone::fromJSON(JsonObject json)
 {
-    name(json["name"].as<char *>());
+    name(json["name"] | "");
     Schedule.fromJSON(json["days"].as<JsonObject>());
 }
 
+unsigned int SprinklerZone::patch(JsonObject json, bool &rescheduled)
+{
+    unsigned int changed = 0;
+    if (json.containsKey("name"))
+    {
+        const char *value = json["name"] | "";
+        if (strncmp(Name, value, sizeof(Name) - 1) != 0)
+        {
+            name(value);
+            changed++;
+        }
+    }
+
+    if (json.containsKey("days"))
+    {
+        unsigned int timers = Schedule.patch(json["days"].as<JsonObject>());
+        rescheduled |= timers > 0;
+        changed += timers;
+    }
+
+    return changed;
+}
+
 void SprinklerZone::fromConfig(SprinklerZoneConfig &config)
 {
     if (config.defined)
@@ -35,26 +58,74 @@ SprinklerZoneConfig SprinklerZone::toConfig()
     return cfg;
 }
 
-void SprinklerSettings::fromJSON(JsonObject json)
+void SprinklerSettings::replace(std::map<unsigned int, SprinklerZone *> &staged)
 {
+    alarmServiceLocked = true;  // Prevent alarm servicing during update
+
     reset();
+    zones.swap(staged);
+
+    compile();
+    revisions++;
+
+    alarmServiceLocked = false;  // Re-enable alarm servicing
+}
 
+unsigned int SprinklerSettings::patch(JsonObject json, bool &rescheduled)
+{
+    unsigned int changed = 0;
     for (JsonPair kv : json)
     {
         String key = kv.key().c_str();
         unsigned int zoneid = key.toInt();
-        JsonObject value = kv.value().as<JsonObject>();
-        SprinklerZone *zone = new SprinklerZone(zoneid, onTimerTick);
-        if (zone == nullptr) {
+        if (zoneid < 1 || zoneid > SKETCH_MAX_ZONES)
+        {
             continue;
         }
-        zone->fromJSON(value);
-        zones[zoneid] = zone;
+
+        auto it = zones.find(zoneid);
+        if (kv.value().isNull())
+        {
+            if (it != zones.end())
+            {
+                delete it->second;
+                zones.erase(it);
+                rescheduled = true;
+                changed++;
+            }
+            continue;
+        }
+
+        JsonObject value = kv.value().as<JsonObject>();
+        if (it == zones.end())
+        {
+            SprinklerZone *zone = new SprinklerZone(zoneid);
+            if (zone == nullptr) {
+                continue;
+            }
+            zone->fromJSON(value);
+            zones[zoneid] = zone;
+            rescheduled = true;
+            changed++;
+        }
+        else
+        {
+            changed += it->second->patch(value, rescheduled);
+        }
     }
+
+    if (changed)
+    {
+        revisions++;
+    }
+
+    return changed;
 }
 
 void SprinklerSettings::fromConfig(SprinklerConfig &config)
 {
+    alarmServiceLocked = true;  // Prevent alarm servicing during update
+
     reset();
 
     for (uint8_t i = 0; i < SKETCH_MAX_ZONES; i++)
@@ -62,7 +133,7 @@ void SprinklerSettings::fromConfig(SprinklerConfig &config)
         unsigned int zoneid = i + 1;
         if (config.zones[i].defined)
         {
-            SprinklerZone *zone = new SprinklerZone(zoneid, onTimerTick);
+            SprinklerZone *zone = new SprinklerZone(zoneid);
             if (zone == nullptr) {
                 continue;
             }
@@ -70,6 +141,77 @@ void SprinklerSettings::fromConfig(SprinklerConfig &config)
             zones[zoneid] = zone;
         }
     }
+
+    compile();
+    revisions++;
+
+    alarmServiceLocked = false;  // Re-enable alarm servicing
+}
+
+void SprinklerSettings::compile()
+{
+    Timetable.clear();
+
+    for (const auto &kv : zones)
+    {
+        unsigned int zoneid = kv.first;
+        SprinklerZone *zone = kv.second;
+        if (isSequenced(zoneid))
+        {
+            continue; // started by the sequence runner
+        }
+        zone->forEachTimer([this, zoneid](SprinklerTimer *timer) {
+            Timetable.add(timer->dow(), timer->hours(), timer->minutes(), zoneid, timer->duration());
+        });
+    }
+
+    if (Sequence.enabled)
+    {
+        // sequence start is stored in client local time
+        int32_t start = (Sequence.hour * 60 + Sequence.minute + Sequence.offset * 60) * SECS_PER_MIN;
+        for (uint8_t d = 0; d < 7; d++)
+        {
+            if (Sequence.days & (1 << d))
+            {
+                int32_t second = d * SECS_PER_DAY + start;
+                if (second < 0)
+                {
+                    second += SECS_PER_WEEK;
+                }
+                Timetable.add((uint32_t)second, TIMETABLE_SEQUENCE, Sequence.duration);
+            }
+        }
+    }
+
+    Timetable.compile();
+}
+
+unsigned int SprinklerSettings::duration(unsigned int zoneid, unsigned int fallback)
+{
+    unsigned int value = 0;
+    auto it = zones.find(zoneid);
+    if (it != zones.end())
+    {
+        it->second->forEachTimer([&value](SprinklerTimer *timer) {
+            if (!value)
+            {
+                value = timer->duration();
+            }
+        });
+    }
+    return value ? value : fallback;
+}
+
+bool SprinklerSettings::isSequenced(unsigned int zoneid) const
+{
+    for (uint8_t i = 0; i < Sequence.orderCount(); i++)
+    {
+        if (Sequence.order[i] == zoneid)
+        {
+            return true;
+        }
+    }
+    return false;
 }
 
 SprinklerConfig SprinklerSettings::toConfig()
@@ -85,17 +227,13 @@ SprinklerConfig SprinklerSettings::toConfig()
     return config;
 }
 
-String SprinklerSettings::toJSON()
+void SprinklerSettings::toJSON(JsonWriter &json)
 {
-    String json = "{";
-    String coma = "";
+    json.beginObject();
     for (const auto &kv : zones)
     {
-        unsigned int zoneid = kv.first;
-        SprinklerZone *zone = kv.second;
-        json += coma + "\"" + (String)zoneid + "\": " + zone->toJSON();
-        coma = ",";
+        json.key(kv.first);
+        kv.second->toJSON(json);
     }
-    json += "}";
-    return json;
+    json.endObject();
 }
@@ -6,40 +6,40 @@
 #include <ArduinoJson.h>
 #include "sprinkler-config.h"
 #include "sprinkler-schedule.h"
+#include "sprinkler-timetable.h"
 
 class SprinklerZone
 {
 
 public:
-  typedef std::function<void(SprinklerZone *, SprinklerTimer *)> OnTimerTick;
-
-  SprinklerZone(unsigned int zoneid, OnTimerTick onTick)
+  SprinklerZone(unsigned int zoneid)
       : Index(zoneid)
   {
     memset(Name, 0, sizeof(Name));
-
-    Schedule.onTimer([this, onTick](SprinklerTimer *timer) {
-      onTick(this, timer);
-    });
   }
 
   unsigned int index() const { return Index; }
   const String name() const { return Name; }
   void name(const char *value);
 
-  bool isAttached() { return Schedule.isEnabled(); }
-
-  void attach() { Schedule.enable(); }
+  template<typename F>
+  void forEachTimer(F callback) { Schedule.forEachTimer(callback); }
 
-  void detach() { Schedule.disable(); }
+  ScheduleDay *day(const char *key) { return Schedule.day(key); }
 
   void fromConfig(SprinklerZoneConfig &config);
   SprinklerZoneConfig toConfig();
 
   void fromJSON(JsonObject json);
-  String toJSON()
+
+  // rename and merge days in place; rescheduled is set when a timer changed
+  unsigned int patch(JsonObject json, bool &rescheduled);
+
+  void toJSON(JsonWriter &json)
   {
-    return "{\"name\": \"" + name() + "\", \"days\": " + Schedule.toJSON() + "}";
+    json.beginObject().member("name", name()).key("days");
+    Schedule.toJSON(json);
+    json.endObject();
   }
 
 private:
@@ -51,62 +51,56 @@ private:
 class SprinklerSettings
 {
 public:
-  SprinklerSettings(SprinklerZone::OnTimerTick onTick)
-    : onTimerTick(onTick)
+  SprinklerSettings(const SprinklerSequenceConfig &sequence, SprinklerTimetable::OnEvent onEvent)
+    : Sequence(sequence), Timetable(onEvent)
   { }
 
-  void fromJSON(JsonObject json);
-  String toJSON();
+  void toJSON(JsonWriter &json);
+
+  // take over zones built elsewhere (see SprinklerParser), the old ones are
+  // deleted and staged is left empty
+  void replace(std::map<unsigned int, SprinklerZone *> &staged);
+
+  // Apply a partial zone map without tearing down untouched zones: a null
+  // zone is removed, an unknown one is created. Returns the number of zones,
+  // days and timers changed; the timetable is left to the caller to compile.
+  unsigned int patch(JsonObject json, bool &rescheduled);
 
   void fromConfig(SprinklerConfig &config);
   SprinklerConfig toConfig();
 
+  // rebuild the timetable from zone timers and the sequence
+  void compile();
+
+  // zone's own timer duration, used as its custom duration within the sequence
+  unsigned int duration(unsigned int zoneid, unsigned int fallback);
+
+  bool isSequenced(unsigned int zoneid) const;
+
   void reset()
   {
     for (const auto &kv : zones)
     {
       SprinklerZone *zone = kv.second;
-      zone->detach();
       delete zone;
     }
 
     zones.clear();
+    Timetable.clear();
+    Timetable.disarm();
   }
 
-  bool isAttached()
-  {
-    if (zones.size() > 0)
-    {
-      for (const auto &kv : zones)
-      {
-        auto *zone = kv.second;
-        if (zone->isAttached())
-        {
-          return true;
-        }
-      }
-    }
-    
-    return false;
-  }
+  bool isAttached() { return Timetable.isArmed(); }
 
-  void detach()
-  {
-    for (const auto &kv : zones)
-    {
-      SprinklerZone *zone = kv.second;
-      zone->detach();
-    }
-  }
+  // Re-arm to follow NTP time corrections; an alarm still due for the next event is kept
+  void attach() { Timetable.arm(); revisions++; }
 
-  void attach()
-  {
-    for (const auto &kv : zones)
-    {
-      SprinklerZone *zone = kv.second;
-      zone->attach();
-    }
-  }
+  void detach() { Timetable.disarm(); revisions++; }
+
+  // bumped whenever the zones or the attached state change, keys the JSON cache
+  uint32_t revision() const { return revisions; }
+
+  SprinklerTimetable &timetable() { return Timetable; }
 
   // Iterator for external access to zones (used by Alexa integration)
   template<typename F>
@@ -123,7 +117,9 @@ public:
 
 private:
   std::map<unsigned int, SprinklerZone *> zones;
-  SprinklerZone::OnTimerTick onTimerTick;
+  const SprinklerSequenceConfig &Sequence;
+  SprinklerTimetable Timetable;
+  uint32_t revisions = 0;
 };
 
 #endif
@@ -2,10 +2,15 @@
 #define SPRINKLER_SETUP_H
 
 #include "sprinkler.h"
+#include "sprinkler-persist.h"
+#include "sprinkler-store.h"
 
 void setupUnit()
 {
+   Store.begin();
    Sprinkler.load();
+   Persist.begin();
+   Sprinkler.recover();
 }
 
 #endif
\ No newline at end of file
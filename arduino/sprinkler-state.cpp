@@ -3,16 +3,20 @@
 #include <WsConsole.h>
 
 #include "includes/Files.h"
+#include "sprinkler-loop.h"
 
-size_t SprinklerState::count() {
-  size_t count = 0;
-  for (const auto &kv : Timers) {
-    SprinklerZoneTimer *timer = kv.second;
-    if (!timer->PauseTime)
-      count += 1;
+#define STATE_TOKEN(zone, generation) (((generation) << 8) | (zone))
+#define STATE_RETRY_US 10000  // expiry queue full, try again shortly
+
+SprinklerZoneTimer *SprinklerState::slot(unsigned int zone) {
+  if (zone < 1 || zone > SKETCH_MAX_ZONES) {
+    return nullptr;
   }
+  return &slots[zone - 1];
+}
 
-  return count;
+size_t SprinklerState::count() {
+  return __builtin_popcount(active & ~paused);
 }
 
 bool SprinklerState::isEnabled() {
@@ -21,87 +25,198 @@ bool SprinklerState::isEnabled() {
 
 void SprinklerState::enable() {
   enabled = true;
+  revisions++;
 }
 
 void SprinklerState::disable() {
   enabled = false;
+  revisions++;
 }
 
 bool SprinklerState::isWatering() {
-  for (const auto &kv : Timers) {
-    SprinklerZoneTimer *timer = kv.second;
-    if (!timer->PauseTime)
-      return true;
-  }
-
-  return false;
+  return (active & ~paused) != 0;
 }
 
 bool SprinklerState::isPaused(unsigned int zone) {
-  if (Timers.find(zone) != Timers.end()) {
-    return (Timers[zone]->PauseTime);
-  }
-  return false;
+  return slot(zone) && (paused & bit(zone));
 }
 
 bool SprinklerState::isWatering(unsigned int zone) {
-  if (Timers.find(zone) != Timers.end()) {
-    return (!Timers[zone]->PauseTime);
-  }
-  return false;
+  return slot(zone) && ((active & ~paused) & bit(zone));
+}
+
+bool SprinklerState::isActive(unsigned int zone) {
+  return slot(zone) && (active & bit(zone));
 }
 
-const String SprinklerState::toJSON() {
-  String json = "{";
-  String coma = "";
-  for (auto &kv : Timers)
+void SprinklerState::toJSON(JsonWriter &json) {
+  json.beginObject();
+  for (unsigned int zone = 1; zone <= SKETCH_MAX_ZONES; zone++)
   {
-    SprinklerZoneTimer *timer = kv.second;
-    json += coma + "\"" + (String) timer->Zone + "\": " + timer->toJSON();
-    coma = ",";
+    if (active & bit(zone))
+    {
+      json.key(zone);
+      slots[zone - 1].toJSON(json);
+    }
   }
-  json += "}";
-  return json;
+  json.endObject();
 }
 
-const String SprinklerState::toJSON(unsigned int zone) 
+void SprinklerState::toJSON(JsonWriter &json, unsigned int zone)
 {
-  if (Timers.find(zone) != Timers.end())
+  if (slot(zone) && (active & bit(zone)))
   {
-    return Timers[zone]->toJSON();
+    slots[zone - 1].toJSON(json);
+    return;
   }
 
-  return "{ \"state\": \"stopped\", \"zone\":" + (String)zone + "}";
+  json.beginObject().member("state", "stopped").member("zone", zone).endObject();
 }
 
-void SprinklerState::start(unsigned int zone, unsigned int duration, OnStopCallback onStop) {
-  if (Timers.find(zone) != Timers.end()) {
-    delete Timers[zone];
-    Timers.erase(zone);
+unsigned int SprinklerState::duration(unsigned int zone) {
+  return slot(zone) && (active & bit(zone)) ? slots[zone - 1].Duration : 0;
+}
+
+unsigned long SprinklerState::remaining(unsigned int zone) {
+  if (slot(zone) && (active & bit(zone))) {
+    return (slots[zone - 1].remaining() + 999999) / 1000000;
   }
+  return 0;
+}
 
-  SprinklerZoneTimer *timer = new SprinklerZoneTimer(zone, duration, onStop);
-  if (timer != nullptr) {
-    Timers[zone] = timer;
+void SprinklerState::start(unsigned int zone, unsigned int duration, OnStopCallback onStop, unsigned int elapsed) {
+  SprinklerZoneTimer *timer = slot(zone);
+  if (timer == nullptr) {
+    return;
   }
+
+  begin();
+  portENTER_CRITICAL(&lock);
+  timer->start(zone, duration, onStop, (int64_t)elapsed * 1000 * 1000);  // re-arms in place, drops a previous run
+  active |= bit(zone);
+  paused &= ~bit(zone);
+  rearm();
+  revisions++;
+  portEXIT_CRITICAL(&lock);
 }
 
 void SprinklerState::stop(unsigned int zone) {
-  if (Timers.find(zone) != Timers.end()) {
-    Timers[zone]->stop();
-    delete Timers[zone];
-    Timers.erase(zone);
+  if (slot(zone) && (active & bit(zone))) {
+    portENTER_CRITICAL(&lock);
+    slots[zone - 1].stop();
+    active &= ~bit(zone);
+    paused &= ~bit(zone);
+    rearm();
+    revisions++;
+    portEXIT_CRITICAL(&lock);
   }
 }
 
 void SprinklerState::pause(unsigned int zone) {
-  if (Timers.find(zone) != Timers.end()) {
-    Timers[zone]->pause();
+  if (slot(zone) && (active & bit(zone))) {
+    portENTER_CRITICAL(&lock);
+    slots[zone - 1].pause();
+    paused |= bit(zone);
+    rearm();
+    revisions++;
+    portEXIT_CRITICAL(&lock);
   }
 }
 
 void SprinklerState::resume(unsigned int zone) {
-  if (Timers.find(zone) != Timers.end()) {
-    Timers[zone]->resume();
+  if (slot(zone) && (paused & bit(zone))) {
+    portENTER_CRITICAL(&lock);
+    slots[zone - 1].resume();
+    paused &= ~bit(zone);
+    rearm();
+    revisions++;
+    portEXIT_CRITICAL(&lock);
+  }
+}
+
+void SprinklerState::handle() {
+  uint32_t token;
+  while (expiries && xQueueReceive(expiries, &token, 0) == pdTRUE) {
+    unsigned int zone = token & 0xFF;
+    SprinklerZoneTimer *timer = slot(zone);
+    // stopped, paused or restarted since the expiry was queued
+    if (timer && isWatering(zone) && STATE_TOKEN(zone, timer->Generation) == token) {
+      timer->OnStop();
+    }
+  }
+}
+
+unsigned long SprinklerState::deadline() {
+  return expiries && uxQueueMessagesWaiting(expiries) ? 0 : LOOP_IDLE;
+}
+
+void SprinklerState::begin() {
+  if (clock) {
+    return;
+  }
+
+  expiries = xQueueCreateStatic(2 * SKETCH_MAX_ZONES, sizeof(uint32_t), expiriesStorage, &expiriesQueue);
+
+  esp_timer_create_args_t args = {};
+  args.callback = +[](void *arg) { ((SprinklerState *)arg)->expire(); };
+  args.arg = this;
+  args.name = "zones";
+  esp_timer_create(&args, &clock);
+}
+
+// arms the shared clock for the earliest slot deadline; called with the lock held
+void SprinklerState::rearm() {
+  int64_t earliest = 0;
+  for (unsigned int i = 0; i < SKETCH_MAX_ZONES; i++) {
+    int64_t deadline = slots[i].Deadline;
+    if (deadline && (!earliest || deadline < earliest)) {
+      earliest = deadline;
+    }
+  }
+
+  if (earliest == clockDeadline || !clock) {
+    return;
   }
-}
\ No newline at end of file
+
+  esp_timer_stop(clock);
+  clockDeadline = earliest;
+  if (earliest) {
+    int64_t us = earliest - esp_timer_get_time();
+    esp_timer_start_once(clock, us > 0 ? us : 0);
+  }
+}
+
+// esp_timer task: hand every due slot to the control task, then re-arm
+void SprinklerState::expire() {
+  uint32_t tokens[SKETCH_MAX_ZONES];
+  size_t due = 0;
+
+  portENTER_CRITICAL(&lock);
+  int64_t t = esp_timer_get_time();
+  for (unsigned int i = 0; i < SKETCH_MAX_ZONES; i++) {
+    if (slots[i].Deadline && slots[i].Deadline <= t) {
+      tokens[due++] = STATE_TOKEN(i + 1, slots[i].Generation);
+      slots[i].Deadline = 0;  // generation is kept so the token stays valid
+    }
+  }
+  clockDeadline = 0;
+  rearm();
+  portEXIT_CRITICAL(&lock);
+
+  for (size_t i = 0; i < due; i++) {
+    if (xQueueSend(expiries, &tokens[i], 0) != pdTRUE) {
+      // keep the zone armed and retry rather than leave it watering
+      unsigned int zone = tokens[i] & 0xFF;
+      portENTER_CRITICAL(&lock);
+      if (STATE_TOKEN(zone, slots[zone - 1].Generation) == tokens[i] && !slots[zone - 1].Deadline) {
+        slots[zone - 1].Deadline = esp_timer_get_time() + STATE_RETRY_US;
+        rearm();
+      }
+      portEXIT_CRITICAL(&lock);
+    }
+  }
+
+  if (due) {
+    Loop.wake();
+  }
+}
@@ -1,105 +1,140 @@
 #ifndef SprinklerState_H
 #define SprinklerState_H
 
-#include <ArduinoJson.h>
-#include <Ticker.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
 
 #include <functional>
-#include <map>
 
+#include "html/settings.json.h"
+#include "includes/JsonWriter.h"
+
+// Zone timer slot. Slots live for the lifetime of the firmware and are re-armed in place.
+// A slot only records its deadline; SprinklerState runs one shared clock for all slots.
+// Every arm/disarm bumps the generation so an expiry queued for an older run is dropped.
+// Run accounting is kept in 64-bit esp_timer microseconds and never wraps.
 class SprinklerZoneTimer {
  public:
   typedef std::function<void()> OnStopCallback;
 
-  SprinklerZoneTimer(unsigned int zone, unsigned int duration, OnStopCallback onStop)
-      : Zone(zone), Duration(duration), StartTime(millis()), PauseTime(0), OnStop(onStop), stopping(false) {
-    unsigned long d = (duration ? duration : 5);
-    unsigned long ms = d * 1000 * 60;
-    timer.once_ms(ms, +[](SprinklerZoneTimer* x) {
-      if (!x->stopping) x->OnStop();
-    }, this);
-  }
+  enum RunState : uint8_t { Stopped, Running, Paused };
+
+  SprinklerZoneTimer()
+      : Zone(0), Duration(0), State(Stopped), Started(0), Elapsed(0), Deadline(0), Generation(0) {}
 
   unsigned int Zone;
-  unsigned int Duration;
-  unsigned long StartTime;
-  unsigned long PauseTime;
+  unsigned int Duration;  // minutes
+  RunState State;
+  int64_t Started;      // esp_timer time (us) the current running segment began
+  int64_t Elapsed;      // us watered before the current segment
+  int64_t Deadline;     // esp_timer time (us) of the expiry, 0 while not armed
+  uint32_t Generation;  // bumped on every arm/disarm
+  OnStopCallback OnStop;
+
+  int64_t total() const { return (int64_t)Duration * 60 * 1000 * 1000; }
 
-  ~SprinklerZoneTimer() {
-    stopping = true;  // Set BEFORE detach to prevent callback execution
-    timer.detach();
+  int64_t elapsed(int64_t t = esp_timer_get_time()) const {
+    return Elapsed + (State == Running ? t - Started : 0);
+  }
+
+  int64_t remaining(int64_t t = esp_timer_get_time()) const {
+    int64_t left = total() - elapsed(t);
+    return left > 0 ? left : 0;
+  }
+
+  void start(unsigned int zone, unsigned int duration, OnStopCallback onStop, int64_t elapsed = 0) {
+    Zone = zone;
+    Duration = duration ? duration : 5;
+    Elapsed = elapsed;
+    OnStop = onStop;  // small capture, stored in the function's inline buffer
+    run();
   }
 
   void pause() {
-    PauseTime = millis();
-    timer.detach();
+    if (State != Running)
+      return;
+
+    Elapsed = elapsed();
+    State = Paused;
+    disarm();
   }
 
   void resume() {
-    if (!PauseTime)
+    if (State != Paused)
       return;
 
-    uint32_t d = (uint32_t)Duration * 60 * 1000;
-    uint32_t p = PauseTime - StartTime;
-    uint32_t ms = d - p;
-    timer.once_ms(ms, +[](SprinklerZoneTimer* x) {
-      if (!x->stopping) x->OnStop();
-    }, this);
-    StartTime = millis() - p;
-    PauseTime = 0;
+    run();
   }
 
   void stop() {
-    stopping = true;  // Also set here for explicit stop
-    PauseTime = 0;
-    timer.detach();
+    State = Stopped;
+    disarm();
   }
 
-  const String toJSON() {
-    auto ms = PauseTime ? PauseTime - StartTime : millis() - StartTime;
-    auto state = PauseTime ? "paused" : "started";
-    return "{ \"state\": \"" + (String)state +
-           "\", \"zone\":" + (String)Zone +
-           ", \"millis\":" + (String)(ms) +
-           ", \"duration\": " + (String)Duration +
-           " }";
+  void toJSON(JsonWriter &json) {
+    int64_t t = esp_timer_get_time();
+    json.beginObject()
+        .member("state", State == Paused ? "paused" : "started")
+        .member("zone", Zone)
+        .member("millis", (unsigned long)(elapsed(t) / 1000))
+        .member("remainingMs", (unsigned long)(remaining(t) / 1000))
+        .member("duration", Duration)
+        .endObject();
   }
 
  private:
-  OnStopCallback OnStop;
-  Ticker timer;
-  volatile bool stopping;  // Prevents callback execution during/after deletion
+  void run() {
+    Generation++;
+    State = Running;
+    Started = esp_timer_get_time();
+    Deadline = Started + total() - Elapsed;
+  }
+
+  void disarm() {
+    Generation++;
+    Deadline = 0;
+  }
 };
 
 struct SequenceSession {
   bool active;                      // Is sequence currently running?
   bool paused;                      // Is sequence paused?
+  bool waiting;                     // Is sequence in the gap before the next zone?
+  uint8_t currentZone;              // Zone at currentZoneIndex
   uint8_t currentZoneIndex;         // Current position in order[] (0-based)
   uint8_t totalZones;               // Total zones in sequence
 
-  SequenceSession() : active(false), paused(false),
-    currentZoneIndex(0), totalZones(0) {}
+  SequenceSession() : active(false), paused(false), waiting(false),
+    currentZone(0), currentZoneIndex(0), totalZones(0) {}
 
   void reset() {
     active = false;
     paused = false;
+    waiting = false;
+    currentZone = 0;
     currentZoneIndex = 0;
     totalZones = 0;
   }
 
-  const String toJSON() const {
-    if (!active) return "null";
-    return "{ \"active\": true"
-           ", \"paused\": " + String(paused ? "true" : "false") +
-           ", \"currentIndex\": " + String(currentZoneIndex) +
-           ", \"totalZones\": " + String(totalZones) +
-           " }";
+  void toJSON(JsonWriter &json) const {
+    if (!active) {
+      json.null();
+      return;
+    }
+    json.beginObject()
+        .member("active", true)
+        .member("paused", paused)
+        .member("waiting", waiting)
+        .member("zone", currentZone)
+        .member("currentIndex", currentZoneIndex)
+        .member("totalZones", totalZones)
+        .endObject();
   }
 };
 
 class SprinklerState {
  public:
-  std::map<unsigned int, SprinklerZoneTimer*> Timers;
   SequenceSession Sequence;
 
   bool isEnabled();
@@ -108,20 +143,51 @@ class SprinklerState {
 
   bool isPaused(unsigned int zone);
   bool isWatering(unsigned int zone);
+  bool isActive(unsigned int zone);  // watering or paused, holding its slot
   bool isWatering();
   size_t count();
 
+  unsigned int duration(unsigned int zone);
+  unsigned long remaining(unsigned int zone);  // seconds, rounded up
+
   typedef std::function<void()> OnStopCallback;
-  void start(unsigned int zone, unsigned int duration, OnStopCallback onStop);
+  // elapsed: seconds of the run already watered, e.g. before a reset
+  void start(unsigned int zone, unsigned int duration, OnStopCallback onStop, unsigned int elapsed = 0);
   void stop(unsigned int zone);
   void pause(unsigned int zone);
   void resume(unsigned int zone);
 
-  const String toJSON(unsigned int zone);
-  const String toJSON();
+  void toJSON(JsonWriter &json, unsigned int zone);
+  void toJSON(JsonWriter &json);
+
+  // bumped on every start, stop, pause, resume, enable and disable
+  uint32_t revision() const { return revisions; }
+
+  // runs expiries queued by the clock; call from the control task only
+  void handle();
+  unsigned long deadline();
 
  private:
+  SprinklerZoneTimer *slot(unsigned int zone);
+  void begin();
+  void rearm();
+  void expire();
+  static uint32_t bit(unsigned int zone) { return 1UL << (zone - 1); }
+
+  SprinklerZoneTimer slots[SKETCH_MAX_ZONES];
+  uint32_t active = 0;  // zone bitmask, bit 0 = zone 1
+  uint32_t paused = 0;  // subset of active
   bool enabled = true;
+  uint32_t revisions = 0;
+
+  // one esp_timer armed for the earliest slot deadline; expiries are handed
+  // to the control task as (generation << 8 | zone) tokens
+  esp_timer_handle_t clock = nullptr;
+  int64_t clockDeadline = 0;
+  QueueHandle_t expiries = nullptr;
+  StaticQueue_t expiriesQueue;
+  uint8_t expiriesStorage[2 * SKETCH_MAX_ZONES * sizeof(uint32_t)];
+  portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
 };
 
 #endif
\ No newline at end of file
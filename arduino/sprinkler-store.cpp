@@ -0,0 +1,338 @@
+#include <rom/crc.h>
+#include <stddef.h>
+#include <WsConsole.h>
+
+#include "sprinkler-store.h"
+
+WsConsole storeLog("save");
+
+#define STORE_FREE 0xFFFFFFFF
+#define STORE_NONE 0xFF
+
+static size_t align(size_t size) {
+  return (size + 3) & ~(size_t)3;
+}
+
+// bytes of SprinklerConfig covered by a section
+static void span(uint8_t section, size_t &offset, size_t &length) {
+  switch (section) {
+    case StoreDevice:
+      offset = offsetof(SprinklerConfig, version);
+      length = offsetof(SprinklerConfig, mqtt_host) - offset;
+      break;
+    case StoreMqtt:
+      offset = offsetof(SprinklerConfig, mqtt_host);
+      length = offsetof(SprinklerConfig, sequence) - offset;
+      break;
+    case StoreSequence:
+      offset = offsetof(SprinklerConfig, sequence);
+      length = sizeof(SprinklerSequenceConfig);
+      break;
+    default:
+      offset = offsetof(SprinklerConfig, zones) + (section - StoreZone) * sizeof(SprinklerZoneConfig);
+      length = sizeof(SprinklerZoneConfig);
+      break;
+  }
+}
+
+// zero the padding and unused timer bits, so equal zones compare equal
+static void normalize(SprinklerZoneConfig &zone) {
+  SprinklerZoneConfig clean;
+  memset((void *)&clean, 0, sizeof(SprinklerZoneConfig));
+  clean.defined = zone.defined;
+  memcpy(clean.disp_name, zone.disp_name, sizeof(clean.disp_name));
+  for (uint8_t d = 0; d < 8; d++) {
+    clean.days[d].defined = zone.days[d].defined;
+    clean.days[d].h = zone.days[d].h;
+    clean.days[d].m = zone.days[d].m;
+    clean.days[d].d = zone.days[d].d;
+  }
+  memcpy((void *)&zone, (const void *)&clean, sizeof(SprinklerZoneConfig));
+}
+
+static uint32_t checksum(const StoreRecordHeader &rec) {
+  return crc32_le(0, (const uint8_t *)&rec, offsetof(StoreRecordHeader, crc));
+}
+
+bool SprinklerStore::begin() {
+  if (partition) {
+    return true;
+  }
+
+  const esp_partition_t *found = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)STORE_SUBTYPE, STORE_PARTITION);
+  if (found == nullptr || found->size < 2 * STORE_SECTOR_SIZE) {
+    storeLog.warn("no config partition, using EEPROM");
+    return false;
+  }
+
+  unsigned long start = millis();
+  partition = found;
+  count = min((size_t)(found->size / STORE_SECTOR_SIZE), (size_t)STORE_MAX_SECTORS);
+  for (uint8_t i = 0; i < StoreSections; i++) {
+    sections[i] = {STORE_NONE, 0, 0, 0};
+  }
+
+  uint8_t order[STORE_MAX_SECTORS];
+  uint8_t used = 0;
+  for (uint8_t s = 0; s < count; s++) {
+    StoreSectorHeader header;
+    esp_partition_read(partition, address(s, 0), &header, sizeof(StoreSectorHeader));
+    erases[s] = header.magic == STORE_MAGIC ? header.erases : 0;
+    seqs[s] = STORE_FREE;
+
+    if (header.magic != STORE_MAGIC) {
+      erase(s);  // blank or foreign sector
+    } else if (header.seq == STORE_FREE && header.check == STORE_FREE) {
+      continue;
+    } else if (header.check != ~header.seq) {
+      erase(s);  // reset while opening, holds no records
+    } else {
+      seqs[s] = header.seq;
+      sector_seq = max(sector_seq, header.seq);
+
+      // oldest first, so newer records override older ones
+      uint8_t i = used++;
+      for (; i > 0 && seqs[order[i - 1]] > header.seq; i--) {
+        order[i] = order[i - 1];
+      }
+      order[i] = s;
+    }
+  }
+
+  // a reset cut a compaction short: the newest sector only holds copies of
+  // records the oldest one still has, maybe torn, so drop it and compact again
+  bool interrupted = used == count;
+  if (interrupted) {
+    erase(order[--used]);
+  }
+
+  for (uint8_t i = 0; i < used; i++) {
+    scan(order[i]);
+  }
+
+  for (uint8_t i = 0; i < StoreSections; i++) {
+    if (sections[i].sector != STORE_NONE) {
+      size_t offset, length;
+      span(i, offset, length);
+      esp_partition_read(partition, address(sections[i].sector, sections[i].offset + sizeof(StoreRecordHeader)),
+                         (uint8_t *)&current + offset, min(length, (size_t)sections[i].length));
+    }
+  }
+
+  if (used == 0) {
+    open(0);
+  } else {
+    head = order[used - 1];
+    if (interrupted) {
+      advance();
+    }
+  }
+
+  loadMs = millis() - start;
+  storeLog.println("Store: " + String(count) + " sectors, " + String(used) + " in use, loaded in " + String(loadMs) + " ms.");
+  return true;
+}
+
+void SprinklerStore::scan(uint8_t sector) {
+  size_t offset = sizeof(StoreSectorHeader);
+  while (offset + sizeof(StoreRecordHeader) <= STORE_SECTOR_SIZE) {
+    StoreRecordHeader rec;
+    esp_partition_read(partition, address(sector, offset), &rec, sizeof(StoreRecordHeader));
+    if (rec.section == STORE_NONE && rec.length == 0xFFFF) {
+      break;  // unwritten tail
+    }
+
+    size_t size = align(sizeof(StoreRecordHeader) + rec.length);
+    bool valid = rec.section < StoreSections && offset + size <= STORE_SECTOR_SIZE;
+    if (valid) {
+      uint8_t chunk[64];
+      uint32_t crc = checksum(rec);
+      for (size_t done = 0; done < rec.length; done += sizeof(chunk)) {
+        size_t length = min(sizeof(chunk), (size_t)rec.length - done);
+        esp_partition_read(partition, address(sector, offset + sizeof(StoreRecordHeader) + done), chunk, length);
+        crc = crc32_le(crc, chunk, length);
+      }
+      valid = crc == rec.crc;
+    }
+
+    if (!valid) {
+      // torn write, nothing after it can be trusted and the space cannot be reused
+      storeLog.warn("Store: sector " + String(sector) + " ends in a torn record.");
+      offset = STORE_SECTOR_SIZE;
+      break;
+    }
+
+    Location &location = sections[rec.section];
+    if (rec.schema == CONFIG_SCHEMA && (location.sector == STORE_NONE || rec.seq > location.seq)) {
+      location = {sector, (uint16_t)offset, rec.length, rec.seq};
+    }
+    record_seq = max(record_seq, rec.seq);
+    offset += size;
+  }
+
+  head = sector;
+  head_offset = offset;
+}
+
+void SprinklerStore::erase(uint8_t sector) {
+  esp_partition_erase_range(partition, address(sector, 0), STORE_SECTOR_SIZE);
+  erases[sector]++;
+  seqs[sector] = STORE_FREE;
+
+  StoreSectorHeader header = {STORE_MAGIC, erases[sector], STORE_FREE, STORE_FREE};
+  esp_partition_write(partition, address(sector, 0), &header, offsetof(StoreSectorHeader, seq));
+}
+
+void SprinklerStore::open(uint8_t sector) {
+  seqs[sector] = ++sector_seq;
+  uint32_t seq[2] = {seqs[sector], ~seqs[sector]};
+  esp_partition_write(partition, address(sector, offsetof(StoreSectorHeader, seq)), seq, sizeof(seq));
+
+  head = sector;
+  head_offset = sizeof(StoreSectorHeader);
+}
+
+bool SprinklerStore::advance() {
+  uint8_t next = (head + 1) % count;
+  if (isUsed(next)) {
+    return false;
+  }
+
+  open(next);
+
+  // the ring is full: move the oldest sector's live records into the new head
+  uint8_t oldest = (next + 1) % count;
+  if (isUsed(oldest)) {
+    compact(oldest);
+  }
+
+  return true;
+}
+
+void SprinklerStore::compact(uint8_t sector) {
+  for (uint8_t i = 0; i < StoreSections; i++) {
+    if (sections[i].sector == sector) {
+      size_t offset, length;
+      span(i, offset, length);
+      if (!append(i, (const uint8_t *)&current + offset, length)) {
+        storeLog.error("Store: compaction failed, sector " + String(sector) + " kept.");
+        return;
+      }
+    }
+  }
+
+  erase(sector);
+  compactions++;
+}
+
+bool SprinklerStore::append(uint8_t section, const uint8_t *payload, size_t length) {
+  size_t size = align(sizeof(StoreRecordHeader) + length);
+  if (head_offset + size > STORE_SECTOR_SIZE && !advance()) {
+    return false;
+  }
+
+  StoreRecordHeader rec;
+  rec.section = section;
+  rec.schema = CONFIG_SCHEMA;
+  rec.length = length;
+  rec.seq = ++record_seq;
+  rec.crc = crc32_le(checksum(rec), payload, length);
+
+  esp_partition_write(partition, address(head, head_offset), &rec, sizeof(StoreRecordHeader));
+  esp_partition_write(partition, address(head, head_offset + sizeof(StoreRecordHeader)), payload, length);
+
+  sections[section] = {head, (uint16_t)head_offset, (uint16_t)length, rec.seq};
+  head_offset += size;
+  records++;
+  bytes += size;
+  return true;
+}
+
+bool SprinklerStore::load(SprinklerConfig &cfg) {
+  if (!partition || sections[StoreDevice].sector == STORE_NONE) {
+    return false;
+  }
+
+  memcpy((void *)&cfg, (const void *)&current, sizeof(SprinklerConfig));
+  return true;
+}
+
+size_t SprinklerStore::write(const SprinklerConfig &cfg) {
+  static SprinklerConfig image;  // keeps the caller's stack small
+
+  if (!partition) {
+    return 0;
+  }
+
+  memcpy((void *)&image, (const void *)&cfg, sizeof(SprinklerConfig));
+  for (uint8_t i = 0; i < SKETCH_MAX_ZONES; i++) {
+    normalize(image.zones[i]);
+  }
+
+  size_t written = 0;
+  for (uint8_t i = 0; i < StoreSections; i++) {
+    size_t offset, length;
+    span(i, offset, length);
+    const uint8_t *section = (const uint8_t *)&image + offset;
+    uint8_t *stored = (uint8_t *)&current + offset;
+    if (sections[i].sector != STORE_NONE && memcmp(section, stored, length) == 0) {
+      continue;
+    }
+
+    if (!append(i, section, length)) {
+      storeLog.error("Store: no free sector.");
+      break;
+    }
+    memcpy(stored, section, length);
+    written += align(sizeof(StoreRecordHeader) + length);
+  }
+
+  return written;
+}
+
+void SprinklerStore::format() {
+  if (!partition) {
+    return;
+  }
+
+  for (uint8_t s = 0; s < count; s++) {
+    erase(s);
+  }
+  for (uint8_t i = 0; i < StoreSections; i++) {
+    sections[i] = {STORE_NONE, 0, 0, 0};
+  }
+  current = SprinklerConfig();
+  open(0);
+}
+
+void SprinklerStore::toJSON(JsonWriter &json) {
+  json.beginObject().member("ready", isReady());
+  if (!partition) {
+    json.endObject();
+    return;
+  }
+
+  uint32_t least = erases[0], most = erases[0];
+  for (uint8_t s = 0; s < count; s++) {
+    least = min(least, erases[s]);
+    most = max(most, erases[s]);
+  }
+
+  json.member("sectors", count)
+      .member("head", head)
+      .member("headOffset", head_offset)
+      .member("records", records)
+      .member("bytes", bytes)
+      .member("compactions", compactions)
+      .member("loadMs", loadMs)
+      .member("minErases", least)
+      .member("maxErases", most)
+      .key("erases")
+      .beginArray();
+  for (uint8_t s = 0; s < count; s++) {
+    json.value(erases[s]);
+  }
+  json.endArray().endObject();
+}
+
+SprinklerStore Store;
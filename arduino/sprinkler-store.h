@@ -0,0 +1,106 @@
+#ifndef SPRINKLER_STORE_H
+#define SPRINKLER_STORE_H
+
+#include <Arduino.h>
+#include <esp_partition.h>
+
+#include "includes/JsonWriter.h"
+#include "sprinkler-config.h"
+
+#define STORE_PARTITION "config"   // see partitions.csv
+#define STORE_SUBTYPE 0x40
+#define STORE_SECTOR_SIZE 4096
+#define STORE_MAX_SECTORS 32
+#define STORE_MAGIC 0x474F4C53     // "SLOG"
+
+// Sections are stored as separate records, so toggling one zone's schedule
+// appends ~100 bytes instead of rewriting the whole SprinklerConfig.
+enum StoreSection {
+  StoreDevice,
+  StoreMqtt,
+  StoreSequence,
+  StoreZone,  // StoreZone + n for zone n + 1
+  StoreSections = StoreZone + SKETCH_MAX_ZONES
+};
+
+// Written right after the erase; seq/check when the sector becomes the head.
+struct StoreSectorHeader {
+  uint32_t magic;
+  uint32_t erases;
+  uint32_t seq;    // 0xFFFFFFFF while the sector is free
+  uint32_t check;  // ~seq
+};
+
+struct StoreRecordHeader {
+  uint8_t section;  // 0xFF marks the unwritten tail of a sector
+  uint8_t schema;   // CONFIG_SCHEMA of the payload
+  uint16_t length;
+  uint32_t seq;
+  uint32_t crc;     // over section, schema, length, seq and the payload
+};
+
+// the live set must fit into the single sector opened before a compaction
+static_assert(sizeof(StoreSectorHeader) + sizeof(SprinklerConfig) + StoreSections * (sizeof(StoreRecordHeader) + 3) <= STORE_SECTOR_SIZE,
+              "config sections do not fit into one store sector");
+
+// Append-only config log on a ring of flash sectors. Every change appends a
+// CRC-checked record for the sections that differ; on boot the newest valid
+// record of each section wins. One sector is always kept erased: when the head
+// moves into it and the ring is full, the live records of the oldest sector are
+// copied forward and that sector is erased, so erases rotate through the ring.
+class SprinklerStore {
+ public:
+  // find and scan the partition; false keeps the caller on EEPROM
+  bool begin();
+  bool isReady() const { return partition != nullptr; }
+
+  // fill the sections found in the log; false when there is no device record
+  bool load(SprinklerConfig &cfg);
+
+  // append the sections that changed; returns the number of bytes written
+  size_t write(const SprinklerConfig &cfg);
+
+  // erase every sector, e.g. on a factory reset
+  void format();
+
+  void toJSON(JsonWriter &json);
+
+ private:
+  struct Location {
+    uint8_t sector;  // 0xFF when the section has no record
+    uint16_t offset;
+    uint16_t length;
+    uint32_t seq;
+  };
+
+  bool isUsed(uint8_t sector) const { return seqs[sector] != 0xFFFFFFFF; }
+  size_t address(uint8_t sector, size_t offset) const { return (size_t)sector * STORE_SECTOR_SIZE + offset; }
+
+  void scan(uint8_t sector);
+  void erase(uint8_t sector);
+  void open(uint8_t sector);
+  bool advance();
+  void compact(uint8_t sector);
+  bool append(uint8_t section, const uint8_t *payload, size_t length);
+
+  const esp_partition_t *partition = nullptr;
+  uint8_t count = 0;
+  uint8_t head = 0;
+  size_t head_offset = 0;
+  uint32_t sector_seq = 0;
+  uint32_t record_seq = 0;
+
+  uint32_t seqs[STORE_MAX_SECTORS];
+  uint32_t erases[STORE_MAX_SECTORS];
+  Location sections[StoreSections];
+  SprinklerConfig current;  // last state written, to diff sections against
+
+  uint32_t records = 0;
+  uint32_t bytes = 0;
+  uint32_t compactions = 0;
+  uint32_t loadMs = 0;
+};
+
+extern SprinklerStore Store;
+
+#endif
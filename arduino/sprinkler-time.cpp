@@ -45,8 +45,24 @@ void handleTicks() {
 
   time_t t = time(nullptr);
   if (t > builtDateTime) {
-    Alarm.serviceAlarms();
+    if (Alarm.isDue()) {
+      Alarm.serviceAlarms();
+    }
   } else if (lastSyncTime == t || (t - lastSyncTime) > 60) {
     syncTime();
   }
 }
+
+unsigned long ticksDeadline() {
+  if (alarmServiceLocked || time(nullptr) <= builtDateTime) {
+    return 1000;  // retry once the schedule is unlocked or time is synced
+  }
+
+  time_t next = Alarm.getNextTrigger();
+  if (!next) {
+    return LOOP_IDLE;
+  }
+
+  time_t t = now();
+  return next > t ? (next - t) * 1000 : 0;
+}
@@ -9,6 +9,7 @@
 #include <WsConsole.h>
 
 #include "sprinkler.h"
+#include "sprinkler-loop.h"
 
 #define NTP_TIMEZONE 0
 #define NTP_SERVER1 "pool.ntp.org"
@@ -19,4 +20,6 @@ void setupTime(time_t t = 0);
 
 void handleTicks();
 
+unsigned long ticksDeadline();
+
 #endif
\ No newline at end of file
@@ -0,0 +1,168 @@
+#include <WsConsole.h>
+#include <algorithm>
+
+#include "sprinkler-timetable.h"
+
+WsConsole timetableLog("plan");
+
+void SprinklerTimetable::clear()
+{
+  // the armed alarm outlives a rebuild, arm() replaces it only if the next event moved
+  events.clear();
+}
+
+void SprinklerTimetable::add(timeDayOfWeek_t day, unsigned int h, unsigned int m, unsigned int zone, unsigned int duration)
+{
+  if (!duration || h > 23 || m > 59)
+  {
+    return;
+  }
+
+  uint32_t daySecond = h * SECS_PER_HOUR + m * SECS_PER_MIN;
+  if (day == dowInvalid)
+  {
+    // everyday timer expands into one event per weekday
+    for (uint32_t d = 0; d < DAYS_PER_WEEK; d++)
+    {
+      events.push_back({(uint32_t)(d * SECS_PER_DAY + daySecond), (uint8_t)zone, (uint16_t)duration});
+    }
+  }
+  else
+  {
+    events.push_back({(uint32_t)((day - 1) * SECS_PER_DAY + daySecond), (uint8_t)zone, (uint16_t)duration});
+  }
+}
+
+void SprinklerTimetable::add(uint32_t weekSecond, unsigned int zone, unsigned int duration)
+{
+  events.push_back({(uint32_t)(weekSecond % SECS_PER_WEEK), (uint8_t)zone, (uint16_t)duration});
+}
+
+void SprinklerTimetable::compile()
+{
+  std::sort(events.begin(), events.end());
+
+  // an everyday timer and a weekday timer at the same minute start the zone once
+  auto last = std::unique(events.begin(), events.end(), [](const SprinklerEvent &a, const SprinklerEvent &b) {
+    return a.weekSecond == b.weekSecond && a.zone == b.zone;
+  });
+  events.erase(last, events.end());
+  events.shrink_to_fit();
+}
+
+const SprinklerEvent *SprinklerTimetable::next(time_t t, time_t *at) const
+{
+  if (events.empty())
+  {
+    return nullptr;
+  }
+
+  time_t weekStart = previousSunday(t);
+  uint32_t weekSecond = t - weekStart;
+  auto it = std::upper_bound(events.begin(), events.end(), weekSecond, [](uint32_t s, const SprinklerEvent &e) {
+    return s < e.weekSecond;
+  });
+
+  if (it == events.end())
+  {
+    // wrap around into next week
+    it = events.begin();
+    weekStart += SECS_PER_WEEK;
+  }
+
+  if (at)
+  {
+    *at = weekStart + it->weekSecond;
+  }
+
+  return &*it;
+}
+
+bool SprinklerTimetable::arm()
+{
+  time_t at;
+  if (isArmed() && next(now(), &at) && at == armedAt)
+  {
+    return true;  // keep the alarm ID
+  }
+
+  disarm();
+  arm(now());
+  return isArmed();
+}
+
+void SprinklerTimetable::arm(time_t from)
+{
+  time_t at;
+  const SprinklerEvent *event = next(from, &at);
+  if (event == nullptr)
+  {
+    return;
+  }
+
+  alarm = Alarm.triggerOnce(at, [this]() { fire(); });
+  if (Alarm.isAllocated(alarm))
+  {
+    armedAt = at;
+  }
+  else
+  {
+    timetableLog.warn("failed to arm " + (String)hour(at) + ":" + (String)minute(at) + " zone " + (String)event->zone + ".");
+  }
+}
+
+void SprinklerTimetable::disarm()
+{
+  if (Alarm.isAllocated(alarm))
+  {
+    Alarm.free(alarm);
+  }
+  alarm = dtINVALID_ALARM_ID;
+}
+
+void SprinklerTimetable::fire()
+{
+  // the one-shot alarm has been released by the scheduler
+  alarm = dtINVALID_ALARM_ID;
+  time_t firedAt = armedAt;
+
+  uint32_t weekSecond = firedAt - previousSunday(firedAt);
+  auto range = std::equal_range(events.begin(), events.end(), SprinklerEvent{weekSecond, 0, 0}, [](const SprinklerEvent &a, const SprinklerEvent &b) {
+    return a.weekSecond < b.weekSecond;
+  });
+
+  for (auto it = range.first; it != range.second; it++)
+  {
+    onEvent(it->zone, it->duration);
+  }
+
+  // re-arm from the fired slot so a late service pass does not skip events
+  arm(firedAt);
+}
+
+void SprinklerTimetable::toJSON(JsonWriter &json)
+{
+  json.beginObject().member("armed", isArmed()).key("next");
+
+  time_t at;
+  const SprinklerEvent *event = next(now(), &at);
+  if (event)
+  {
+    json.beginObject()
+        .member("zone", event->zone)
+        .member("time", at)
+        .member("duration", event->duration)
+        .endObject();
+  }
+  else
+  {
+    json.null();
+  }
+
+  json.key("events").beginArray();
+  for (auto &e : events)
+  {
+    json.beginArray().value(e.weekSecond).value(e.zone).value(e.duration).endArray();
+  }
+  json.endArray().endObject();
+}
@@ -0,0 +1,62 @@
+#ifndef SPRINKLER_TIMETABLE_H
+#define SPRINKLER_TIMETABLE_H
+
+#include <Arduino.h>
+#include <TimeAlarms.h>
+#include <TimeLib.h>
+
+#include <functional>
+#include <vector>
+
+#include "includes/JsonWriter.h"
+
+#define TIMETABLE_SEQUENCE 0  // event zone that starts the configured sequence
+
+struct SprinklerEvent {
+  uint32_t weekSecond;  // seconds since Sunday 00:00
+  uint8_t zone;
+  uint16_t duration;    // minutes
+
+  bool operator<(const SprinklerEvent &other) const {
+    return weekSecond < other.weekSecond || (weekSecond == other.weekSecond && zone < other.zone);
+  }
+};
+
+// Weekly plan compiled from the zone settings into one sorted event table.
+// A single alarm is armed for the next event; next-run lookups are a binary search.
+class SprinklerTimetable {
+ public:
+  typedef std::function<void(unsigned int zone, unsigned int duration)> OnEvent;
+
+  SprinklerTimetable(OnEvent onEvent)
+      : alarm(dtINVALID_ALARM_ID), armedAt(0), onEvent(onEvent) {}
+
+  void clear();
+  void add(timeDayOfWeek_t day, unsigned int h, unsigned int m, unsigned int zone, unsigned int duration);
+  void add(uint32_t weekSecond, unsigned int zone, unsigned int duration);
+  void compile();
+
+  size_t size() const { return events.size(); }
+  const SprinklerEvent *begin() const { return events.data(); }
+  const SprinklerEvent *end() const { return events.data() + events.size(); }
+
+  // first event strictly after t; nullptr when the table is empty
+  const SprinklerEvent *next(time_t t, time_t *at = nullptr) const;
+
+  bool isArmed() { return Alarm.isAllocated(alarm); }
+  bool arm();
+  void disarm();
+
+  void toJSON(JsonWriter &json);
+
+ private:
+  void arm(time_t from);
+  void fire();
+
+  std::vector<SprinklerEvent> events;
+  AlarmID_t alarm;
+  time_t armedAt;
+  OnEvent onEvent;
+};
+
+#endif
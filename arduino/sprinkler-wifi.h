@@ -8,6 +8,7 @@
 #include <WsConsole.h>
 
 #include "Sprinkler.h"
+#include "sprinkler-loop.h"
 
 IPAddress apIP(8, 8, 4, 4);
 IPAddress subnet(255, 255, 255, 0);
@@ -116,5 +117,10 @@ void handleWifi() {
   }
 }
 
+unsigned long wifiDeadline() {
+  // new credentials are applied on the next pass
+  return (Sprinkler.wifissid().length() && !Sprinkler.connectedWifi) ? 0 : LOOP_IDLE;
+}
+
 
 #endif
@@ -2,9 +2,15 @@
 #include <WsConsole.h>
 #include <esp_wifi.h>
 #include "sprinkler.h"
+#include "sprinkler-loop.h"
+#include "sprinkler-persist.h"
+#include "sprinkler-recovery.h"
 
 WsConsole console("unit");
 
+static_assert(TIMER_MAX_DURATION <= UINT16_MAX, "run record duration is 16 bits wide");
+static_assert(TIMER_MAX_DURATION * 60UL <= UINT16_MAX, "run record remaining is 16 bits wide");
+
 const String SprinklerControl::wifissid(bool persisted) {
   if (persisted) {
     if (WiFiGenericClass::getMode() & WIFI_MODE_STA) {
@@ -35,142 +41,329 @@ void SprinklerControl::fireEvent(const char *eventType, const char *evenDescript
   }
 }
 
-void SprinklerControl::on(const char *eventType, OnEvent event) {
-  onEventHandlers[eventType].push_back(event);
+void SprinklerControl::fireState(unsigned int zone) {
+  char buffer[160];
+  JsonBuffer out(buffer, sizeof(buffer));
+  JsonWriter json(out);
+  Timers.toJSON(json, zone);
+  fireEvent("state", buffer);
 }
 
-bool SprinklerControl::isZoneInSequence(uint8_t zone) {
-  auto& seq = Device.sequence();
-  for (uint8_t i = 0; i < seq.orderCount(); i++) {
-    if (seq.order[i] == zone) return true;
-  }
-  return false;
+void SprinklerControl::fireSequence() {
+  char buffer[160];
+  JsonBuffer out(buffer, sizeof(buffer));
+  JsonWriter json(out);
+  Timers.Sequence.toJSON(json);
+  fireEvent("sequence", buffer);
 }
 
-uint8_t SprinklerControl::getZoneSequenceIndex(uint8_t zone) {
-  auto& seq = Device.sequence();
-  for (uint8_t i = 0; i < seq.orderCount(); i++) {
-    if (seq.order[i] == zone) return i;
-  }
-  return 255; // Not found
-}
-
-bool SprinklerControl::isInSequenceWindow() {
-  auto& seq = Device.sequence();
-  if (!seq.enabled || seq.orderCount() == 0) return false;
-
-  // Get current time
-  time_t now = time(nullptr);
-  struct tm* timeinfo = localtime(&now);
-  int currentDayBit = 1 << timeinfo->tm_wday; // 0=Sun, 1=Mon, etc.
-
-  // Check if today is a sequence day
-  if (!(seq.days & currentDayBit)) return false;
-
-  // Check if current time is close to sequence start (within reasonable window)
-  int currentMinutes = timeinfo->tm_hour * 60 + timeinfo->tm_min;
-  int seqStartMinutes = seq.hour * 60 + seq.minute;
-
-  // Allow 60 minute window after start time for sequence detection
-  return currentMinutes >= seqStartMinutes && currentMinutes <= seqStartMinutes + 60;
-}
-
-void SprinklerControl::startSequenceSession(uint8_t zoneIndex) {
-  auto& session = Timers.Sequence;
-  auto& seq = Device.sequence();
-
-  session.active = true;
-  session.paused = false;
-  session.currentZoneIndex = zoneIndex;
-  session.totalZones = seq.orderCount();
-
-  console.println("Sequence session started, zone index: " + String(zoneIndex));
+void SprinklerControl::on(const char *eventType, OnEvent event) {
+  onEventHandlers[eventType].push_back(event);
 }
 
 void SprinklerControl::scheduled(unsigned int zone, unsigned int duration = 0) {
   if (Timers.isEnabled())
   {
-    console.println("Scheduled timer " + (String)zone);
-
-    // Check if this is part of a sequence
-    if (isZoneInSequence(zone) && isInSequenceWindow()) {
-      uint8_t zoneIndex = getZoneSequenceIndex(zone);
+    console.info("Scheduled timer %u", zone);
 
-      if (!Timers.Sequence.active) {
-        // First zone of sequence - start session
-        startSequenceSession(zoneIndex);
-      } else {
-        // Subsequent zone - advance session
-        Timers.Sequence.currentZoneIndex = zoneIndex;
-      }
+    if (zone == TIMETABLE_SEQUENCE) {
+      startSequence();
+    } else {
+      start(zone, duration);
     }
-
-    start(zone, duration);
   }
   else
   {
-    console.println("Scheduled timer " + (String)zone + " canceled");
+    console.info("Scheduled timer %u canceled", zone);
   }
 }
 
 void SprinklerControl::start(unsigned int zone, unsigned int duration = 0) {
-  console.println("Starting timer " + (String)zone);
+  console.info("Starting timer %u", zone);
 
-  Device.turnOn(zone);  // zone first
-  Device.turnOn();      // engine last
+  Device.stage(RELAY(zone) | RELAY(0), 0);  // valve first, engine after the lead
   Device.blink(0.5);
 
   Timers.start(zone, duration, [this, zone] { stop(zone); });
-  fireEvent("state", Timers.toJSON(zone));
+  fireState(zone);
+  persist();
+}
+
+void SprinklerControl::start(const std::vector<unsigned int> &zones, unsigned int duration) {
+  RelayMask relays = 0;
+  for (unsigned int zone : zones) {
+    console.info("Starting timer %u", zone);
+    relays |= RELAY(zone);
+    Timers.start(zone, duration, [this, zone] { stop(zone); });
+  }
+
+  if (relays) {
+    Device.stage(relays | RELAY(0), 0);  // valves staggered, engine last
+    Device.blink(0.5);
+    for (unsigned int zone : zones) {
+      fireState(zone);
+    }
+    persist();
+  }
 }
 
 void SprinklerControl::stop(unsigned int zone) {
-  console.println("Stopping timer " + (String)zone);
-  if (Timers.isWatering(zone)) {
-    if (Timers.count() == 1) {
-      Device.turnOff(); 
-      Device.blink(0);
+  console.info("Stopping timer %u", zone);
+  if (Timers.isActive(zone)) {
+    if (Timers.isWatering(zone)) {  // a paused zone's relays are already off
+      bool last = Timers.count() == 1;
+      Device.stage(0, RELAY(zone) | (last ? RELAY(0) : 0));
+      if (last) {
+        Device.blink(0);
+      }
     }
-    Device.turnOff(zone);  // zone last
     Timers.stop(zone);     // detach and remove timer
-    fireEvent("state", Timers.toJSON(zone));
+    fireState(zone);
+    completeSequenceZone(zone);
+    persist();
   }
 }
 
 void SprinklerControl::stop() {
-  console.println("Stopping all");
-  Device.turnOff(); 
+  console.info("Stopping all");
+  stopSequence();
+  Device.halt();
   Device.blink(0);
-  for (size_t zone = 1; zone <= 6; zone++) {
-    Device.turnOff(zone); 
+  for (size_t zone = 1; zone <= SKETCH_MAX_ZONES; zone++) {
+    Timers.stop(zone);
   }
+  persist();
 }
 
 void SprinklerControl::pause(unsigned int zone) {
-  console.println("Pausing timer " + (String)zone);
+  console.info("Pausing timer %u", zone);
   if (Timers.isWatering(zone)) {
-    if (Timers.count() == 1) {
-      Device.turnOff();
+    bool last = Timers.count() == 1;
+    Device.stage(0, RELAY(zone) | (last ? RELAY(0) : 0));
+    if (last) {
       Device.blink(0);
     }
     Timers.pause(zone);
-    Device.turnOff(zone);
-    fireEvent("state", Timers.toJSON(zone));
+    if (Timers.Sequence.active && Timers.Sequence.currentZone == zone) {
+      Timers.Sequence.paused = true;
+    }
+    fireState(zone);
+    persist();
   }
 }
 
 void SprinklerControl::resume(unsigned int zone) {
-  console.println("Resuming timer " + (String)zone);
+  console.info("Resuming timer %u", zone);
   if (Timers.isPaused(zone)) {
     Timers.resume(zone);
-    Device.turnOn(zone);  // zone first
-    Device.turnOn();      // engine last
+    Device.stage(RELAY(zone) | RELAY(0), 0);
     Device.blink(0.5);
-    fireEvent("state", Timers.toJSON(zone));
+    if (Timers.Sequence.active && Timers.Sequence.currentZone == zone) {
+      Timers.Sequence.paused = false;
+    }
+    fireState(zone);
+    persist();
+  }
+}
+
+void SprinklerControl::persist() {
+  Recovery.save(Timers);
+}
+
+void SprinklerControl::recover() {
+  Recovery.begin();
+  Recovery.resumed(Recovery.action() == RecoveryResume);
+  const SprinklerRunRecord &record = Recovery.record();
+
+  if (Recovery.action() == RecoveryAbort) {
+    console.warn("Interrupted run discarded, reset reason " + String(Recovery.reason()));
+  } else if (Recovery.action() == RecoveryResume) {
+    console.warn("Resuming interrupted run, reset reason " + String(Recovery.reason()));
+    RelayMask relays = 0;
+    for (unsigned int zone = 1; zone <= SKETCH_MAX_ZONES; zone++) {
+      if (!(record.watering & (1UL << (zone - 1)))) {
+        continue;
+      }
+
+      Timers.start(zone, record.duration[zone - 1], [this, zone] { stop(zone); }, record.elapsed(zone));
+      if (record.paused & (1UL << (zone - 1))) {
+        Timers.pause(zone);
+      } else {
+        relays |= RELAY(zone) | RELAY(0);
+      }
+    }
+
+    if (relays) {
+      Device.stage(relays, 0);
+      Device.blink(0.5);
+    }
+
+    auto& seq = Device.sequence();
+    if (record.sequence < seq.orderCount()) {
+      auto& session = Timers.Sequence;
+      session.active = true;
+      session.totalZones = seq.orderCount();
+      session.currentZoneIndex = record.sequence;
+      session.currentZone = seq.order[record.sequence];
+      session.paused = Timers.isPaused(session.currentZone);
+      if (!Timers.isWatering(session.currentZone) && !session.paused) {
+        runSequenceZone();  // reset during the gap, skip the rest of it
+      }
+    }
+  }
+
+  persist();
+}
+
+void SprinklerControl::startSequence() {
+  auto& session = Timers.Sequence;
+  auto& seq = Device.sequence();
+
+  stopSequence();
+  if (seq.orderCount() == 0) {
+    return;
+  }
+
+  session.active = true;
+  session.totalZones = seq.orderCount();
+
+  console.info("Sequence started, %u zones", session.totalZones);
+  runSequenceZone();
+}
+
+void SprinklerControl::runSequenceZone() {
+  auto& session = Timers.Sequence;
+  auto& seq = Device.sequence();
+
+  session.waiting = false;
+  if (!session.active) {
+    return;
+  }
+
+  if (session.currentZoneIndex >= session.totalZones) {
+    console.info("Sequence finished");
+    session.reset();
+    fireSequence();
+    return;
+  }
+
+  session.currentZone = seq.order[session.currentZoneIndex];
+  start(session.currentZone, Settings.duration(session.currentZone, seq.duration));
+  fireSequence();
+}
+
+void SprinklerControl::completeSequenceZone(unsigned int zone) {
+  auto& session = Timers.Sequence;
+  auto& seq = Device.sequence();
+
+  if (!session.active || session.waiting || session.currentZone != zone) {
+    return;
+  }
+
+  session.currentZoneIndex++;
+  session.paused = false;
+
+  if (!sequenceSkip && seq.gap && session.currentZoneIndex < session.totalZones) {
+    // chain on actual completion so early stops and pauses do not drift
+    session.waiting = true;
+    sequenceGapStart = millis();
+    sequenceGapMs = (unsigned long)seq.gap * 60 * 1000;
+    fireSequence();
+    Loop.wake();  // handleSequence() picks the gap up from the loop
+  } else {
+    runSequenceZone();
+  }
+}
+
+void SprinklerControl::stopSequence() {
+  auto& session = Timers.Sequence;
+
+  if (session.active) {
+    unsigned int zone = session.waiting ? 0 : session.currentZone;
+    session.reset();
+    console.info("Sequence stopped");
+    if (zone) {
+      stop(zone);
+    }
+    fireSequence();
+  }
+}
+
+void SprinklerControl::pauseSequence() {
+  auto& session = Timers.Sequence;
+  if (!session.active || session.paused) {
+    return;
+  }
+
+  if (session.waiting) {
+    unsigned long elapsed = millis() - sequenceGapStart;
+    sequenceGapMs = elapsed < sequenceGapMs ? sequenceGapMs - elapsed : 0;
+    session.paused = true;
+  } else {
+    pause(session.currentZone);
+  }
+
+  fireSequence();
+}
+
+void SprinklerControl::resumeSequence() {
+  auto& session = Timers.Sequence;
+  if (!session.active || !session.paused) {
+    return;
+  }
+
+  if (session.waiting) {
+    session.paused = false;
+    sequenceGapStart = millis();
+    Loop.wake();
+  } else {
+    resume(session.currentZone);
   }
+
+  fireSequence();
 }
 
-bool SprinklerControl::fromJSON(JsonObject json) {
+void SprinklerControl::skipSequence() {
+  auto& session = Timers.Sequence;
+  if (!session.active) {
+    return;
+  }
+
+  console.info("Sequence skipping zone %u", session.currentZone);
+  if (session.waiting) {
+    runSequenceZone();
+    return;
+  }
+
+  unsigned int zone = session.currentZone;
+  sequenceSkip = true;  // next zone starts without the gap
+  stop(zone);
+  sequenceSkip = false;
+}
+
+unsigned long SprinklerControl::sequenceDeadline() {
+  auto& session = Timers.Sequence;
+  if (!session.active || !session.waiting || session.paused) {
+    return LOOP_IDLE;
+  }
+
+  unsigned long elapsed = millis() - sequenceGapStart;
+  return elapsed < sequenceGapMs ? sequenceGapMs - elapsed : 0;
+}
+
+void SprinklerControl::handleSequence() {
+  if (sequenceDeadline() == 0) {
+    runSequenceZone();
+  }
+}
+
+void SprinklerControl::handleRecovery() {
+  if (Recovery.deadline() == 0) {
+    persist();  // keep remaining times fresh for a resume after a reset
+  }
+}
+
+bool SprinklerControl::deviceFromJSON(JsonObject json) {
   bool dirty = false;
 
   if (json.containsKey("logLevel")) {
@@ -234,6 +427,7 @@ bool SprinklerControl::fromJSON(JsonObject json) {
     console.println("WiFi credentials changed - will reconnect");
     connectedWifi = false;
     WiFi.disconnect();
+    revisions++;
 
     dirty = true;
   }
@@ -241,6 +435,7 @@ bool SprinklerControl::fromJSON(JsonObject json) {
   if (json.containsKey("sequence")) {
     JsonVariant seqVar = json["sequence"];
     SprinklerSequenceConfig& seq = Device.sequence();
+    SprinklerSequenceConfig before = seq;
 
     if (seqVar.isNull()) {
       // Clear sequence
@@ -255,8 +450,12 @@ bool SprinklerControl::fromJSON(JsonObject json) {
       memset(seq.order, 0, sizeof(seq.order));
       uint8_t idx = 0;
       for (JsonVariant v : orderArr) {
-        if (idx < 6) {
-          seq.order[idx++] = v.as<uint8_t>();
+        unsigned int zone = v.as<unsigned int>();
+        if (zone < 1 || zone > SKETCH_MAX_ZONES) {
+          continue;  // RELAY(zone) is only defined for real zones
+        }
+        if (idx < sizeof(seq.order)) {
+          seq.order[idx++] = zone;
         }
       }
 
@@ -264,161 +463,131 @@ bool SprinklerControl::fromJSON(JsonObject json) {
       seq.days = 0;
       JsonArray daysArr = seqJson["days"].as<JsonArray>();
       for (JsonVariant v : daysArr) {
-        const char* day = v.as<const char*>();
-        if (strcmp(day, "sun") == 0) seq.days |= (1 << 0);
-        else if (strcmp(day, "mon") == 0) seq.days |= (1 << 1);
-        else if (strcmp(day, "tue") == 0) seq.days |= (1 << 2);
-        else if (strcmp(day, "wed") == 0) seq.days |= (1 << 3);
-        else if (strcmp(day, "thu") == 0) seq.days |= (1 << 4);
-        else if (strcmp(day, "fri") == 0) seq.days |= (1 << 5);
-        else if (strcmp(day, "sat") == 0) seq.days |= (1 << 6);
+        // sun..sat follow "all" in the day table
+        int8_t day = SprinklerSchedule::index(v.as<const char*>());
+        if (day > 0) seq.days |= (1 << (day - 1));
       }
 
       seq.hour = seqJson["startHour"] | 6;
       seq.minute = seqJson["startMinute"] | 0;
       seq.duration = seqJson["duration"] | 15;
       seq.gap = seqJson["gap"] | 5;
+      // Timezone offset is sent with each request; start time stays in client local time
+      seq.offset = seqJson["timezoneOffset"].as<int8_t>();
       seq.enabled = (seq.orderCount() > 0 && seq.days > 0);
     }
+    if (memcmp(&before, &seq, sizeof(SprinklerSequenceConfig)) != 0) {
+      Device.touch();
+    }
     dirty = true;
   }
 
-  // Get timezone offset for UTC conversion (sent with request, not stored)
-  int8_t timezoneOffset = 0;
-  if (json.containsKey("sequence")) {
-    JsonObject seqJson = json["sequence"].as<JsonObject>();
-    if (!seqJson.isNull() && seqJson.containsKey("timezoneOffset")) {
-      timezoneOffset = seqJson["timezoneOffset"].as<int8_t>();
-    }
+  return dirty;
+}
+
+bool SprinklerControl::fromJSON(SprinklerParser &parser) {
+  JsonObject json = parser.device();
+  bool dirty = deviceFromJSON(json);
+
+  if (parser.hasZones()) {
+    Settings.replace(parser.zones());
+    save();
+    dirty = false;
+    attach();
+  } else if (json.containsKey("sequence")) {
+    alarmServiceLocked = true;  // Prevent alarm servicing during update
+    Settings.compile();
+    alarmServiceLocked = false;
+    attach();
   }
 
-  if (json.containsKey("zones")) {
-    JsonObject zonesJson = json["zones"].as<JsonObject>();
-    SprinklerSequenceConfig& seq = Device.sequence();
+  if (dirty) {
+    save();
+  }
 
-    // If sequence has zones, calculate and override zone timers
-    if (seq.orderCount() > 0) {
-      const char* dayNames[] = {"sun", "mon", "tue", "wed", "thu", "fri", "sat"};
-
-      // Convert local time to UTC using timezone offset
-      // timezoneOffset is hours from UTC (e.g., EST = 5, so local + 5 = UTC)
-      int16_t utcMinutes = (seq.hour * 60 + seq.minute) + (timezoneOffset * 60);
-      int8_t dayShift = 0;
-      if (utcMinutes < 0) {
-        utcMinutes += 24 * 60;
-        dayShift = -1;  // Previous day in UTC
-      } else if (utcMinutes >= 24 * 60) {
-        utcMinutes -= 24 * 60;
-        dayShift = 1;   // Next day in UTC
-      }
+  // schedule, Wi-Fi or MQTT settings may have moved the loop deadlines
+  Loop.wake();
 
-      // Calculate start time for each zone in sequence
-      uint16_t currentMinutes = utcMinutes;
-
-      for (uint8_t i = 0; i < seq.orderCount(); i++) {
-        uint8_t zoneId = seq.order[i];
-        String zoneKey = String(zoneId);
-
-        // Get zone's custom duration from incoming JSON before clearing days
-        uint8_t zoneDuration = seq.duration;  // Default to template
-        if (zonesJson.containsKey(zoneKey)) {
-          JsonObject existingZone = zonesJson[zoneKey];
-          if (existingZone.containsKey("days")) {
-            JsonObject existingDays = existingZone["days"];
-            // Check any day for existing duration
-            for (JsonPair kv : existingDays) {
-              JsonArray timers = kv.value().as<JsonArray>();
-              if (timers.size() > 0) {
-                JsonObject timerObj = timers[0];
-                if (timerObj.containsKey("d") && timerObj["d"].as<uint8_t>() > 0) {
-                  zoneDuration = timerObj["d"].as<uint8_t>();
-                  break;
-                }
-              }
-            }
-          }
-        }
+  return true;
+}
 
-        // Ensure zone exists in JSON
-        if (!zonesJson.containsKey(zoneKey)) {
-          zonesJson.createNestedObject(zoneKey);
-        }
-        JsonObject zoneObj = zonesJson[zoneKey];
-
-        // Clear existing days for this zone and set sequence days
-        JsonObject daysObj = zoneObj.createNestedObject("days");
-
-        // Calculate hour and handle additional day wraparound from zone offset
-        uint8_t timerHour = (currentMinutes / 60) % 24;
-        uint8_t timerMinute = currentMinutes % 60;
-        int8_t zoneDayOffset = currentMinutes / 60 / 24;  // Additional offset from zone position
-
-        // Set timer for each day in sequence (with day shift from timezone + zone offset)
-        for (int d = 0; d < 7; d++) {
-          if (seq.days & (1 << d)) {
-            // Apply total day offset (timezone shift + zone position wraparound)
-            int adjustedDay = (d + dayShift + zoneDayOffset + 7) % 7;
-            JsonArray dayArr = daysObj.createNestedArray(dayNames[adjustedDay]);
-            JsonObject timer = dayArr.createNestedObject();
-            timer["h"] = timerHour;
-            timer["m"] = timerMinute;
-            timer["d"] = zoneDuration;  // Use zone's custom duration (or template if none)
-          }
-        }
+unsigned int SprinklerControl::patch(JsonObject json) {
+  uint32_t before = Device.revision() + revisions;
+  SprinklerSequenceConfig sequence = Device.sequence();
+  deviceFromJSON(json);
+  unsigned int changed = Device.revision() + revisions - before;
 
-        // Move to next zone's start time using zone's actual duration
-        currentMinutes += zoneDuration + seq.gap;
-      }
-    }
+  // a changed sequence moves zones in or out of the timetable
+  bool rescheduled = memcmp(&sequence, &Device.sequence(), sizeof(SprinklerSequenceConfig)) != 0;
+  if (json.containsKey("zones")) {
+    alarmServiceLocked = true;  // Prevent alarm servicing during update
+    changed += Settings.patch(json["zones"].as<JsonObject>(), rescheduled);
+    alarmServiceLocked = false;
+  }
 
-    Settings.fromJSON(zonesJson);
-    save();
-    dirty = false;
+  if (rescheduled) {
+    alarmServiceLocked = true;
+    Settings.compile();
+    alarmServiceLocked = false;
     attach();
   }
 
-  if (dirty) {
+  if (changed) {
     save();
+    Loop.wake();
   }
 
-  return true;
+  return changed;
 }
 
-String SprinklerControl::sequenceToJSON() {
+void SprinklerControl::toJSON(JsonWriter &json) {
+  json.beginObject()
+      .member("logLevel", logLevelNumber())
+      .member("alexaEnabled", Device.alexaEnabled())
+      .member("mqttHost", Device.mqttHost())
+      .member("mqttPort", Device.mqttPort())
+      .member("mqttUser", Device.mqttUser())
+      .member("mqttEnabled", Device.mqttEnabled())
+      .member("name", Device.dispname())
+      .member("ssid", wifissid())
+      .member("host", Device.hostname())
+      .key("zones");
+  Settings.toJSON(json);
+  json.key("sequence");
+  sequenceToJSON(json);
+  json.member("source", Device.source())
+      .member("enabled", isEnabled())
+      .endObject();
+}
+
+void SprinklerControl::sequenceToJSON(JsonWriter &json) {
   SprinklerSequenceConfig& seq = Device.sequence();
   uint8_t count = seq.orderCount();
 
   // Only return null if no zones configured - keep settings even with no days
   if (count == 0) {
-    return "null";
+    json.null();
+    return;
   }
 
-  String json = "{\"order\":[";
+  json.beginObject().key("order").beginArray();
   for (uint8_t i = 0; i < count; i++) {
-    if (i > 0) json += ",";
-    json += String(seq.order[i]);
+    json.value(seq.order[i]);
   }
-  json += "],\"days\":[";
+  json.endArray().key("days").beginArray();
 
   // Convert bitmask to day names
-  const char* dayNames[] = {"sun", "mon", "tue", "wed", "thu", "fri", "sat"};
-  bool first = true;
   for (int i = 0; i < 7; i++) {
     if (seq.days & (1 << i)) {
-      if (!first) json += ",";
-      json += "\"";
-      json += dayNames[i];
-      json += "\"";
-      first = false;
+      json.value(ScheduleDayKeys[i + 1]);
     }
   }
-  json += "],\"startHour\":" + String(seq.hour);
-  json += ",\"startMinute\":" + String(seq.minute);
-  json += ",\"duration\":" + String(seq.duration);
-  json += ",\"gap\":" + String(seq.gap);
-  json += "}";
-
-  return json;
+  json.endArray()
+      .member("startHour", seq.hour)
+      .member("startMinute", seq.minute)
+      .member("duration", seq.duration)
+      .member("gap", seq.gap)
+      .endObject();
 }
 
 bool SprinklerControl::isEnabled() {
@@ -440,10 +609,12 @@ bool SprinklerControl::isAttached() {
 
 void SprinklerControl::detach() {
   Settings.detach();
+  Loop.wake();
 }
 
 void SprinklerControl::attach() {
   Settings.attach();
+  Loop.wake();
 }
 
 void SprinklerControl::load() {
@@ -454,9 +625,13 @@ void SprinklerControl::load() {
 }
 
 void SprinklerControl::save() {
-  SprinklerConfig tmp = Settings.toConfig();
-  Device.save(tmp);
-  console.println(toJSON());
+  SprinklerConfig cfg = Settings.toConfig();
+  Device.toConfig(cfg);
+  Persist.stage(cfg);  // committed by the persistence task
+}
+
+void SprinklerControl::flush() {
+  Persist.flush();
 }
 
 void SprinklerControl::reset() {
@@ -464,7 +639,26 @@ void SprinklerControl::reset() {
 }
 
 void SprinklerControl::restart() {
+  flush();
   Device.restart();
 }
 
-SprinklerControl Sprinkler = SprinklerControl();
\ No newline at end of file
+SprinklerControl Sprinkler = SprinklerControl();
+
+void handleTimers() {
+  Sprinkler.Timers.handle();
+  Sprinkler.handleSequence();
+  Sprinkler.handleRecovery();
+}
+
+unsigned long timersDeadline() {
+  return min(min(Sprinkler.Timers.deadline(), Sprinkler.sequenceDeadline()), Recovery.deadline());
+}
+
+void handleRelays() {
+  Sprinkler.Device.handleRelays();
+}
+
+unsigned long relaysDeadline() {
+  return Sprinkler.Device.relaysDeadline();
+}
@@ -6,11 +6,16 @@
 #include <map>
 #include <vector>
 
+#include "includes/JsonWriter.h"
+#include "sprinkler-parser.h"
 #include "sprinkler-pinout.h"
 #include "sprinkler-device.h"
 #include "sprinkler-settings.h"
 #include "sprinkler-state.h"
 
+#define RELAY(n) ((RelayMask)1 << (n))  // relay bit: 0 = water source, n = zone n
+#define RELAY_ALL (~(RelayMask)0)
+
 class SprinklerControl {
 
  protected:
@@ -18,13 +23,13 @@ class SprinklerControl {
   String SKEY = "";
 
  public:
-  SprinklerSettings Settings;
   SprinklerDevice Device;
+  SprinklerSettings Settings;
   SprinklerState Timers;
   bool connectedWifi = false;
 
   SprinklerControl()
-   : Settings([&](SprinklerZone *zone, SprinklerTimer *timer) { scheduled(zone->index(), timer->duration()); }) {
+   : Settings(Device.sequence(), [&](unsigned int zone, unsigned int duration) { scheduled(zone, duration); }) {
   }
 
   const char * builtDateString() const { return Device.builtDateString(); }
@@ -59,34 +64,46 @@ class SprinklerControl {
     return Device.source() != Device.source(source.c_str());
   }
 
-  String toJSON() {
-    return (String) "{ \"logLevel\": " + (String)logLevelNumber() +
-      ", \"alexaEnabled\": " + (Device.alexaEnabled() ? "true" : "false") +
-      ", \"mqttHost\": \"" + Device.mqttHost() +
-      "\", \"mqttPort\": " + Device.mqttPort() +
-      ", \"mqttUser\": \"" + Device.mqttUser() +
-      "\", \"mqttEnabled\": " + (Device.mqttEnabled() ? "true" : "false") +
-      ", \"name\": \"" + Device.dispname() +
-      "\", \"ssid\": \"" + wifissid() +
-      "\", \"host\": \"" + Device.hostname() +
-      "\", \"zones\": " + Settings.toJSON() +
-      ", \"sequence\": " + sequenceToJSON() +
-      ", \"source\": \"" + Device.source() +
-      "\", \"enabled\": " + isEnabled() + " }";
-  }
+  void toJSON(JsonWriter &json);
+  void sequenceToJSON(JsonWriter &json);
 
-  String sequenceToJSON();
+  // changes whenever anything serialized by toJSON() changes
+  uint32_t revision() const { return Settings.revision() + Device.revision() + Timers.revision() + revisions; }
 
-  bool fromJSON(JsonObject json);
+  // apply a settings body streamed through the parser, replacing all zones
+  bool fromJSON(SprinklerParser &parser);
+
+  // Partial update: only the keys given are applied and zones are merged in
+  // place, so untouched zones, timers and the armed alarm survive. Returns the
+  // number of settings, zones, days and timers that actually changed.
+  unsigned int patch(JsonObject json);
 
   bool isWatering() { return Timers.isWatering(); }
 
   void start(unsigned int zone, unsigned int duration);
+  void start(const std::vector<unsigned int> &zones, unsigned int duration);
   void stop(unsigned int zone);
   void stop();
   void pause(unsigned int zone);
   void resume(unsigned int zone);
 
+  // Sequence runner: zones are chained on completion with the configured gap
+  void startSequence();
+  void stopSequence();
+  void pauseSequence();
+  void resumeSequence();
+  void skipSequence();
+
+  // start the next sequence zone once the gap is over; runs on the loop
+  void handleSequence();
+  unsigned long sequenceDeadline();
+
+  // re-save the run record once a minute while zones water; runs on the loop
+  void handleRecovery();
+
+  // Resume or discard the run interrupted by the last reset
+  void recover();
+
   bool isEnabled();
   void enable();
   void disable();
@@ -95,6 +112,7 @@ class SprinklerControl {
   void detach();
   void load();
   void save();
+  void flush();
   void reset();
   void restart();
 
@@ -105,18 +123,35 @@ class SprinklerControl {
   void fireEvent(const char *eventType) { fireEvent(eventType, ""); }
   void fireEvent(const char *eventType, const String evenDescription) { fireEvent(eventType, evenDescription.c_str()); }
   void fireEvent(const char *eventType, const char *evenDescription);
+  void fireState(unsigned int zone);
+  void fireSequence();
 
   void scheduled(unsigned int zone, unsigned int duration);
 
-  // Sequence detection helpers
-  bool isInSequenceWindow();
-  bool isZoneInSequence(uint8_t zone);
-  uint8_t getZoneSequenceIndex(uint8_t zone);
-  void startSequenceSession(uint8_t zoneIndex);
+  // device, Wi-Fi, MQTT and sequence keys shared by fromJSON() and patch()
+  bool deviceFromJSON(JsonObject json);
+
+  void runSequenceZone();
+  void completeSequenceZone(unsigned int zone);
+
+  void persist();
 
  private:
   std::map<const char *, std::vector<OnEvent>> onEventHandlers;
+
+  uint32_t revisions = 0;
+
+  bool sequenceSkip = false;
+  unsigned long sequenceGapStart = 0;
+  unsigned long sequenceGapMs = 0;
 };
 
 extern SprinklerControl Sprinkler;
+
+void handleTimers();
+unsigned long timersDeadline();
+
+void handleRelays();
+unsigned long relaysDeadline();
+
 #endif
\ No newline at end of file
@@ -0,0 +1,198 @@
+// The versioned config blob: golden images of the older layouts migrated to
+// the current SprinklerConfig, the in-place view and the rejection of
+// corrupt, truncated and newer blobs.
+
+#include <rom/crc.h>
+
+#include "sprinkler-config.h"
+#include "test.h"
+
+// Schema 1 as the header-less firmware wrote it on the ESP32 (bool 1 byte,
+// unsigned int 4 bytes aligned to 4), byte offsets of the fields
+#define V1_VERSION 0
+#define V1_LOGLEVEL 1
+#define V1_FULL_NAME 2
+#define V1_HOST_NAME 52
+#define V1_DISP_NAME 102
+#define V1_SOURCE 152
+#define V1_ALEXA 153
+#define V1_MQTT_HOST 154
+#define V1_MQTT_PORT 218
+#define V1_MQTT_USER 220
+#define V1_MQTT_PASS 252
+#define V1_MQTT_ENABLED 316
+#define V1_SEQUENCE 317  // enabled, order[6], days, hour, minute, duration, gap
+#define V1_ZONES 332
+#define V1_ZONE_SIZE 180  // defined, disp_name[50], 2 padding, days[8] of 16 bytes
+#define V1_ZONE_DAYS 52
+#define V1_SIZE (V1_ZONES + SKETCH_MAX_ZONES * V1_ZONE_SIZE)
+
+uint8_t v1[V1_SIZE];
+
+template <typename T>
+void put(uint8_t *blob, size_t offset, T value) {
+  memcpy(blob + offset, &value, sizeof(value));
+}
+
+void text(uint8_t *blob, size_t offset, const char *value) {
+  memcpy(blob + offset, value, strlen(value) + 1);
+}
+
+void timer(uint8_t *blob, unsigned int zone, unsigned int day, unsigned int h, unsigned int m, unsigned int d) {
+  size_t at = V1_ZONES + (zone - 1) * V1_ZONE_SIZE + V1_ZONE_DAYS + day * 16;
+  put<uint8_t>(blob, at, 1);
+  put<uint32_t>(blob, at + 4, h);
+  put<uint32_t>(blob, at + 8, m);
+  put<uint32_t>(blob, at + 12, d);
+}
+
+// a unit configured by the last header-less firmware
+void golden(uint8_t *blob) {
+  memset(blob, 0, V1_SIZE);
+  put<uint8_t>(blob, V1_VERSION, 1);
+  put<uint8_t>(blob, V1_LOGLEVEL, 3);
+  text(blob, V1_FULL_NAME, "sprinkler-v1.3.0.42");
+  text(blob, V1_HOST_NAME, "garden");
+  text(blob, V1_DISP_NAME, "Back Garden");
+  put<char>(blob, V1_SOURCE, 'W');
+  put<uint8_t>(blob, V1_ALEXA, 0);
+  text(blob, V1_MQTT_HOST, "broker.lan");
+  put<uint16_t>(blob, V1_MQTT_PORT, 8883);
+  text(blob, V1_MQTT_USER, "sprinkler");
+  text(blob, V1_MQTT_PASS, "secret");
+  put<uint8_t>(blob, V1_MQTT_ENABLED, 1);
+
+  const uint8_t sequence[] = {1, 3, 1, 2, 0, 0, 0, 0x41, 5, 30, 20, 2};
+  memcpy(blob + V1_SEQUENCE, sequence, sizeof(sequence));
+
+  put<uint8_t>(blob, V1_ZONES, 1);
+  text(blob, V1_ZONES + 1, "Lawn");
+  timer(blob, 1, 7, 6, 30, 20);    // everyday
+  timer(blob, 1, 3, 23, 59, 720);  // Wednesday, the longest run
+  put<uint8_t>(blob, V1_ZONES + 2 * V1_ZONE_SIZE, 1);
+  text(blob, V1_ZONES + 2 * V1_ZONE_SIZE + 1, "Roses");
+  timer(blob, 3, 0, 0, 0, 1);
+  text(blob, V1_ZONES + (SKETCH_MAX_ZONES - 1) * V1_ZONE_SIZE + 1, "Unused");
+}
+
+// the current payload behind a header of the given schema
+size_t wrap(uint8_t *blob, uint16_t schema, const uint8_t *payload, uint16_t length) {
+  SprinklerConfigHeader header = {CONFIG_MAGIC, schema, length, crc32_le(0, payload, length)};
+  memcpy(blob, &header, sizeof(header));
+  memcpy(blob + sizeof(header), payload, length);
+  return sizeof(header) + length;
+}
+
+void checkGolden(const SprinklerConfig &cfg) {
+  CHECK(cfg.version == 1);
+  CHECK(cfg.loglevel == 3);
+  CHECK(strcmp(cfg.host_name, "garden") == 0);
+  CHECK(strcmp(cfg.disp_name, "Back Garden") == 0);
+  CHECK(cfg.source == 'W');
+  CHECK(!cfg.alexa_enabled);
+  CHECK(strcmp(cfg.mqtt_host, "broker.lan") == 0);
+  CHECK(cfg.mqtt_port == 8883);
+  CHECK(strcmp(cfg.mqtt_user, "sprinkler") == 0);
+  CHECK(strcmp(cfg.mqtt_pass, "secret") == 0);
+  CHECK(cfg.mqtt_enabled);
+
+  CHECK(cfg.sequence.enabled);
+  CHECK(cfg.sequence.orderCount() == 3);
+  CHECK(cfg.sequence.order[0] == 3 && cfg.sequence.order[1] == 1 && cfg.sequence.order[2] == 2);
+  CHECK(cfg.sequence.days == 0x41);
+  CHECK(cfg.sequence.hour == 5 && cfg.sequence.minute == 30);
+  CHECK(cfg.sequence.duration == 20 && cfg.sequence.gap == 2);
+  CHECK(cfg.sequence.offset == 0);
+
+  CHECK(cfg.zones[0].defined);
+  CHECK(strcmp(cfg.zones[0].disp_name, "Lawn") == 0);
+  CHECK(cfg.zones[0].days[7].defined);
+  CHECK(cfg.zones[0].days[7].h == 6 && cfg.zones[0].days[7].m == 30 && cfg.zones[0].days[7].d == 20);
+  CHECK(cfg.zones[0].days[3].h == 23 && cfg.zones[0].days[3].m == 59 && cfg.zones[0].days[3].d == 720);
+  CHECK(!cfg.zones[0].days[0].defined);
+  CHECK(!cfg.zones[1].defined);
+  CHECK(cfg.zones[2].defined);
+  CHECK(strcmp(cfg.zones[2].disp_name, "Roses") == 0);
+  CHECK(cfg.zones[2].days[0].defined && cfg.zones[2].days[0].d == 1);
+  CHECK(!cfg.zones[SKETCH_MAX_ZONES - 1].defined);
+  CHECK(strcmp(cfg.zones[SKETCH_MAX_ZONES - 1].disp_name, "Unused") == 0);
+}
+
+int main() {
+  static uint8_t blob[2 * V1_SIZE];
+  SprinklerConfig cfg;
+
+  // the packed format is smaller than the one it replaces
+  CHECK(sizeof(SprinklerTimerConfig) == 4);
+  CHECK(sizeof(SprinklerConfigHeader) == 12);
+  CHECK(sizeof(SprinklerConfigHeader) + sizeof(SprinklerConfig) < V1_SIZE);
+  printf("config: %zu bytes, was %d\n", sizeof(SprinklerConfigHeader) + sizeof(SprinklerConfig), V1_SIZE);
+
+  // schema 1 without a header, as found in EEPROM after the upgrade
+  golden(v1);
+  memset(blob, 0xFF, sizeof(blob));  // erased flash behind the old image
+  memcpy(blob, v1, V1_SIZE);
+  CHECK(configView(blob, sizeof(blob)) == nullptr);
+  CHECK(configMigrate(blob, sizeof(blob), cfg));
+  checkGolden(cfg);
+
+  // any firmware version in full_name is accepted
+  text(blob, V1_FULL_NAME, "sprinkler-v0.9.1.7");
+  SprinklerConfig other;
+  CHECK(configMigrate(blob, sizeof(blob), other));
+  CHECK(memcmp(&other, &cfg, sizeof(cfg)) == 0);
+
+  // the upgraded unit saves in the current format and loads in place
+  memset(blob, 0xFF, sizeof(blob));
+  size_t written = configWrite(blob, sizeof(blob), cfg);
+  CHECK(written == sizeof(SprinklerConfigHeader) + sizeof(SprinklerConfig));
+  const SprinklerConfig *view = configView(blob, sizeof(blob));
+  CHECK(view == (const SprinklerConfig *)(blob + sizeof(SprinklerConfigHeader)));
+  CHECK(view && memcmp(view, &cfg, sizeof(cfg)) == 0);
+  CHECK(configView(blob, written) == view);
+  CHECK(configView(blob, written - 1) == nullptr);
+  CHECK(configWrite(blob, written - 1, cfg) == 0);
+
+  // a current blob also passes through the migration unchanged
+  CHECK(configMigrate(blob, sizeof(blob), other));
+  CHECK(memcmp(&other, &cfg, sizeof(cfg)) == 0);
+
+  // schema 1 behind a header takes the same migration
+  written = wrap(blob, 1, v1, V1_SIZE);
+  CHECK(configView(blob, written) == nullptr);
+  CHECK(configMigrate(blob, written, other));
+  CHECK(memcmp(&other, &cfg, sizeof(cfg)) == 0);
+  CHECK(!configMigrate(blob, written - 1, other));  // payload cut off
+  wrap(blob, 1, v1, V1_SIZE - 4);
+  CHECK(!configMigrate(blob, written, other));  // length of another layout
+
+  // corruption
+  written = configWrite(blob, sizeof(blob), cfg);
+  bool detected = true;
+  for (size_t i = sizeof(SprinklerConfigHeader); i < written; i += 7) {
+    blob[i] ^= 0x04;
+    detected = detected && configView(blob, written) == nullptr && !configMigrate(blob, written, other);
+    blob[i] ^= 0x04;
+  }
+  CHECK(detected);
+  CHECK(configView(blob, written) != nullptr);
+
+  // a newer firmware's layout is not downgraded
+  written = wrap(blob, CONFIG_SCHEMA + 1, (const uint8_t *)&cfg, sizeof(cfg));
+  CHECK(configView(blob, written) == nullptr);
+  CHECK(!configMigrate(blob, written, other));
+
+  // blank and foreign EEPROM
+  memset(blob, 0xFF, sizeof(blob));
+  CHECK(configView(blob, sizeof(blob)) == nullptr);
+  CHECK(!configMigrate(blob, sizeof(blob), other));
+  memset(blob, 0, sizeof(blob));
+  CHECK(!configMigrate(blob, sizeof(blob), other));
+  memcpy(blob, v1, V1_SIZE);
+  text(blob, V1_FULL_NAME, "another-v1");
+  CHECK(!configMigrate(blob, sizeof(blob), other));
+  memcpy(blob, v1, V1_SIZE);
+  CHECK(!configMigrate(blob, V1_SIZE - 1, other));
+
+  return report();
+}
@@ -0,0 +1,177 @@
+// WsConsole::write against the previous StreamString line assembly: printf
+// and print() heavy logging, long lines printed byte by byte, and the text
+// stored for them.
+
+#include "WsConsole.h"
+#include "test.h"
+
+// the ESP32 core String as StreamString used it: reserve() reallocates to
+// the exact size, indexOf() is strstr(), substring() copies
+struct CoreString {
+  char *buffer = nullptr;
+  size_t len = 0;
+  size_t capacity = 0;
+
+  CoreString() {}
+  CoreString(const char *text, size_t length) {
+    reserve(length);
+    memcpy(buffer, text, length);
+    len = length;
+    buffer[len] = 0;
+  }
+  CoreString(const CoreString &) = delete;
+  ~CoreString() { free(buffer); }
+
+  bool reserve(size_t size) {
+    if (buffer && capacity >= size) {
+      return true;
+    }
+    char *grown = (char *)realloc(buffer, size + 1);
+    hostAllocations++;
+    hostAllocated += size + 1;
+    if (!grown) {
+      return false;
+    }
+    buffer = grown;
+    capacity = size;
+    return true;
+  }
+
+  void concat(const char *text, size_t length) {
+    reserve(len + length);
+    memcpy(buffer + len, text, length);
+    len += length;
+    buffer[len] = 0;
+  }
+
+  int indexOf(const char *text) const {
+    const char *found = buffer ? strstr(buffer, text) : nullptr;
+    return found ? found - buffer : -1;
+  }
+
+  void clear() {
+    len = 0;
+    if (buffer) {
+      buffer[0] = 0;
+    }
+  }
+};
+
+LogRing previousLogs;
+
+// the previous WsConsole::write
+class PreviousConsole : public Print {
+ public:
+  size_t write(uint8_t c) override { return write(&c, 1); }
+
+  size_t write(const uint8_t *data, size_t size) override {
+    log.reserve(log.len + size + 1);  // StreamString::write
+    log.concat((const char *)data, size);
+    int index = log.indexOf("\r\n");
+    if (index != -1) {
+      CoreString line(log.buffer, index);
+      Serial.printf("[%s] %s\r\n", logScope.c_str(), line.buffer);
+      previousLogs.append(logInfo, scopeId, line.buffer, line.len);
+      CoreString rest(log.buffer + index + 2, log.len - index - 2);
+      log.clear();
+      log.concat(rest.buffer, rest.len);
+    }
+    return size;
+  }
+
+ private:
+  String logScope = "unit";
+  uint8_t scopeId = previousLogs.intern("unit");
+  CoreString log;
+};
+
+// one printf() per line
+template <typename P>
+void formatted(P &out, long i) {
+  out.printf("Zone %ld started for %ld minutes by \"%s\", next run at %02ld:%02ld\r\n", i % 8 + 1, i % 90,
+             i % 2 ? "schedule" : "sequence", i % 24, i % 60);
+}
+
+// print() chains, a write() per fragment
+template <typename P>
+void fragments(P &out, long i) {
+  out.print("Scheduled timer ");
+  out.print(i % 16);
+  out.print(" for ");
+  out.print(i % 90);
+  out.print(" minutes, next run at ");
+  out.print(i % 24);
+  out.print(':');
+  out.println(i % 60);
+}
+
+// a long line printed a byte at a time, e.g. a document serialized into the console
+template <typename P>
+void bytewise(P &out, int length) {
+  for (int i = 0; i < length; i++) {
+    out.write((uint8_t)('a' + i % 26));
+  }
+  out.println();
+}
+
+template <typename Before, typename After>
+void compare(const char *name, long lines, Before before, After after) {
+  size_t allocations = hostAllocations;
+  double previous = measure(lines, before);
+  double previousAllocations = (double)(hostAllocations - allocations) / lines;
+
+  allocations = hostAllocations;
+  double ns = measure(lines, after);
+  CHECK(hostAllocations == allocations);
+  printf("%s: %.0f -> %.0f ns per line, %.2f -> %.2f allocations per line\n", name, previous, ns,
+         previousAllocations, (double)(hostAllocations - allocations) / lines);
+}
+
+PreviousConsole previous;
+LogLine line;
+
+int main() {
+  static WsConsole console("unit");  // after the library's globals
+  console.logLevel(logInfo);
+  previous.print("");  // nothing allocated yet
+
+  compare("printf, 70 bytes", 200000, [](long i) { formatted(previous, i); }, [](long i) { formatted(console, i); });
+  compare("print() chain, 50 bytes", 200000, [](long i) { fragments(previous, i); },
+          [](long i) { fragments(console, i); });
+  const int lengths[] = {200, 1000, 4000};
+  for (int length : lengths) {
+    char name[48];
+    snprintf(name, sizeof(name), "%d bytes, byte by byte", length);
+    compare(name, 1000000 / length, [length](long) { bytewise(previous, length); },
+            [length](long) { bytewise(console, length); });
+  }
+
+  // the same text is stored for a normal line
+  LogEntry entry;
+  formatted(previous, 7);
+  formatted(console, 7);
+  CHECK(previousLogs.find(previousLogs.lastSeq(), entry));
+  CHECK(WsConsole::read(WsConsole::lastSeq(), line));
+  CHECK(strcmp(entry.text, line.text) == 0);
+  CHECK(strcmp(line.scope, "unit") == 0);
+  fragments(console, 7);
+  CHECK(WsConsole::read(WsConsole::lastSeq(), line));
+  CHECK(strcmp(line.text, "Scheduled timer 7 for 7 minutes, next run at 7:7") == 0);
+
+  // a runaway line is cut once and the rest up to its newline dropped
+  WsConsole::clearLogs();
+  bytewise(console, 300);
+  CHECK(WsConsole::read(0, line));
+  CHECK(strlen(line.text) == LOG_MAX_LINE);
+  CHECK(strcmp(line.text + LOG_MAX_LINE - 3, "...") == 0);
+  CHECK(WsConsole::lastSeq() == line.seq);
+
+  // a bare newline ends a line, a "\r\n" split across writes too
+  console.print("bare newline\n");
+  CHECK(WsConsole::read(WsConsole::lastSeq(), line) && strcmp(line.text, "bare newline") == 0);
+  console.print("split\r");
+  console.print("\n");
+  CHECK(WsConsole::read(WsConsole::lastSeq(), line) && strcmp(line.text, "split") == 0);
+
+  return report();
+}
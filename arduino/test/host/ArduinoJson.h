@@ -0,0 +1,11 @@
+// Host stand-in for ArduinoJson: the types the sketch headers name. Modules
+// that parse JSON are not built on the host.
+
+#ifndef ARDUINOJSON_H
+#define ARDUINOJSON_H
+
+class JsonObject {};
+class JsonArray {};
+class JsonVariant {};
+
+#endif
@@ -0,0 +1,44 @@
+// Host stand-in for the ESPAsyncWebServer WebSocket, enough for WsConsole:
+// clients are added by the test and keep the frames sent to them.
+
+#ifndef ASYNCWEBSOCKET_H_
+#define ASYNCWEBSOCKET_H_
+
+#include <Arduino.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+typedef enum { WS_DISCONNECTED, WS_CONNECTED, WS_DISCONNECTING } AwsClientStatus;
+
+class AsyncClient {
+ public:
+  size_t space() { return sendBuffer; }
+  size_t sendBuffer = 5744;  // free TCP send buffer
+};
+
+class AsyncWebSocketClient {
+ public:
+  AwsClientStatus status() { return WS_CONNECTED; }
+  AsyncClient *client() { return &tcp; }
+  bool queueIsFull() { return full; }
+  void text(const char *message, size_t length) { frames.emplace_back(message, length); }
+
+  AsyncClient tcp;
+  bool full = false;
+  std::vector<std::string> frames;
+};
+
+class AsyncWebSocket {
+ public:
+  AsyncWebSocketClient *client(uint32_t id) {
+    auto found = clients.find(id);
+    return found == clients.end() ? nullptr : &found->second;
+  }
+  void cleanupClients(uint16_t max) { (void)max; }
+
+  std::map<uint32_t, AsyncWebSocketClient> clients;
+};
+
+#endif
@@ -0,0 +1,63 @@
+// Host stand-in for the Time library: its macros, with now() on the wall
+// clock of host.h.
+
+#ifndef _Time_h
+#define _Time_h
+
+#include <stdint.h>
+#include <time.h>
+
+typedef enum {
+  dowInvalid,
+  dowSunday,
+  dowMonday,
+  dowTuesday,
+  dowWednesday,
+  dowThursday,
+  dowFriday,
+  dowSaturday
+} timeDayOfWeek_t;
+
+typedef struct {
+  uint8_t Second;
+  uint8_t Minute;
+  uint8_t Hour;
+  uint8_t Wday;  // day of week, sunday is day 1
+  uint8_t Day;
+  uint8_t Month;
+  uint8_t Year;  // offset from 1970
+} tmElements_t;
+
+#define SECS_PER_MIN ((time_t)(60UL))
+#define SECS_PER_HOUR ((time_t)(3600UL))
+#define SECS_PER_DAY ((time_t)(SECS_PER_HOUR * 24UL))
+#define DAYS_PER_WEEK ((time_t)(7UL))
+#define SECS_PER_WEEK ((time_t)(SECS_PER_DAY * DAYS_PER_WEEK))
+#define SECS_PER_YEAR ((time_t)(SECS_PER_DAY * 365UL))
+
+#define numberOfSeconds(_time_) ((_time_) % SECS_PER_MIN)
+#define numberOfMinutes(_time_) (((_time_) / SECS_PER_MIN) % SECS_PER_MIN)
+#define numberOfHours(_time_) (((_time_) % SECS_PER_DAY) / SECS_PER_HOUR)
+#define dayOfWeek(_time_) ((((_time_) / SECS_PER_DAY + 4) % DAYS_PER_WEEK) + 1)
+#define elapsedDays(_time_) ((_time_) / SECS_PER_DAY)
+#define elapsedSecsToday(_time_) ((_time_) % SECS_PER_DAY)
+#define previousMidnight(_time_) (((_time_) / SECS_PER_DAY) * SECS_PER_DAY)
+#define nextMidnight(_time_) (previousMidnight(_time_) + SECS_PER_DAY)
+#define elapsedSecsThisWeek(_time_) (elapsedSecsToday(_time_) + ((dayOfWeek(_time_) - 1) * SECS_PER_DAY))
+#define previousSunday(_time_) ((_time_) - elapsedSecsThisWeek(_time_))
+#define nextSunday(_time_) (previousSunday(_time_) + SECS_PER_WEEK)
+
+time_t now();
+
+int hour(time_t t);
+int minute(time_t t);
+int second(time_t t);
+int weekday(time_t t);
+int hour();
+int minute();
+int weekday();
+
+void breakTime(time_t time, tmElements_t &tm);
+time_t makeTime(const tmElements_t &tm);
+
+#endif
@@ -0,0 +1,78 @@
+// Host stand-in for the Arduino String.
+
+#ifndef String_class_h
+#define String_class_h
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include <string>
+
+#define DEC 10
+#define HEX 16
+
+// Arduino String over std::string, with the members the firmware calls
+class String {
+ public:
+  String() {}
+  String(const char *text) : s(text ? text : "") {}
+  String(const std::string &text) : s(text) {}
+  explicit String(char c) : s(1, c) {}
+  explicit String(int v, unsigned char base = DEC) : s(number(v, base)) {}
+  explicit String(unsigned int v, unsigned char base = DEC) : s(number(v, base)) {}
+  explicit String(long v, unsigned char base = DEC) : s(number(v, base)) {}
+  explicit String(unsigned long v, unsigned char base = DEC) : s(number(v, base)) {}
+  explicit String(float v, unsigned int decimals = 2) : s(fixed(v, decimals)) {}
+  explicit String(double v, unsigned int decimals = 2) : s(fixed(v, decimals)) {}
+
+  const char *c_str() const { return s.c_str(); }
+  unsigned int length() const { return s.size(); }
+  bool isEmpty() const { return s.empty(); }
+  bool reserve(unsigned int size) { s.reserve(size); return true; }
+
+  bool concat(const String &text) { s += text.s; return true; }
+  bool concat(const char *text) { s += text; return true; }
+  bool concat(const char *text, unsigned int length) { s.append(text, length); return true; }
+  bool concat(char c) { s += c; return true; }
+
+  String &operator+=(const String &text) { s += text.s; return *this; }
+  String &operator+=(const char *text) { s += text; return *this; }
+  String &operator+=(char c) { s += c; return *this; }
+
+  char operator[](unsigned int index) const { return index < s.size() ? s[index] : 0; }
+  bool operator==(const String &other) const { return s == other.s; }
+  bool operator==(const char *other) const { return s == other; }
+  bool operator!=(const String &other) const { return s != other.s; }
+  bool operator<(const String &other) const { return s < other.s; }
+  bool equals(const char *other) const { return s == other; }
+  bool equalsIgnoreCase(const String &other) const { return strcasecmp(c_str(), other.c_str()) == 0; }
+  bool startsWith(const char *prefix) const { return s.compare(0, strlen(prefix), prefix) == 0; }
+
+  int indexOf(char c, unsigned int from = 0) const { return found(s.find(c, from)); }
+  int indexOf(const char *text, unsigned int from = 0) const { return found(s.find(text, from)); }
+  String substring(unsigned int from) const { return from < s.size() ? s.substr(from) : ""; }
+  String substring(unsigned int from, unsigned int to) const { return from < to && from < s.size() ? s.substr(from, to - from) : ""; }
+  void replace(const char *from, const char *to);
+  void remove(unsigned int index, unsigned int count = ~0u) { if (index < s.size()) s.erase(index, count); }
+  void toLowerCase() { for (char &c : s) c = tolower(c); }
+  void trim();
+  long toInt() const { return atol(c_str()); }
+
+  friend String operator+(const String &a, const String &b) { return a.s + b.s; }
+  friend String operator+(const String &a, const char *b) { return a.s + b; }
+  friend String operator+(const char *a, const String &b) { return a + b.s; }
+  friend String operator+(const String &a, char b) { return a.s + b; }
+
+ private:
+  static std::string number(unsigned long v, unsigned char base, bool negative = false);
+  static std::string number(long v, unsigned char base) { return v < 0 && base == DEC ? number((unsigned long)-v, base, true) : number((unsigned long)v, base); }
+  static std::string number(int v, unsigned char base) { return number((long)v, base); }
+  static std::string number(unsigned int v, unsigned char base) { return number((unsigned long)v, base); }
+  static std::string fixed(double v, unsigned int decimals);
+  static int found(size_t at) { return at == std::string::npos ? -1 : (int)at; }
+
+  std::string s;
+};
+
+#endif
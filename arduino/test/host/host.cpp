@@ -0,0 +1,361 @@
+#include "host.h"
+
+#include <Arduino.h>
+#include <TimeLib.h>
+#include <esp_partition.h>
+#include <esp_timer.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <rom/crc.h>
+
+#include <new>
+#include <vector>
+
+int64_t hostMicros = 0;
+time_t hostTime = 0;
+esp_reset_reason_t hostResetReason = ESP_RST_POWERON;
+size_t hostAllocations = 0;
+size_t hostAllocated = 0;
+uint32_t hostNotifications = 0;
+long hostFlashBudget = -1;
+
+HardwareSerial Serial;
+
+// heap
+
+void *operator new(size_t size) {
+  hostAllocations++;
+  hostAllocated += size;
+  void *p = malloc(size ? size : 1);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+
+// clock
+
+struct HostTimer {
+  esp_timer_cb_t callback;
+  void *arg;
+  int64_t deadline;
+  bool armed;
+};
+
+static std::vector<HostTimer *> &timers() {
+  static std::vector<HostTimer *> all;
+  return all;
+}
+
+void hostAdvance(int64_t us) {
+  int64_t target = hostMicros + us;
+  for (;;) {
+    HostTimer *next = nullptr;
+    for (HostTimer *timer : timers()) {
+      if (timer->armed && timer->deadline <= target && (!next || timer->deadline < next->deadline)) {
+        next = timer;
+      }
+    }
+    if (!next) {
+      break;
+    }
+    if (next->deadline > hostMicros) {
+      hostMicros = next->deadline;
+    }
+    next->armed = false;
+    next->callback(next->arg);
+  }
+  hostMicros = target;
+}
+
+unsigned long millis() { return (unsigned long)(hostMicros / 1000); }
+unsigned long micros() { return (unsigned long)hostMicros; }
+void delay(unsigned long ms) { hostAdvance((int64_t)ms * 1000); }
+
+int64_t esp_timer_get_time() { return hostMicros; }
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *timer) {
+  *timer = new HostTimer{args->callback, args->arg, 0, false};
+  timers().push_back(*timer);
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+  timer->deadline = hostMicros + (int64_t)timeout_us;
+  timer->armed = true;
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+  timer->armed = false;
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+  auto &all = timers();
+  all.erase(std::remove(all.begin(), all.end(), timer), all.end());
+  delete timer;
+  return ESP_OK;
+}
+
+time_t now() { return hostTime; }
+
+int hour(time_t t) { return numberOfHours(t); }
+int minute(time_t t) { return numberOfMinutes(t); }
+int second(time_t t) { return numberOfSeconds(t); }
+int weekday(time_t t) { return dayOfWeek(t); }
+int hour() { return hour(now()); }
+int minute() { return minute(now()); }
+int weekday() { return weekday(now()); }
+
+void breakTime(time_t time, tmElements_t &tm) {
+  struct tm t;
+  gmtime_r(&time, &t);
+  tm.Second = t.tm_sec;
+  tm.Minute = t.tm_min;
+  tm.Hour = t.tm_hour;
+  tm.Wday = t.tm_wday + 1;
+  tm.Day = t.tm_mday;
+  tm.Month = t.tm_mon + 1;
+  tm.Year = t.tm_year - 70;
+}
+
+time_t makeTime(const tmElements_t &tm) {
+  struct tm t = {};
+  t.tm_sec = tm.Second;
+  t.tm_min = tm.Minute;
+  t.tm_hour = tm.Hour;
+  t.tm_mday = tm.Day;
+  t.tm_mon = tm.Month - 1;
+  t.tm_year = tm.Year + 70;
+  return timegm(&t);
+}
+
+esp_reset_reason_t esp_reset_reason() { return hostResetReason; }
+
+// FreeRTOS, single threaded
+
+static TaskHandle_t hostTask = (TaskHandle_t)&hostNotifications;
+
+BaseType_t xTaskCreate(TaskFunction_t, const char *, uint32_t, void *, UBaseType_t, TaskHandle_t *task) {
+  if (task) {
+    *task = hostTask;
+  }
+  return pdPASS;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() { return hostTask; }
+void xTaskNotifyGive(TaskHandle_t) { hostNotifications++; }
+void vTaskNotifyGiveFromISR(TaskHandle_t, BaseType_t *) { hostNotifications++; }
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t) {
+  uint32_t taken = hostNotifications;
+  hostNotifications = clear ? 0 : (taken ? taken - 1 : 0);
+  return taken;
+}
+
+struct HostQueue {
+  uint8_t *storage;
+  UBaseType_t length;
+  UBaseType_t itemSize;
+  UBaseType_t head;
+  UBaseType_t count;
+};
+
+static_assert(sizeof(HostQueue) <= sizeof(StaticQueue_t), "StaticQueue_t holds the host queue");
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t itemSize, uint8_t *storage, StaticQueue_t *buffer) {
+  return new (buffer) HostQueue{storage, length, itemSize, 0, 0};
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t) {
+  if (queue->count == queue->length) {
+    return pdFALSE;
+  }
+  UBaseType_t tail = (queue->head + queue->count) % queue->length;
+  memcpy(queue->storage + tail * queue->itemSize, item, queue->itemSize);
+  queue->count++;
+  return pdTRUE;
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void *item, BaseType_t *) {
+  return xQueueSend(queue, item, 0);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t) {
+  if (queue->count == 0) {
+    return pdFALSE;
+  }
+  memcpy(item, queue->storage + queue->head * queue->itemSize, queue->itemSize);
+  queue->head = (queue->head + 1) % queue->length;
+  queue->count--;
+  return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) { return queue->count; }
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *buffer) { return (SemaphoreHandle_t)buffer; }
+BaseType_t xSemaphoreTake(SemaphoreHandle_t, TickType_t) { return pdTRUE; }
+BaseType_t xSemaphoreGive(SemaphoreHandle_t) { return pdTRUE; }
+
+// ROM
+
+uint32_t crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len) {
+  crc = ~crc;
+  while (len--) {
+    crc ^= *buf++;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+    }
+  }
+  return ~crc;
+}
+
+// flash
+
+static esp_partition_t hostConfigPartition = {ESP_PARTITION_TYPE_DATA, 0x40, 0x290000, 0, "config"};
+
+static std::vector<uint8_t> &flash() {
+  static std::vector<uint8_t> bytes;
+  return bytes;
+}
+
+static std::vector<uint32_t> &erases() {
+  static std::vector<uint32_t> counts;
+  return counts;
+}
+
+void hostPartition(size_t size) {
+  hostConfigPartition.size = size;
+  flash().assign(size, 0xFF);
+  erases().assign(size / SPI_FLASH_SEC_SIZE, 0);
+}
+
+uint8_t *hostFlash() { return flash().data(); }
+uint32_t hostSectorErases(size_t sector) { return erases()[sector]; }
+
+// false once the power is cut
+static bool powered() {
+  if (hostFlashBudget == 0) {
+    return false;
+  }
+  if (hostFlashBudget > 0) {
+    hostFlashBudget--;
+  }
+  return true;
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char *label) {
+  const esp_partition_t &p = hostConfigPartition;
+  if (p.size == 0 || type != p.type || subtype != p.subtype || (label && strcmp(label, p.label) != 0)) {
+    return nullptr;
+  }
+  return &p;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size) {
+  if (src_offset + size > partition->size) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  memcpy(dst, flash().data() + src_offset, size);
+  return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src, size_t size) {
+  if (dst_offset + size > partition->size) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  if (powered()) {
+    const uint8_t *bytes = (const uint8_t *)src;
+    for (size_t i = 0; i < size; i++) {
+      flash()[dst_offset + i] &= bytes[i];
+    }
+  }
+  return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size) {
+  if (offset % SPI_FLASH_SEC_SIZE || size % SPI_FLASH_SEC_SIZE) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (offset + size > partition->size) {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  if (powered()) {
+    memset(flash().data() + offset, 0xFF, size);
+    for (size_t s = offset / SPI_FLASH_SEC_SIZE; s < (offset + size) / SPI_FLASH_SEC_SIZE; s++) {
+      erases()[s]++;
+    }
+  }
+  return ESP_OK;
+}
+
+// Arduino core
+
+void pinMode(uint8_t, uint8_t) {}
+void digitalWrite(uint8_t, uint8_t) {}
+int digitalRead(uint8_t) { return LOW; }
+
+size_t HardwareSerial::write(uint8_t) { return 1; }
+size_t HardwareSerial::write(const uint8_t *, size_t size) { return size; }
+
+size_t Print::printf(const char *format, ...) {
+  char line[256];
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(line, sizeof(line), format, args);
+  va_end(args);
+  if (length < 0) {
+    return 0;
+  }
+  if ((size_t)length < sizeof(line)) {
+    return write((const uint8_t *)line, length);
+  }
+
+  std::vector<char> text(length + 1);
+  va_start(args, format);
+  vsnprintf(text.data(), text.size(), format, args);
+  va_end(args);
+  return write((const uint8_t *)text.data(), length);
+}
+
+std::string String::number(unsigned long v, unsigned char base, bool negative) {
+  char digits[34];
+  size_t at = sizeof(digits);
+  do {
+    digits[--at] = "0123456789abcdef"[v % base];
+    v /= base;
+  } while (v);
+  if (negative) {
+    digits[--at] = '-';
+  }
+  return std::string(digits + at, sizeof(digits) - at);
+}
+
+std::string String::fixed(double v, unsigned int decimals) {
+  char text[64];
+  snprintf(text, sizeof(text), "%.*f", decimals, v);
+  return text;
+}
+
+void String::replace(const char *from, const char *to) {
+  size_t length = strlen(from);
+  if (!length) {
+    return;
+  }
+  for (size_t at = s.find(from); at != std::string::npos; at = s.find(from, at + strlen(to))) {
+    s.replace(at, length, to);
+  }
+}
+
+void String::trim() {
+  size_t first = s.find_first_not_of(" \t\r\n");
+  size_t last = s.find_last_not_of(" \t\r\n");
+  s = first == std::string::npos ? "" : s.substr(first, last - first + 1);
+}
@@ -0,0 +1,43 @@
+// Controls of the host stand-ins, used by the tests and benchmarks.
+
+#ifndef HOST_H
+#define HOST_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <esp_system.h>
+
+// virtual clock behind millis(), micros() and esp_timer_get_time()
+extern int64_t hostMicros;
+
+// wall clock behind now(), seconds since 1970
+extern time_t hostTime;
+
+// move the virtual clock, firing the esp_timers that come due on the way
+void hostAdvance(int64_t us);
+
+// reset reason esp_reset_reason() reports
+extern esp_reset_reason_t hostResetReason;
+
+// operator new calls and bytes since start
+extern size_t hostAllocations;
+extern size_t hostAllocated;
+
+// task notifications given and not yet taken
+extern uint32_t hostNotifications;
+
+// the data partition behind esp_partition_*: size 0 removes it, any other
+// size makes a blank one with fresh erase counts
+void hostPartition(size_t size);
+
+// its bytes, and erase_range calls per 4 KB sector since hostPartition()
+uint8_t *hostFlash();
+uint32_t hostSectorErases(size_t sector);
+
+// flash writes and erases left before the power is cut; once spent, further
+// ones are dropped until it is set again. -1 never cuts
+extern long hostFlashBudget;
+
+#endif
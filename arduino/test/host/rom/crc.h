@@ -0,0 +1,9 @@
+#ifndef ROM_CRC_H
+#define ROM_CRC_H
+
+#include <stdint.h>
+
+// CRC-32 as the ROM computes it: reflected 0xEDB88320, crc inverted in and out
+uint32_t crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len);
+
+#endif
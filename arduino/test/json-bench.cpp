@@ -0,0 +1,185 @@
+// JsonWriter against the String concatenation the toJSON() methods used
+// before: heap allocations, bytes allocated and time for the /api/settings
+// document of a fully scheduled unit, and the state of every zone.
+
+#include "includes/JsonWriter.h"
+#include "sprinkler-loop.h"
+#include "sprinkler-state.h"
+#include "test.h"
+
+#define ITERATIONS 20000L
+#define TIMERS 2  // per day
+
+static const char *const dayIds[] = {"everyday", "fri", "mon", "sat", "sun", "thu", "tue", "wed"};
+static const char *const names[] = {"Lawn", "Roses", "Hedge", "Orchard", "Greenhouse", "Patio", "Vegetables", "Drip"};
+
+unsigned int duration(unsigned int zone, unsigned int day, unsigned int t) { return 5 + zone + day + t; }
+unsigned int hourOf(unsigned int day, unsigned int t) { return (5 + day + 12 * t) % 24; }
+unsigned int minuteOf(unsigned int zone, unsigned int t) { return (zone * 10 + t * 5) % 60; }
+
+// the String chains of SprinklerSettings, SprinklerZone, SprinklerSchedule,
+// ScheduleDay and SprinklerTimer before the writer
+String previousTimer(unsigned int zone, unsigned int day, unsigned int t) {
+  return "{ \"d\": " + (String)duration(zone, day, t) + ", \"h\": " + (String)hourOf(day, t) +
+         ", \"m\": " + (String)minuteOf(zone, t) + " }";
+}
+
+String previousDay(unsigned int zone, unsigned int day) {
+  String json = "[";
+  String coma = "";
+  for (unsigned int t = 0; t < TIMERS; t++) {
+    json += coma + previousTimer(zone, day, t);
+    coma = ",";
+  }
+  json += "]";
+
+  return json;
+}
+
+String previousSchedule(unsigned int zone) {
+  String json = "{";
+  String coma = "";
+  for (unsigned int day = 0; day < 8; day++) {
+    String dayid = dayIds[day];
+    json += coma + "\"" + dayid + "\": " + previousDay(zone, day);
+    coma = ",";
+  }
+  json += "}";
+  return json;
+}
+
+String previousZone(unsigned int zone) {
+  return "{\"name\": \"" + String(names[zone - 1]) + "\", \"days\": " + previousSchedule(zone) + "}";
+}
+
+String previousSettings() {
+  String json = "{";
+  String coma = "";
+  for (unsigned int zoneid = 1; zoneid <= SKETCH_MAX_ZONES; zoneid++) {
+    json += coma + "\"" + (String)zoneid + "\": " + previousZone(zoneid);
+    coma = ",";
+  }
+  json += "}";
+  return json;
+}
+
+// the same document through the writer, as the toJSON() methods do now
+void settings(JsonWriter &json) {
+  json.beginObject();
+  for (unsigned int zone = 1; zone <= SKETCH_MAX_ZONES; zone++) {
+    json.key(zone).beginObject().member("name", names[zone - 1]).key("days").beginObject();
+    for (unsigned int day = 0; day < 8; day++) {
+      json.key(dayIds[day]).beginArray();
+      for (unsigned int t = 0; t < TIMERS; t++) {
+        json.beginObject()
+            .member("d", duration(zone, day, t))
+            .member("h", hourOf(day, t))
+            .member("m", minuteOf(zone, t))
+            .endObject();
+      }
+      json.endArray();
+    }
+    json.endObject().endObject();
+  }
+  json.endObject();
+}
+
+// counts what an AsyncResponseStream would be handed
+class CountingPrint : public Print {
+ public:
+  size_t write(uint8_t) override { return write(nullptr, 1); }
+  size_t write(const uint8_t *, size_t count) override {
+    bytes += count;
+    return count;
+  }
+
+  size_t bytes = 0;
+};
+
+std::string squeeze(const char *json) {
+  std::string s;
+  for (; *json; json++) {
+    if (*json != ' ') {
+      s += *json;
+    }
+  }
+  return s;
+}
+
+static char buffer[4096];
+SprinklerState state;
+volatile size_t sink;
+
+int main() {
+  // same document, less the spaces
+  String previous = previousSettings();
+  JsonBuffer out(buffer, sizeof(buffer));
+  JsonWriter json(out);
+  settings(json);
+  CHECK(!out.isOverflow());
+  CHECK(json.length() == strlen(buffer));
+  CHECK(squeeze(previous.c_str()) == buffer);
+
+  size_t allocations = hostAllocations, allocated = hostAllocated;
+  double ns = measure(ITERATIONS, [](long) { sink = previousSettings().length(); });
+  double previousAllocations = (double)(hostAllocations - allocations) / ITERATIONS;
+  double previousAllocated = (double)(hostAllocated - allocated) / ITERATIONS;
+  printf("String concatenation: %.0f ns, %.0f allocations, %.0f bytes allocated for %u bytes of JSON\n", ns,
+         previousAllocations, previousAllocated, previous.length());
+
+  allocations = hostAllocations;
+  allocated = hostAllocated;
+  ns = measure(ITERATIONS, [](long) {
+    JsonBuffer out(buffer, sizeof(buffer));
+    JsonWriter json(out);
+    settings(json);
+    sink = json.length();
+  });
+  CHECK(hostAllocations == allocations);
+  printf("JsonWriter into JsonBuffer: %.0f ns, %zu allocations, %zu bytes allocated for %zu bytes of JSON\n", ns,
+         hostAllocations - allocations, hostAllocated - allocated, strlen(buffer));
+
+  CountingPrint counter;
+  allocations = hostAllocations;
+  {
+    JsonWriter json(counter);
+    settings(json);
+    CHECK(counter.bytes == strlen(buffer));
+  }
+  CHECK(hostAllocations == allocations);
+  CHECK(previousAllocations > 100);
+
+  // the state of every zone, sent on each /api/state poll
+  Loop.begin();
+  for (unsigned int zone = 1; zone <= SKETCH_MAX_ZONES; zone++) {
+    state.start(zone, 10 * zone, [] {});
+  }
+  state.pause(2);
+  hostAdvance(90 * 1000 * 1000LL);
+  allocations = hostAllocations;
+  ns = measure(ITERATIONS, [](long) {
+    JsonBuffer out(buffer, sizeof(buffer));
+    JsonWriter json(out);
+    state.toJSON(json);
+    sink = json.length();
+  });
+  CHECK(hostAllocations == allocations);
+  CHECK(strstr(buffer, "\"state\":\"paused\"") != nullptr);
+  printf("SprinklerState::toJSON: %.0f ns, %zu allocations for %zu bytes of JSON\n", ns,
+         hostAllocations - allocations, strlen(buffer));
+
+  // escaping, which the concatenation never did
+  JsonBuffer escaped(buffer, sizeof(buffer));
+  JsonWriter names(escaped);
+  names.beginArray().value("Mum's \"rose\" bed\\\n\t\x01").endArray();
+  CHECK(strcmp(buffer, "[\"Mum's \\\"rose\\\" bed\\\\\\n\\t\\u0001\"]") == 0);
+
+  char small[16];
+  JsonBuffer tight(small, sizeof(small));
+  JsonWriter cut(tight);
+  settings(cut);
+  CHECK(tight.isOverflow());
+  CHECK(strlen(small) < sizeof(small));
+
+  return report();
+}
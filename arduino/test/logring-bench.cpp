@@ -0,0 +1,113 @@
+// LogRing against the previous std::vector<log_t> store of WsConsole: 100k
+// log lines, heap allocations and time per line, and the ring invariants
+// over 200k appends of random length.
+
+#include <WString.h>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "LogRing.h"
+#include "test.h"
+
+#define LINES 100000L
+
+// the previous WsConsole store: two Strings per line, the oldest erased from
+// the front once 1000 lines are held
+struct log_t {
+  int level;
+  String scope;
+  String entry;
+};
+
+std::vector<log_t> logs;
+
+void broadcast(log_t log) {
+  log.scope.replace("\"", "\\\"");
+  log.scope.replace("\r", "");
+  log.scope.replace("\n", "");
+  log.entry.replace("\"", "\\\"");
+  log.entry.replace("\r", "");
+  log.entry.replace("\n", "");
+
+  logs.push_back(log);
+
+  if (logs.size() > 1000) {
+    logs.erase(logs.begin());
+  }
+}
+
+int format(char *line, size_t size, long i) {
+  return snprintf(line, size, "Zone %ld started for %ld minutes by \"schedule\" at tick %ld", i % 8 + 1, i % 60, i);
+}
+
+LogRing ring;
+
+// the ring holds a contiguous suffix of what was appended, texts intact
+bool invariants() {
+  static LogRing r;
+  std::deque<std::pair<uint32_t, std::string>> appended;
+  srand(7);
+  for (int i = 0; i < 200000; i++) {
+    std::string text(rand() % 300, 'a' + i % 26);
+    uint32_t seq = r.append(1, r.intern(i % 2 ? "plan" : "save"), text.data(), text.size());
+    appended.push_back({seq, text.substr(0, LOG_MAX_LINE)});
+    if (appended.size() > 2000) {
+      appended.pop_front();
+    }
+
+    if (i % 997 == 0 || i > 199990) {
+      size_t n = 0;
+      uint32_t expect = seq - r.count() + 1;
+      bool ok = r.bytes() <= r.capacity() && r.firstSeq() == expect && r.lastSeq() == seq;
+      r.forEach([&](const LogEntry &e) {
+        const auto &kept = appended[appended.size() - r.count() + n++];
+        ok = ok && e.seq == expect++ && kept.first == e.seq;
+        ok = ok && kept.second == std::string(e.text, e.length) && strlen(e.text) == e.length;
+      });
+      if (!ok || n != r.count() || expect != seq + 1) {
+        printf("ring invariant broken at append %d\n", i);
+        return false;
+      }
+    }
+  }
+  printf("200000 appends: %zu records in %zu bytes held, %u evicted\n", r.count(), r.bytes(), r.evicted());
+  return true;
+}
+
+int main() {
+  CHECK(invariants());
+
+  size_t allocations = hostAllocations, allocated = hostAllocated;
+  double ns = measure(LINES, [](long i) {
+    char line[96];
+    int n = format(line, sizeof(line), i);
+    broadcast(log_t{3, "plan", String(std::string(line, n))});
+  });
+  printf("previous vector<log_t>: %.0f ns per line, %.2f allocations per line (%zu bytes), %zu lines kept\n", ns,
+         (double)(hostAllocations - allocations) / LINES, hostAllocated - allocated, logs.size());
+
+  uint8_t scope = ring.intern("plan");
+  allocations = hostAllocations;
+  ns = measure(LINES, [scope](long i) {
+    char line[96];
+    int n = format(line, sizeof(line), i);
+    ring.append(3, scope, line, n);
+  });
+  CHECK(hostAllocations == allocations);
+  CHECK(ring.lastSeq() == LINES);
+  CHECK(ring.count() > 100 && ring.bytes() <= ring.capacity());
+  printf("LogRing of %d bytes: %.0f ns per line, %zu allocations, %zu lines kept\n", LOG_RING_SIZE, ns,
+         hostAllocations - allocations, ring.count());
+
+  LogEntry entry;
+  CHECK(ring.find(0, entry) && entry.seq == ring.firstSeq());
+  CHECK(ring.find(LINES, entry) && entry.seq == LINES);
+  char line[96];
+  CHECK(entry.length == (uint16_t)format(line, sizeof(line), LINES - 1) && strcmp(entry.text, line) == 0);
+  CHECK(strcmp(entry.scope, "plan") == 0);
+  CHECK(!ring.find(LINES + 1, entry));
+
+  return report();
+}
@@ -0,0 +1,198 @@
+// SprinklerRunRecord encoding and the SprinklerRecovery rules, over boots
+// simulated by fresh SprinklerRecovery objects on the same RTC record, and
+// the refresh of remaining times while zones water.
+
+#include <rom/crc.h>
+#include <stddef.h>
+
+#include "sprinkler-loop.h"
+#include "sprinkler-recovery.h"
+#include "sprinkler-state.h"
+#include "test.h"
+
+#define SECOND 1000000LL
+
+SprinklerRunRecord running() {
+  SprinklerRunRecord record;
+  record.clear();
+  record.watering = 0x5;  // zones 1 and 3
+  record.paused = 0x4;
+  record.sequence = 1;
+  record.duration[0] = 30;
+  record.remaining[0] = 1200;
+  record.duration[2] = 600;  // longer than 255 minutes
+  record.remaining[2] = 36000;
+  record.seal();
+  return record;
+}
+
+// what the next boot decides after a reset of the given reason
+RecoveryAction boot(esp_reset_reason_t reason, SprinklerRecovery &recovery) {
+  hostResetReason = reason;
+  recovery.begin();
+  recovery.resumed(recovery.action() == RecoveryResume);
+  return recovery.action();
+}
+
+int main() {
+  // encoding
+  CHECK(sizeof(SprinklerRunRecord) <= 16 + 4 * SKETCH_MAX_ZONES + 4);
+  CHECK(offsetof(SprinklerRunRecord, magic) == 0);
+  CHECK(offsetof(SprinklerRunRecord, crc) == sizeof(SprinklerRunRecord) - 4);
+
+  uint8_t check[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+  CHECK(crc32_le(0, check, sizeof(check)) == 0xCBF43926);  // the host ROM crc is CRC-32
+
+  SprinklerRunRecord idle;
+  idle.clear();
+  CHECK(idle.isValid());
+  CHECK(idle.isIdle());
+  CHECK(idle.magic == RECOVERY_MAGIC);
+
+  SprinklerRunRecord record = running();
+  CHECK(record.isValid());
+  CHECK(!record.isIdle());
+  CHECK(record.duration[2] == 600 && record.remaining[2] == 36000);
+
+  // any byte flipped before the crc invalidates the record
+  bool detected = true;
+  for (size_t i = 0; i < offsetof(SprinklerRunRecord, crc); i++) {
+    SprinklerRunRecord corrupt = record;
+    ((uint8_t *)&corrupt)[i] ^= 0x10;
+    detected = detected && !corrupt.isValid();
+  }
+  CHECK(detected);
+
+  SprinklerRunRecord unsealed = record;
+  unsealed.remaining[0]--;
+  CHECK(!unsealed.isValid());
+  unsealed.seal();
+  CHECK(unsealed.isValid());
+
+  SprinklerRunRecord noise;
+  memset(&noise, 0xA5, sizeof(noise));  // RTC memory after a power cycle
+  CHECK(!noise.isValid());
+
+  // rules
+  const esp_reset_reason_t resumes[] = {ESP_RST_BROWNOUT, ESP_RST_PANIC, ESP_RST_INT_WDT, ESP_RST_TASK_WDT, ESP_RST_WDT};
+  const esp_reset_reason_t aborts[] = {ESP_RST_UNKNOWN, ESP_RST_POWERON, ESP_RST_EXT, ESP_RST_SW, ESP_RST_DEEPSLEEP, ESP_RST_SDIO};
+  for (esp_reset_reason_t reason : resumes) {
+    CHECK(SprinklerRecovery::decide(record, reason) == RecoveryResume);
+    CHECK(SprinklerRecovery::decide(idle, reason) == RecoveryNone);
+    CHECK(SprinklerRecovery::decide(noise, reason) == RecoveryNone);
+  }
+  for (esp_reset_reason_t reason : aborts) {
+    CHECK(SprinklerRecovery::decide(record, reason) == RecoveryAbort);
+    CHECK(SprinklerRecovery::decide(idle, reason) == RecoveryNone);
+  }
+
+  SprinklerRunRecord tired = record;
+  tired.resumes = RECOVERY_MAX_RESUMES - 1;
+  tired.seal();
+  CHECK(SprinklerRecovery::decide(tired, ESP_RST_BROWNOUT) == RecoveryResume);
+  tired.resumes = RECOVERY_MAX_RESUMES;
+  tired.seal();
+  CHECK(SprinklerRecovery::decide(tired, ESP_RST_BROWNOUT) == RecoveryAbort);
+
+  // boots: a pump that browns the unit out on every start is given up on
+  {
+    SprinklerRecovery first;
+    CHECK(boot(ESP_RST_POWERON, first) == RecoveryNone);  // RTC memory holds no record yet
+    SprinklerRunRecord run = running();
+    first.save(run);
+  }
+  for (int i = 0; i < RECOVERY_MAX_RESUMES; i++) {
+    SprinklerRecovery next;
+    CHECK(boot(ESP_RST_BROWNOUT, next) == RecoveryResume);
+    CHECK(next.record().remaining[2] == 36000);
+    CHECK(next.reason() == ESP_RST_BROWNOUT);
+    SprinklerRunRecord run = next.record();
+    next.save(run);
+  }
+  {
+    SprinklerRecovery last;
+    CHECK(boot(ESP_RST_BROWNOUT, last) == RecoveryAbort);
+    SprinklerRunRecord run;
+    run.clear();
+    last.save(run);
+  }
+
+  // the run finished, the next one gets its resumes back
+  {
+    SprinklerRecovery next;
+    CHECK(boot(ESP_RST_POWERON, next) == RecoveryNone);
+    SprinklerRunRecord run = running();
+    next.save(run);
+  }
+  {
+    SprinklerRecovery next;
+    CHECK(boot(ESP_RST_TASK_WDT, next) == RecoveryResume);
+  }
+
+  // an intentional restart discards the run
+  {
+    SprinklerRecovery next;
+    CHECK(boot(ESP_RST_SW, next) == RecoveryAbort);
+  }
+
+  // remaining times are re-saved while zones water, so a reset late in a
+  // run resumes with what was left of it
+  Loop.begin();
+  {
+    SprinklerRecovery first;
+    CHECK(boot(ESP_RST_POWERON, first) == RecoveryAbort);  // the run restarted above
+    CHECK(first.deadline() == LOOP_IDLE);
+
+    SprinklerState timers;
+    timers.start(1, 20, [] {});
+    timers.start(2, 20, [] {});
+    timers.pause(2);
+    first.save(timers);
+    CHECK(first.deadline() == RECOVERY_REFRESH);
+
+    // the loop as handleTimers() and timersDeadline() drive it
+    int saves = 0;
+    for (int64_t until = hostMicros + 15 * 60 * SECOND + 30 * SECOND; hostMicros < until;) {
+      unsigned long wait = first.deadline();
+      if (wait == 0) {
+        first.save(timers);
+        saves++;
+        continue;
+      }
+      hostAdvance(std::min<int64_t>((int64_t)wait * 1000, until - hostMicros));
+    }
+    CHECK(saves == 15);
+    CHECK(first.deadline() == RECOVERY_REFRESH - 30 * 1000);
+
+    timers.pause(1);
+    first.save(timers);  // as SprinklerControl::pause() and resume() do
+    CHECK(first.deadline() == LOOP_IDLE);  // paused zones keep their remaining time
+    timers.resume(1);
+    first.save(timers);
+    CHECK(first.deadline() == RECOVERY_REFRESH);
+    hostAdvance(50 * SECOND);  // browns out before the next refresh
+  }
+  {
+    SprinklerRecovery next;
+    CHECK(boot(ESP_RST_BROWNOUT, next) == RecoveryResume);
+    const SprinklerRunRecord &record = next.record();
+    CHECK(record.watering == 0x3 && record.paused == 0x2);
+    CHECK(record.elapsed(1) == 15 * 60 + 30);
+    CHECK(record.elapsed(2) == 0);
+    CHECK(record.elapsed(0) == 0 && record.elapsed(SKETCH_MAX_ZONES + 1) == 0);
+
+    // picked up from the record as SprinklerControl::recover() does
+    SprinklerState timers;
+    timers.start(1, record.duration[0], [] {}, record.elapsed(1));
+    CHECK(timers.remaining(1) == 4 * 60 + 30);
+    next.save(timers);
+  }
+  {
+    SprinklerRecovery again;
+    CHECK(boot(ESP_RST_TASK_WDT, again) == RecoveryResume);
+    CHECK(again.record().resumes == 1);
+    CHECK(again.record().elapsed(1) == 15 * 60 + 30);
+  }
+
+  return report();
+}
@@ -0,0 +1,142 @@
+// RelayQueue staging on an injected clock, applied to the mock relay driver
+// the way SprinklerDevice::handleRelays() does.
+
+#include "sprinkler-loop.h"
+#include "sprinkler-relay.h"
+#include "test.h"
+
+#define MS 1000LL
+#define PUMP ((RelayMask)1)
+#define ZONE(n) ((RelayMask)1 << (n))
+#define ALL (((RelayMask)1 << (SKETCH_MAX_ZONES + 1)) - 1)
+
+RelayQueue queue;
+MockRelayDriver driver;
+RelayMask relays = 0;
+int64_t now = 1000 * MS;
+bool pumpAlone = false;  // the pump ran with every valve closed
+
+// apply the steps due by t, as SprinklerDevice does
+int run(int64_t t) {
+  int applied = 0;
+  RelayTransition step;
+  while (queue.pop(step, t)) {
+    RelayMask state = (relays | step.on) & ~step.off;
+    if ((state ^ relays) >> 1) {
+      driver.write((ZoneMask)(state >> 1));
+    }
+    relays = state;
+    pumpAlone |= (relays & PUMP) && !(relays >> 1);
+    queue.applied(step, t);
+    applied++;
+  }
+  return applied;
+}
+
+// apply everything, stepping the clock to each deadline
+void settle() {
+  for (unsigned long wait = queue.deadline(now); wait != LOOP_IDLE; wait = queue.deadline(now)) {
+    now += wait * MS;
+    run(now);
+  }
+}
+
+int main() {
+  Loop.begin();
+  driver.begin();
+
+  // the valve opens at once, the pump after the lead
+  CHECK(queue.push(relays, ZONE(2) | PUMP, 0, now));
+  CHECK(run(now) == 1);
+  CHECK(relays == ZONE(2));
+  CHECK(driver.state == 0x2);
+  CHECK(queue.deadline(now) == RELAY_PUMP_LEAD);
+  CHECK(run(now + RELAY_PUMP_LEAD * MS - 1) == 0);
+  now += RELAY_PUMP_LEAD * MS;
+  CHECK(run(now) == 1);
+  CHECK(relays == (ZONE(2) | PUMP));
+  CHECK(driver.writes == 1);  // the pump is not a zone relay
+  CHECK(queue.deadline(now) == LOOP_IDLE);
+
+  // the pump stops first, the valves close after the lag
+  CHECK(queue.push(relays, 0, ZONE(2) | PUMP, now));
+  CHECK(run(now) == 1);
+  CHECK(relays == ZONE(2));
+  CHECK(queue.deadline(now) == RELAY_PUMP_LAG);
+  now += RELAY_PUMP_LAG * MS;
+  CHECK(run(now) == 1);
+  CHECK(relays == 0);
+  CHECK(driver.state == 0);
+
+  // valves energize one at a time, the pump after the last one
+  now += 10000 * MS;
+  int64_t start = now;
+  CHECK(queue.push(relays, ZONE(1) | ZONE(3) | ZONE(5) | PUMP, 0, now));
+  CHECK(run(now) == 1);
+  CHECK(relays == ZONE(1));
+  now += RELAY_SWITCH_GAP * MS;
+  CHECK(run(now) == 1);
+  CHECK(relays == (ZONE(1) | ZONE(3)));
+  now += RELAY_SWITCH_GAP * MS;
+  CHECK(run(now) == 1);
+  CHECK(driver.state == 0x15);
+  settle();
+  CHECK(relays == (ZONE(1) | ZONE(3) | ZONE(5) | PUMP));
+  CHECK(now - start == (2 * RELAY_SWITCH_GAP + RELAY_PUMP_LEAD) * MS);
+
+  // a request spaced from the previous energizing waits for the gap
+  CHECK(queue.push(relays, ZONE(6), 0, now));
+  CHECK(run(now) == 0);
+  CHECK(queue.deadline(now) == RELAY_SWITCH_GAP);
+  settle();
+  CHECK(relays & ZONE(6));
+
+  // all off at once: pump, then every valve in one driver write
+  uint32_t writes = driver.writes;
+  CHECK(queue.push(relays, 0, ALL, now));
+  settle();
+  CHECK(relays == 0);
+  CHECK(driver.state == 0);
+  CHECK(driver.writes == writes + 1);
+
+  // a newer request cancels the pending steps of the same relays
+  now += 10000 * MS;
+  CHECK(queue.push(relays, ZONE(4) | PUMP, 0, now));
+  CHECK(run(now) == 1);
+  CHECK(queue.push(relays, 0, ZONE(4) | PUMP, now));
+  settle();
+  CHECK(relays == 0);
+
+  now += 10000 * MS;
+  CHECK(queue.push(relays, ZONE(1) | ZONE(2) | PUMP, 0, now));
+  CHECK(queue.push(relays, 0, ZONE(2), now));  // before zone 2 was due
+  settle();
+  CHECK(relays == (ZONE(1) | PUMP));
+  CHECK(queue.push(relays, 0, ALL, now));
+  settle();
+
+  // toggles faster than the control task pops fill the queue, the device
+  // then switches at once
+  now += 10000 * MS;
+  int pushed = 0;
+  while (queue.push(relays, pushed % 2 ? 0 : ALL, pushed % 2 ? ALL : 0, now)) {
+    pushed++;
+  }
+  CHECK(pushed == 3);
+  queue.clear();
+  CHECK(queue.deadline(now) == LOOP_IDLE);
+  CHECK(run(now) == 0);
+
+  CHECK(!pumpAlone);
+
+  // latency of the applied steps
+  char buffer[128];
+  JsonBuffer out(buffer, sizeof(buffer));
+  JsonWriter json(out);
+  queue.toJSON(json);
+  CHECK(strstr(buffer, "\"pending\":0") != nullptr);
+  CHECK(strstr(buffer, "\"maxLatencyMs\":2500") != nullptr);
+  printf("%s\n", buffer);
+
+  return report();
+}
@@ -0,0 +1,107 @@
+// SprinklerState slots against the previous std::map of heap timers, each
+// with its own Ticker: 1M start/stop cycles and heap allocations per call.
+
+#include <map>
+
+#include "sprinkler-loop.h"
+#include "sprinkler-state.h"
+#include "test.h"
+
+#define CYCLES 1000000L
+
+// the previous SprinklerState, one esp_timer per run as the core's Ticker does
+struct PreviousTimer {
+  typedef std::function<void()> OnStopCallback;
+
+  PreviousTimer(unsigned int zone, unsigned int duration, OnStopCallback onStop)
+      : Zone(zone), Duration(duration), StartTime(millis()), PauseTime(0), OnStop(onStop) {
+    esp_timer_create_args_t args = {};
+    args.callback = +[](void *arg) { ((PreviousTimer *)arg)->OnStop(); };
+    args.arg = this;
+    esp_timer_create(&args, &timer);
+    esp_timer_start_once(timer, (uint64_t)(duration ? duration : 5) * 60 * 1000 * 1000);
+  }
+  ~PreviousTimer() {
+    esp_timer_stop(timer);
+    esp_timer_delete(timer);
+  }
+
+  unsigned int Zone;
+  unsigned int Duration;
+  unsigned long StartTime;
+  unsigned long PauseTime;
+  OnStopCallback OnStop;
+  esp_timer_handle_t timer;
+};
+
+struct PreviousState {
+  std::map<unsigned int, PreviousTimer *> Timers;
+
+  void start(unsigned int zone, unsigned int duration, PreviousTimer::OnStopCallback onStop) {
+    if (Timers.find(zone) != Timers.end()) {
+      delete Timers[zone];
+      Timers.erase(zone);
+    }
+    Timers[zone] = new PreviousTimer(zone, duration, onStop);
+  }
+
+  void stop(unsigned int zone) {
+    if (Timers.find(zone) != Timers.end()) {
+      delete Timers[zone];
+      Timers.erase(zone);
+    }
+  }
+
+  bool isWatering(unsigned int zone) { return Timers.find(zone) != Timers.end(); }
+};
+
+SprinklerState state;
+PreviousState previous;
+int stops = 0;
+
+int main() {
+  Loop.begin();
+
+  // the first start sets up the shared clock and the queue
+  state.start(1, 10, [] { stops++; });
+  state.stop(1);
+
+  size_t before = hostAllocations;
+  double ns = measure(CYCLES, [](long i) {
+    unsigned int zone = 1 + i % SKETCH_MAX_ZONES;
+    state.start(zone, 10, [zone] { stops += zone; });  // captures like SprinklerControl::start()
+    state.stop(zone);
+  });
+  double allocations = (double)(hostAllocations - before) / (2 * CYCLES);
+  CHECK(hostAllocations == before);
+  CHECK(state.count() == 0);
+  printf("SprinklerState: %.1f ns per start + stop, %.2f allocations per call\n", ns, allocations);
+
+  for (unsigned int zone = 1; zone <= SKETCH_MAX_ZONES; zone++) {
+    state.start(zone, 10, [zone] { stops += zone; });
+  }
+  before = hostAllocations;
+  ns = measure(CYCLES, [](long i) {
+    unsigned int zone = 1 + i % SKETCH_MAX_ZONES;
+    state.pause(zone);
+    state.resume(zone);
+    volatile bool watering = state.isWatering(zone) && state.count() == SKETCH_MAX_ZONES;
+    (void)watering;
+  });
+  CHECK(hostAllocations == before);
+  printf("SprinklerState: %.1f ns per pause + resume + isWatering() + count(), %.2f allocations per call\n", ns,
+         (double)(hostAllocations - before) / (2 * CYCLES));
+
+  before = hostAllocations;
+  ns = measure(CYCLES, [](long i) {
+    unsigned int zone = 1 + i % SKETCH_MAX_ZONES;
+    previous.start(zone, 10, [zone] { stops += zone; });
+    previous.stop(zone);
+  });
+  CHECK(previous.Timers.empty());
+  printf("previous std::map + new + Ticker: %.1f ns per start + stop, %.2f allocations per call\n", ns,
+         (double)(hostAllocations - before) / (2 * CYCLES));
+
+  CHECK(stops == 0);
+  return report();
+}
@@ -0,0 +1,120 @@
+// SprinklerState on a virtual clock: one shared deadline timer, expiries
+// handed to the loop through the queue, pause/resume re-arms, stale tokens.
+
+#include "sprinkler-loop.h"
+#include "sprinkler-state.h"
+#include "test.h"
+
+#define SECOND 1000000LL
+
+SprinklerState state;
+int stops[SKETCH_MAX_ZONES + 1];
+
+void start(unsigned int zone, unsigned int minutes, unsigned int elapsed = 0) {
+  state.start(zone, minutes, [zone] {
+    stops[zone]++;
+    state.stop(zone);
+  }, elapsed);
+}
+
+int main() {
+  Loop.begin();
+
+  // expiries run on the loop, not on the timer
+  start(1, 1);
+  start(2, 2);
+  CHECK(state.count() == 2);
+  hostAdvance(59 * SECOND);
+  CHECK(state.deadline() == LOOP_IDLE);
+  hostNotifications = 0;
+  hostAdvance(1 * SECOND);
+  CHECK(stops[1] == 0);
+  CHECK(state.deadline() == 0);
+  CHECK(hostNotifications > 0);
+  state.handle();
+  CHECK(stops[1] == 1);
+  CHECK(!state.isWatering(1));
+  CHECK(state.isWatering(2));
+  CHECK(state.remaining(2) == 60);
+  CHECK(state.deadline() == LOOP_IDLE);
+
+  hostAdvance(60 * SECOND);
+  state.handle();
+  CHECK(stops[2] == 1);
+  CHECK(state.count() == 0);
+
+  // a paused zone keeps its remaining time and does not expire
+  start(3, 1);
+  hostAdvance(30 * SECOND);
+  state.pause(3);
+  CHECK(state.isPaused(3));
+  CHECK(!state.isWatering());
+  hostAdvance(600 * SECOND);
+  state.handle();
+  CHECK(stops[3] == 0);
+  CHECK(state.remaining(3) == 30);
+  state.resume(3);
+  hostAdvance(29 * SECOND);
+  state.handle();
+  CHECK(stops[3] == 0);
+  hostAdvance(1 * SECOND);
+  state.handle();
+  CHECK(stops[3] == 1);
+
+  // an expiry queued for a run that was restarted since is dropped
+  start(4, 1);
+  hostAdvance(60 * SECOND);
+  CHECK(state.deadline() == 0);
+  start(4, 1);
+  state.handle();
+  CHECK(stops[4] == 0);
+  CHECK(state.isWatering(4));
+  CHECK(state.remaining(4) == 60);
+
+  // stopped and paused zones drop theirs as well
+  start(5, 1);
+  hostAdvance(60 * SECOND);
+  state.stop(5);
+  state.pause(4);
+  state.handle();
+  CHECK(stops[4] == 0 && stops[5] == 0);
+  state.stop(4);
+
+  // a paused zone is still active until it is stopped, which frees its slot
+  start(5, 1);
+  state.pause(5);
+  CHECK(state.isActive(5) && !state.isWatering(5));
+  state.stop(5);
+  CHECK(!state.isActive(5) && !state.isPaused(5));
+  CHECK(state.deadline() == LOOP_IDLE);
+  state.resume(5);
+  CHECK(!state.isActive(5));
+  hostAdvance(120 * SECOND);
+  state.handle();
+  CHECK(stops[5] == 0);
+
+  // a resumed run expires after what was left of it
+  start(6, 1, 50);
+  CHECK(state.remaining(6) == 10);
+  hostAdvance(10 * SECOND);
+  state.handle();
+  CHECK(stops[6] == 1);
+
+  // zones expiring together are all handed over
+  for (unsigned int zone = 1; zone <= SKETCH_MAX_ZONES; zone++) {
+    start(zone, 5);
+  }
+  hostAdvance(300 * SECOND);
+  state.handle();
+  for (unsigned int zone = 1; zone <= SKETCH_MAX_ZONES; zone++) {
+    CHECK(!state.isWatering(zone));
+  }
+  CHECK(stops[1] == 2 && stops[6] == 2);
+
+  // zones out of range are ignored
+  start(0, 1);
+  start(SKETCH_MAX_ZONES + 1, 1);
+  CHECK(state.count() == 0);
+
+  return report();
+}
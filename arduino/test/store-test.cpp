@@ -0,0 +1,185 @@
+// SprinklerStore on a RAM partition: 100k config updates and the erases
+// they leave per sector, what a boot loads and how long its scan takes, and
+// power cuts at every flash operation of the writes that compact.
+
+#include <stddef.h>
+
+#include <vector>
+
+#include "sprinkler-store.h"
+#include "test.h"
+
+#define PARTITION_SIZE 0x10000  // partitions.csv
+#define SECTORS (PARTITION_SIZE / STORE_SECTOR_SIZE)
+#define UPDATES 100000L
+
+// the bytes the store keeps of a config; the rest is padding
+bool same(const SprinklerConfig &a, const SprinklerConfig &b) {
+  size_t end = offsetof(SprinklerConfig, sequence) + sizeof(SprinklerSequenceConfig);
+  return memcmp(&a, &b, end) == 0 && memcmp(&a.zones, &b.zones, sizeof(a.zones)) == 0;
+}
+
+void defaults(SprinklerConfig &cfg) {
+  memset((void *)&cfg, 0, sizeof(SprinklerConfig));
+  cfg.version = 1;
+  strcpy(cfg.host_name, "sprinkler");
+  strcpy(cfg.disp_name, "Sprinkler");
+  cfg.mqtt_port = 1883;
+  for (uint8_t i = 0; i < SKETCH_MAX_ZONES; i++) {
+    cfg.zones[i].defined = true;
+    snprintf(cfg.zones[i].disp_name, sizeof(cfg.zones[i].disp_name), "Zone %d", i + 1);
+  }
+}
+
+// changes a single section: a schedule toggle mostly, now and then a setting
+void update(SprinklerConfig &cfg, long i) {
+  if (i % 100 == 0) {
+    cfg.loglevel = i / 100 % 4;
+  } else if (i % 1000 == 1) {
+    cfg.mqtt_port = 1883 + i / 1000 % 2;
+  } else if (i % 250 == 2) {
+    cfg.sequence.gap = i / 250 % 10;
+  } else {
+    SprinklerTimerConfig &timer = cfg.zones[i % SKETCH_MAX_ZONES].days[i / SKETCH_MAX_ZONES % 8];
+    timer.defined = !timer.defined;
+    timer.h = i % 24;
+    timer.m = i % 60;
+    timer.d = i % 120;
+  }
+}
+
+StoreSectorHeader header(uint8_t sector) {
+  StoreSectorHeader h;
+  memcpy(&h, hostFlash() + (size_t)sector * STORE_SECTOR_SIZE, sizeof(h));
+  return h;
+}
+
+uint8_t freeSectors() {
+  uint8_t free = 0;
+  for (uint8_t s = 0; s < SECTORS; s++) {
+    StoreSectorHeader h = header(s);
+    free += h.magic == STORE_MAGIC && h.seq == 0xFFFFFFFF;
+  }
+  return free;
+}
+
+uint32_t erasesInAll() {
+  uint32_t total = 0;
+  for (uint8_t s = 0; s < SECTORS; s++) {
+    total += hostSectorErases(s);
+  }
+  return total;
+}
+
+// what the next boot loads
+bool reboot(SprinklerStore &store, SprinklerConfig &cfg) {
+  store = SprinklerStore();
+  return store.begin() && store.load(cfg);
+}
+
+SprinklerStore store;
+SprinklerConfig expected;
+SprinklerConfig loaded;
+
+int main() {
+  hostPartition(0);
+  CHECK(!store.begin());  // no partition, the firmware stays on EEPROM
+
+  hostPartition(PARTITION_SIZE);
+  CHECK(store.begin());
+  CHECK(freeSectors() == SECTORS - 1);  // the head is opened
+  CHECK(!store.load(loaded));
+
+  defaults(expected);
+  CHECK(store.write(expected) > 0);
+  CHECK(store.write(expected) == 0);  // nothing changed
+  CHECK(reboot(store, loaded) && same(loaded, expected));
+
+  // 100k updates, a boot every 10k
+  size_t written = 0;
+  bool loads = true;
+  for (long i = 0; i < UPDATES; i++) {
+    update(expected, i);
+    written += store.write(expected);
+    if (i % 10000 == 9999) {
+      loads = loads && reboot(store, loaded) && same(loaded, expected);
+    }
+  }
+  CHECK(loads);
+  CHECK(freeSectors() >= 1);
+
+  // every sector takes its turn, the counts in the headers are the real ones
+  uint32_t least = hostSectorErases(0), most = least, total = 0;
+  bool counted = true;
+  printf("erases per sector after %ld updates:", UPDATES);
+  for (uint8_t s = 0; s < SECTORS; s++) {
+    uint32_t erases = hostSectorErases(s);
+    least = min(least, erases);
+    most = max(most, erases);
+    total += erases;
+    counted = counted && header(s).erases == erases;
+    printf(" %u", erases);
+  }
+  printf("\n%zu bytes appended per update, %u erases in all, %u to %u per sector; EEPROM erased one sector %ld times\n",
+         written / UPDATES, total, least, most, UPDATES);
+  CHECK(counted);
+  CHECK(most - least <= 1);
+  CHECK(most < UPDATES / 100);
+
+  double ns = measure(1000, [](long) { reboot(store, loaded); });
+  CHECK(same(loaded, expected));
+  printf("boot scan of %d sectors: %.1f us\n", SECTORS, ns / 1000);
+
+  // power cuts at each flash operation of a write that compacts: the next
+  // boot loads the config before or after it and finishes the compaction,
+  // also when the cut left a torn copy in the sector it compacted into
+  hostPartition(PARTITION_SIZE);
+  store = SprinklerStore();
+  CHECK(store.begin());
+  defaults(expected);
+  store.write(expected);
+
+  std::vector<uint8_t> before(PARTITION_SIZE), after(PARTITION_SIZE);
+  int compactions = 0, cuts = 0, interrupted = 0;
+  bool recovered = true;
+  for (long i = 0; compactions < 20; i++) {
+    SprinklerConfig previous = expected;
+    SprinklerStore saved = store;
+    memcpy(before.data(), hostFlash(), PARTITION_SIZE);
+    uint32_t erases = erasesInAll();
+
+    update(expected, i);
+    hostFlashBudget = 1000;
+    store.write(expected);
+    long operations = 1000 - hostFlashBudget;
+    hostFlashBudget = -1;
+    if (erasesInAll() == erases) {
+      continue;  // only the writes that erase the oldest sector
+    }
+    compactions++;
+    memcpy(after.data(), hostFlash(), PARTITION_SIZE);
+
+    for (long cut = 0; cut < operations; cut++) {
+      memcpy(hostFlash(), before.data(), PARTITION_SIZE);
+      SprinklerStore unit = saved;
+      hostFlashBudget = cut;
+      unit.write(expected);
+      hostFlashBudget = -1;
+      cuts++;
+      interrupted += freeSectors() == 0;
+
+      SprinklerStore boot;
+      recovered = recovered && reboot(boot, loaded) && (same(loaded, previous) || same(loaded, expected));
+      recovered = recovered && freeSectors() == 1;  // the spare is erased again
+      boot.write(expected);  // the caller saves again
+      recovered = recovered && reboot(boot, loaded) && same(loaded, expected);
+    }
+
+    memcpy(hostFlash(), after.data(), PARTITION_SIZE);
+  }
+  printf("%d power cuts in %d compacting writes, %d left no sector free, all finished on the next begin()\n", cuts, compactions, interrupted);
+  CHECK(recovered);
+  CHECK(interrupted > 0);
+
+  return report();
+}
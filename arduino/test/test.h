@@ -0,0 +1,42 @@
+// Checks shared by the host tests.
+
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+
+#include <chrono>
+
+#include "host.h"
+
+static int failures = 0;
+
+#define CHECK(condition)                                             \
+  do {                                                               \
+    if (!(condition)) {                                              \
+      printf("%s:%d: failed: %s\n", __FILE__, __LINE__, #condition); \
+      failures++;                                                    \
+    }                                                                \
+  } while (0)
+
+// exit code of main()
+inline int report() {
+  if (failures) {
+    printf("%d failed\n", failures);
+    return 1;
+  }
+  printf("all passed\n");
+  return 0;
+}
+
+// ns per iteration of body
+template <typename F>
+double measure(long iterations, F body) {
+  auto start = std::chrono::steady_clock::now();
+  for (long i = 0; i < iterations; i++) {
+    body(i);
+  }
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / iterations;
+}
+
+#endif
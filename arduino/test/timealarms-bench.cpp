@@ -0,0 +1,82 @@
+// TimeAlarms heap scheduler: a week of 2,500 alarms serviced once per second.
+
+#include <TimeAlarms.h>
+
+#include <vector>
+
+#include "test.h"
+
+#define WEEKLY 2000
+#define TIMERS 500
+#define FREED 400
+
+int main() {
+  hostTime = 1700000000;  // a tuesday, 22:13:20
+
+  std::vector<AlarmID_t> ids;
+  std::vector<int> fired(WEEKLY + TIMERS);
+  std::vector<bool> onTime(WEEKLY, true);
+  std::vector<time_t> at(WEEKLY);
+
+  for (int i = 0; i < WEEKLY; i++) {
+    timeDayOfWeek_t day = (timeDayOfWeek_t)(dowSunday + i % 7);
+    int h = i % 24, m = (i / 24) % 60, s = 1 + i % 59;  // sunday 00:00:00 is not a valid weekly alarm
+    at[i] = (day - 1) * SECS_PER_DAY + AlarmHMS(h, m, s);
+    ids.push_back(Alarm.alarmRepeat(day, h, m, s, [&, i] {
+      fired[i]++;
+      onTime[i] = onTime[i] && elapsedSecsThisWeek(now()) == at[i];
+    }));
+  }
+  for (int i = 0; i < TIMERS; i++) {
+    ids.push_back(Alarm.timerRepeat(60 + i, [&, i] { fired[WEEKLY + i]++; }));
+  }
+  for (int i = 0; i < FREED; i++) {
+    Alarm.free(ids[i * 5]);
+  }
+
+  CHECK(Alarm.count() == WEEKLY + TIMERS - FREED);
+  for (AlarmID_t id : ids) {
+    CHECK(id != dtINVALID_ALARM_ID);
+  }
+
+  // one pass of the loop per second for a week
+  long passes = 0, services = 0;
+  double ns = measure(SECS_PER_WEEK, [&](long) {
+    hostTime++;
+    passes++;
+    if (Alarm.isDue()) {
+      services++;
+      Alarm.serviceAlarms();
+    }
+  });
+
+  for (int i = 0; i < WEEKLY; i++) {
+    bool freed = i % 5 == 0 && i / 5 < FREED;
+    CHECK(fired[i] == (freed ? 0 : 1));
+    CHECK(onTime[i]);
+  }
+  for (int i = 0; i < TIMERS; i++) {
+    CHECK(fired[WEEKLY + i] == SECS_PER_WEEK / (60 + i));
+  }
+  CHECK(Alarm.getNextTrigger() > now());
+
+  long total = 0;
+  for (int n : fired) {
+    total += n;
+  }
+  printf("%zu alarms, %ld passes, %ld with alarms due, %ld alarms fired\n", Alarm.count(), passes, services, total);
+  printf("%.0f ns per loop pass, isDue() and serviceAlarms() included\n", ns);
+
+  // isDue() alone, nothing due
+  volatile bool due = false;
+  ns = measure(10000000, [&](long) { due = due | Alarm.isDue(); });
+  printf("%.1f ns per isDue()\n", ns);
+
+  // create and free next to a full heap
+  size_t before = Alarm.count();
+  ns = measure(1000000, [&](long i) { Alarm.free(Alarm.timerOnce(1 + i % 3600, [] {})); });
+  CHECK(Alarm.count() == before);
+  printf("%.0f ns per timerOnce() + free()\n", ns);
+
+  return report();
+}
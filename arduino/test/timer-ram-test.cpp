@@ -0,0 +1,79 @@
+// RAM per schedule timer: the packed SprinklerTimer kept by value against the
+// previous heap-allocated one. The ESP32 is ILP32 with a 32-bit time_t, the
+// previous layout is mirrored with fixed-width fields.
+
+#include "sprinkler-schedule.h"
+#include "test.h"
+
+#define TIMERS 1000
+
+// the previous SprinklerTimer: timeDayOfWeek_t, unsigned int and time_t
+struct PreviousTimer {
+  int32_t Day;
+  uint32_t Duration;
+  int32_t Time;
+
+  PreviousTimer(timeDayOfWeek_t day) : Day(day), Duration(0), Time(0) {}
+};
+
+// ESP-IDF multi_heap: 4-byte granularity and a 4-byte block header
+size_t heapCost(size_t size) { return ((size + 3) & ~(size_t)3) + 4; }
+
+// fills a day as the settings parser does through ScheduleDay::add()
+class FilledDay : public ScheduleDay {
+ public:
+  FilledDay(timeDayOfWeek_t day) : ScheduleDay(day) {}
+
+  void fill(size_t count) {
+    Timers.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+      Timers.emplace_back(Day);
+    }
+  }
+};
+
+int main() {
+  CHECK(sizeof(SprinklerTimer) == 4);
+  CHECK(sizeof(PreviousTimer) == 12);
+
+  size_t previous = heapCost(sizeof(PreviousTimer)) + 4;  // object and the vector's 32-bit pointer
+  printf("ESP32 RAM per timer: %zu bytes before (%zu byte object, heap header, pointer), %zu bytes now\n", previous,
+         sizeof(PreviousTimer), sizeof(SprinklerTimer));
+  CHECK(previous == 20);
+
+  size_t allocations = hostAllocations, allocated = hostAllocated;
+  {
+    std::vector<PreviousTimer *> timers;
+    timers.reserve(TIMERS);
+    for (int i = 0; i < TIMERS; i++) {
+      timers.push_back(new PreviousTimer(dowMonday));
+    }
+    printf("host, %d timers before: %zu allocations, %zu bytes\n", TIMERS, hostAllocations - allocations,
+           hostAllocated - allocated);
+    CHECK(hostAllocations - allocations == TIMERS + 1);
+    for (PreviousTimer *timer : timers) {
+      delete timer;
+    }
+  }
+
+  allocations = hostAllocations;
+  allocated = hostAllocated;
+  {
+    FilledDay day(dowMonday);
+    day.fill(TIMERS);
+    printf("host, %d timers now: %zu allocations, %zu bytes\n", TIMERS, hostAllocations - allocations,
+           hostAllocated - allocated);
+    CHECK(hostAllocations - allocations == 1);
+    CHECK(hostAllocated - allocated == TIMERS * sizeof(SprinklerTimer));
+    CHECK(day.size() == TIMERS);
+    CHECK(!day.isEnabled());  // no duration yet
+  }
+
+  // the fields in the packed record
+  SprinklerTimer timer(dowSaturday);
+  CHECK(timer.dow() == dowSaturday);
+  CHECK(timer.hours() == 0 && timer.minutes() == 0 && timer.duration() == 0);
+  CHECK(!timer.isEnabled());
+
+  return report();
+}
@@ -196,7 +196,21 @@ export class Menu extends HTMLElement {
     }
 
     this.$scheduleCheck.item().className = state.enabled ? "enabled" : "";
+    this.refreshNextRun().catch((error) => console.error(error));
     this.$btnPump.css('display', state.source == "pump" ? '' : 'none');
     this.$btnPipe.css('display', state.source != "pump" ? '' : 'none');
   }
-}
\ No newline at end of file
+
+  async refreshNextRun() {
+    const { timetable } = await Http.json('GET', 'api/schedule');
+    const next = timetable && timetable.next;
+    const text = this.jQuery('#schedule-text').item();
+    if (next) {
+      const at = new Date(next.time * 1000);
+      const time = at.toLocaleTimeString([], { weekday: 'short', hour: '2-digit', minute: '2-digit' });
+      text.title = `next: zone ${next.zone} at ${time} for ${next.duration} min`;
+    } else {
+      text.title = '';
+    }
+  }
+}
@@ -98,9 +98,8 @@ export class ZoneList extends HTMLElement {
     let hasActive = false;
 
     for (const [zone, timer] of Object.entries(this.activeTimers)) {
-      const elapsed = now - timer.startTime;
-      const total = timer.duration * 60 * 1000;
-      const progress = Math.min(elapsed / total, 1);
+      const remaining = Math.max(timer.endTime - now, 0);
+      const progress = timer.total > 0 ? 1 - remaining / timer.total : 1;
 
       this.jQuery(`.container sketch-checkbox:nth-child(${zone})`).forEach(e => {
         e.progress = progress;
@@ -188,6 +187,8 @@ export class ZoneList extends HTMLElement {
 
   update(timer) {
     const { state, zone, millis, duration } = timer;
+    const total = duration * 60 * 1000;
+    const remainingMs = "remainingMs" in timer ? timer.remainingMs : total - millis;
     if (zone) {
       this.jQuery(`.container sketch-checkbox:nth-child(${zone})`).forEach(
         (e, i) => {
@@ -208,15 +209,15 @@ export class ZoneList extends HTMLElement {
           } else {
             // Started - track for real-time updates
             this.activeTimers[zone] = {
-              startTime: Date.now() - millis,
-              duration: duration
+              endTime: Date.now() + remainingMs,
+              total: millis + remainingMs
             };
             this.startProgressInterval();
             e.style.color = "";
             e.progressColor = "var(--info-background-color)";
             e.checked = true;
             if (duration > 0) {
-              e.progress = millis / (duration * 60 * 1000);
+              e.progress = millis / (millis + remainingMs);
             }
           }
         }
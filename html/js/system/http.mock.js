@@ -68,6 +68,7 @@ function getZoneTimerState(zoneIndex) {
         state: state.paused ? "paused" : "started",
         zone: zoneIndex,
         millis: elapsed,
+        remainingMs: Math.max(state.duration * 60 * 1000 - elapsed, 0),
         duration: state.duration
     };
 }
@@ -208,7 +209,11 @@ function routeRequest(method, url) {
         };
     }
     if (path === '/esp/log') {
-        return { logs: ["[mock] System started", "[mock] WiFi connected", "[mock] HTTP server ready"] };
+        return [
+            { seq: 1, scope: "mock", info: "System started" },
+            { seq: 2, scope: "mock", info: "WiFi connected" },
+            { seq: 3, scope: "mock", info: "HTTP server ready" }
+        ];
     }
 
     // Default empty response
@@ -7,9 +7,13 @@ function* LogItr(logs) {
     }
 }
 
+const MAX_LOG = 1000;
+
 class EventLog {
 
     #log = [];
+    #seq = 0;   // last line seen, from the WebSocket or esp/log
+    #fetching = null;
 
     [Symbol.iterator]() {
         return LogItr(this.#log)
@@ -32,11 +36,11 @@ class EventLog {
         Http.json('POST', 'esp/log/clear').catch(() => {});
     }
 
+    // only the lines missed since the last fetch or event
     async fetch() {
-        this.#log = [];
-        const logs = await Http.json('GET', 'esp/log');
+        const logs = await Http.json('GET', 'esp/log', { since: this.#seq + 1 });
         for (const log of logs) {
-            this.onEvent(log);
+            this.#append(log);
         }
         return this.#log;
     }
@@ -48,8 +52,26 @@ class EventLog {
     }
 
     onEvent(e) {
+        if (e && e.seq < this.#seq) {
+            this.#seq = 0;  // the device restarted its numbering
+        }
+        if (e && this.#seq && e.seq > this.#seq + 1) {
+            // lines were dropped while this client was backed up
+            if (!this.#fetching) {
+                this.#fetching = this.fetch().catch(() => {}).finally(() => this.#fetching = null);
+            }
+            return;
+        }
+        this.#append(e);
+    }
+
+    #append(e) {
         if (e) {
-            
+            if (e.seq) {
+                if (e.seq <= this.#seq) return;
+                this.#seq = e.seq;
+            }
+
             let log = null;
             if (e.info) {
                 log = { level: "info", scope: e.scope, log: e.info };
@@ -61,6 +83,9 @@ class EventLog {
 
             if (log) {
                 this.#log.push(log);
+                if (this.#log.length > MAX_LOG) {
+                    this.#log.splice(0, this.#log.length - MAX_LOG);
+                }
                 document.dispatchEvent(new CustomEvent('sketch-event', { detail: log }));
             }
         }
@@ -92,9 +92,12 @@ export class WsClient {
       ws.onmessage = function (evt) {
         try {
           const e = evt.data ? JSON.parse(evt.data) : {};
-          const type = Object.keys(e)[0];
           console.log(e);
-          fireEvent(type, e[type]);
+          // the device batches messages into one array per frame
+          for (const message of Array.isArray(e) ? e : [e]) {
+            const type = Object.keys(message)[0];
+            fireEvent(type, message[type]);
+          }
         } catch (error) {
           console.error(error);
           console.log(evt.data);